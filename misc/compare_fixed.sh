@@ -0,0 +1,31 @@
+#!/bin/sh
+# Runs compare_fixed on every file in data/ with windows of 512 to 4096
+# points, which -b and PlanAnalysis can pick, and fails if the float and the integer paths decide
+# differently: in any window with the default window of 512 points, and in
+# more than 0.2% of the windows with the larger ones, whose integer FFT
+# scales away more bits.
+#
+#   misc/compare_fixed.sh [<compare_fixed>] [<data directory>]
+
+compare_fixed=${1:-src/compare_fixed}
+data=${2:-data}
+
+# tone of each file in Hz; its sample rate is 44100
+tones="common-mistakes:441 hello-world-slow:204 hello-world:409 special:549
+sw:732 sw-2:936 t-t-finished:624"
+
+result=0
+# hops of 256 samples, i.e. FFTs of 512 to 4096 points
+for hops in 2 4 8 16; do
+  tolerance=0.2
+  [ "$hops" -eq 2 ] && tolerance=0
+  for entry in $tones; do
+    name=${entry%%:*}
+    tone=${entry##*:}
+    bin=$(( (2 * tone * 256 * hops + 44100) / (2 * 44100) ))
+    output=$("$compare_fixed" -b "$hops" -t "$tolerance" \
+      "$data/$name.wav:$bin") || result=1
+    echo "$output" | head -n 1
+  done
+done
+exit $result
@@ -0,0 +1,234 @@
+#include "activity_index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace morse {
+
+static_assert(sizeof(ActivityHeader) == kActivityHeaderSize,
+              "activity header must not be padded");
+static_assert(sizeof(ActivityInterval) == 24,
+              "activity interval must not be padded");
+
+// a hop is active when its energy exceeds the noise floor by 6dB
+static const double kActivityRatio = 4.0;
+// the noise floor follows the energy down at once, and up by this many dB a
+// second so that it catches up with louder noise
+static const double kNoiseFloorRise = 10.0;
+// lowest noise floor as the RMS level of a hop, so that digital silence does
+// not make every click active
+static const double kMinNoiseLevel = 64.0;
+// silence in seconds that separates intervals
+static const double kMaxGap = 3.0;
+// the spectrum is taken on every this many active hops
+static const size_t kSpectrumStride = 4;
+// shorter intervals are taken as clicks
+static const size_t kMinMarks = 3;
+// the lowest bins are below any tone
+static const size_t kMinToneBin = 2;
+
+ActivityScanner::ActivityScanner(size_t hop_size, size_t fft_size,
+                                 double sample_rate)
+    : hop_size_(hop_size), fft_size_(fft_size),
+      max_gap_hops_(static_cast<size_t>(kMaxGap * sample_rate / hop_size)),
+      floor_rise_(pow(10.0, kNoiseFloorRise / 10.0 * hop_size / sample_rate)),
+      history_(fft_size), fft_data_(fft_size), fft_temp_(fft_size),
+      bin_power_(fft_size / 2) {}
+
+void ActivityScanner::Process(const short samples[], size_t num_samples) {
+  double energy = 0.0;
+  for (size_t i = 0; i < num_samples; ++i) {
+    energy += samples[i] * samples[i];
+  }
+  // a partial hop at the end is scaled to a whole one
+  if (num_samples > 0 && num_samples < hop_size_) {
+    energy *= static_cast<double>(hop_size_) / num_samples;
+  }
+  double min_floor = kMinNoiseLevel * kMinNoiseLevel * hop_size_;
+  noise_floor_ = std::max(
+      min_floor, noise_floor_ < 0.0
+                     ? energy
+                     : std::min(energy, noise_floor_ * floor_rise_));
+
+  size_t n = std::min(num_samples, fft_size_);
+  std::move(history_.begin() + n, history_.end(), history_.begin());
+  std::copy(samples + num_samples - n, samples + num_samples,
+            history_.end() - n);
+
+  bool active = num_samples > 0 &&
+                energy > noise_floor_ * kActivityRatio;
+  uint64_t hop_start = num_samples_;
+  num_samples_ += num_samples;
+  if (active) {
+    if (!active_) {
+      active_ = true;
+      start_sample_ = hop_start;
+    }
+    end_sample_ = num_samples_;
+    num_gap_hops_ = 0;
+    ++mark_length_;
+    if (num_active_hops_++ % kSpectrumStride == 0 &&
+        num_samples_ >= fft_size_) {
+      AddSpectrum();
+    }
+  } else if (active_) {
+    if (mark_length_ > 0) {
+      mark_lengths_.push_back(mark_length_);
+      mark_length_ = 0;
+    }
+    if (++num_gap_hops_ > max_gap_hops_) {
+      CloseInterval();
+    }
+  }
+  if (num_samples < hop_size_) {
+    Finish();
+  }
+}
+
+void ActivityScanner::Finish() {
+  if (mark_length_ > 0) {
+    mark_lengths_.push_back(mark_length_);
+    mark_length_ = 0;
+  }
+  if (active_) {
+    CloseInterval();
+  }
+}
+
+void ActivityScanner::AddSpectrum() {
+  for (size_t i = 0; i < fft_size_; ++i) {
+    fft_data_[i].Re = history_[i];
+    fft_data_[i].Im = 0.0;
+  }
+  fft(fft_data_.data(), fft_size_, fft_temp_.data());
+  for (size_t bin = 0; bin < bin_power_.size(); ++bin) {
+    bin_power_[bin] += fft_data_[bin].Re * fft_data_[bin].Re +
+                       fft_data_[bin].Im * fft_data_[bin].Im;
+  }
+}
+
+void ActivityScanner::CloseInterval() {
+  if (mark_lengths_.size() >= kMinMarks) {
+    ActivityInterval interval{};
+    interval.start_sample = start_sample_;
+    interval.end_sample = end_sample_;
+    auto first = bin_power_.begin() + std::min(kMinToneBin, bin_power_.size());
+    interval.bin = std::max_element(first, bin_power_.end()) -
+                   bin_power_.begin();
+    // dots are the shorter half of the marks, the lower quartile is taken
+    // to be one
+    auto quartile = mark_lengths_.begin() + mark_lengths_.size() / 4;
+    std::nth_element(mark_lengths_.begin(), quartile, mark_lengths_.end());
+    interval.dot_length = static_cast<float>(*quartile * hop_size_);
+    intervals_.push_back(interval);
+  }
+  active_ = false;
+  num_gap_hops_ = 0;
+  num_active_hops_ = 0;
+  mark_lengths_.clear();
+  std::fill(bin_power_.begin(), bin_power_.end(), 0.0f);
+}
+
+int WriteActivityIndex(const std::string &file_name, uint32_t sample_rate,
+                       uint32_t hop_size, uint32_t fft_size,
+                       const std::vector<ActivityInterval> &intervals) {
+  int fd = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return -1;
+  }
+  ActivityHeader header{};
+  memcpy(header.magic, kActivityFileMagic, sizeof(header.magic));
+  header.version = kActivityFileVersion;
+  header.sample_rate = sample_rate;
+  header.hop_size = hop_size;
+  header.fft_size = fft_size;
+
+  std::vector<uint8_t> buffer{};
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&header);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(header));
+  bytes = reinterpret_cast<const uint8_t *>(intervals.data());
+  buffer.insert(buffer.end(), bytes,
+                bytes + sizeof(ActivityInterval) * intervals.size());
+
+  size_t written = 0;
+  while (written < buffer.size()) {
+    ssize_t result =
+        write(fd, buffer.data() + written, buffer.size() - written);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      int saved_errno = errno;
+      close(fd);
+      errno = saved_errno;
+      return -1;
+    }
+    written += result;
+  }
+  return close(fd);
+}
+
+int ReadActivityIndex(const std::string &file_name, ActivityHeader *header,
+                      std::vector<ActivityInterval> *intervals) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  size_t size = st.st_size;
+  if (size < kActivityHeaderSize ||
+      (size - kActivityHeaderSize) % sizeof(ActivityInterval) != 0) {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+  std::vector<uint8_t> buffer(size);
+  size_t num_read = 0;
+  while (num_read < size) {
+    ssize_t result = read(fd, buffer.data() + num_read, size - num_read);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      close(fd);
+      if (result == 0) {
+        errno = EINVAL;
+      }
+      return -1;
+    }
+    num_read += result;
+  }
+  close(fd);
+
+  memcpy(header, buffer.data(), sizeof(*header));
+  if (memcmp(header->magic, kActivityFileMagic, sizeof(header->magic)) != 0 ||
+      header->version != kActivityFileVersion || header->hop_size == 0 ||
+      header->fft_size == 0 ||
+      (header->fft_size & (header->fft_size - 1)) != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  intervals->resize((size - kActivityHeaderSize) / sizeof(ActivityInterval));
+  memcpy(intervals->data(), buffer.data() + kActivityHeaderSize,
+         size - kActivityHeaderSize);
+  for (const auto &interval : *intervals) {
+    if (interval.bin >= header->fft_size / 2) {
+      intervals->clear();
+      errno = EINVAL;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+} // namespace morse
@@ -0,0 +1,122 @@
+#ifndef MORSE_ACTIVITY_INDEX_H_
+#define MORSE_ACTIVITY_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "fft.h"
+
+namespace morse {
+
+/*
+ * Activity index file lists the intervals of a recording where a tone is on,
+ * so that a long recording can be decoded by time ranges. All fields are in
+ * host byte order.
+ *
+ *   header   : "MACT" followed by 32-bit version, sample rate, hop size in
+ *              samples, and FFT size of the scan, padded to
+ *              kActivityHeaderSize bytes
+ *   interval : ActivityInterval
+ */
+static const char kActivityFileMagic[] = {'M', 'A', 'C', 'T'};
+static const uint32_t kActivityFileVersion = 1;
+static const size_t kActivityHeaderSize = 32;
+
+struct ActivityHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t sample_rate;
+  uint32_t hop_size;
+  uint32_t fft_size;
+  uint32_t reserved[3];
+};
+
+struct ActivityInterval {
+  // [start_sample, end_sample) of the tone in the recording
+  uint64_t start_sample;
+  uint64_t end_sample;
+  // bin of the strongest tone in the spectrum of the FFT size
+  uint32_t bin;
+  // rough length of a dot in samples
+  float dot_length;
+};
+
+/**
+ * Coarse pass over a recording that finds the intervals of tone activity by
+ * the energy of the hops against a tracked noise floor. The spectrum is taken
+ * only on some of the active hops to find the tone.
+ */
+class ActivityScanner {
+private:
+  size_t hop_size_;
+  size_t fft_size_;
+  // silence longer than this closes an interval
+  size_t max_gap_hops_;
+  size_t num_gap_hops_ = 0;
+  uint64_t num_samples_ = 0;
+
+  double noise_floor_ = -1.0;
+  // factor the noise floor may rise by a hop
+  double floor_rise_;
+
+  // the latest FFT size samples
+  std::vector<short> history_;
+  std::vector<complex> fft_data_;
+  std::vector<complex> fft_temp_;
+
+  // the open interval
+  bool active_ = false;
+  uint64_t start_sample_ = 0;
+  uint64_t end_sample_ = 0;
+  size_t num_active_hops_ = 0;
+  size_t mark_length_ = 0;
+  std::vector<size_t> mark_lengths_;
+  std::vector<float> bin_power_;
+
+  std::vector<ActivityInterval> intervals_;
+
+public:
+  ActivityScanner(size_t hop_size, size_t fft_size, double sample_rate);
+  virtual ~ActivityScanner() = default;
+
+  /**
+   * Scans a hop of samples. Less than hop_size samples mean the end of the
+   * recording.
+   */
+  void Process(const short samples[], size_t num_samples);
+
+  /**
+   * Closes the interval open at the end of the recording.
+   */
+  void Finish();
+
+  inline const std::vector<ActivityInterval> &GetIntervals() const {
+    return intervals_;
+  }
+
+private:
+  void AddSpectrum();
+  void CloseInterval();
+};
+
+/**
+ * Writes an index file. Returns -1 on failure with errno set.
+ */
+int WriteActivityIndex(const std::string &file_name, uint32_t sample_rate,
+                       uint32_t hop_size, uint32_t fft_size,
+                       const std::vector<ActivityInterval> &intervals);
+
+/**
+ * Reads an index file. Returns -1 on failure with errno set, EINVAL if the
+ * file is not an index file or its FFT size is not a power of two holding the
+ * bins of the intervals.
+ */
+int ReadActivityIndex(const std::string &file_name, ActivityHeader *header,
+                      std::vector<ActivityInterval> *intervals);
+
+} // namespace morse
+
+#endif // MORSE_ACTIVITY_INDEX_H_
@@ -0,0 +1,87 @@
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "analysis_file.h"
+
+/**
+ * Converts a binary analysis file to the text format for gnuplot.
+ */
+int main(int argc, char *argv[]) {
+  bool print_spectrum = false;
+  while (true) {
+    int c = getopt(argc, argv, "s");
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 's':
+      print_spectrum = true;
+      break;
+    }
+  }
+
+  if (optind >= argc) {
+    fprintf(stderr, "Usage: %s [-s] <analysis_file>\n", basename(argv[0]));
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -s : Print the spectrum as <window> <bin> <value> "
+                    "instead of the levels\n");
+    return 1;
+  }
+
+  const char *file_name = argv[optind];
+  FILE *file = fopen(file_name, "r");
+  if (file == nullptr) {
+    fprintf(stderr, "File error: %s: %s\n", file_name, strerror(errno));
+    return 1;
+  }
+
+  uint8_t header[morse::kAnalysisHeaderSize];
+  if (fread(header, sizeof(header), 1, file) != 1 ||
+      memcmp(header, morse::kAnalysisFileMagic,
+             sizeof(morse::kAnalysisFileMagic)) != 0 ||
+      header[4] != morse::kAnalysisFileVersion) {
+    fprintf(stderr, "%s: not an analysis file\n", file_name);
+    fclose(file);
+    return 1;
+  }
+  uint32_t num_bins;
+  memcpy(&num_bins, header + 5, sizeof(num_bins));
+  if (print_spectrum && num_bins == 0) {
+    fprintf(stderr, "%s: spectrum is not recorded\n", file_name);
+    fclose(file);
+    return 1;
+  }
+
+  std::vector<uint8_t> record(morse::kAnalysisRecordSize +
+                              sizeof(float) * num_bins);
+  std::vector<float> spectrum(num_bins);
+  while (fread(record.data(), record.size(), 1, file) == 1) {
+    uint32_t window;
+    float level;
+    uint8_t detected;
+    float diff;
+    memcpy(&window, record.data(), 4);
+    memcpy(&level, record.data() + 4, 4);
+    memcpy(&detected, record.data() + 8, 1);
+    memcpy(&diff, record.data() + 9, 4);
+    if (!print_spectrum) {
+      printf("%u %f %f %f\n", window, level, detected ? 1.e11 : 0, diff);
+      continue;
+    }
+    memcpy(spectrum.data(), record.data() + morse::kAnalysisRecordSize,
+           sizeof(float) * num_bins);
+    for (uint32_t bin = 0; bin < num_bins; ++bin) {
+      printf("%u %u %f\n", window, bin, spectrum[bin]);
+    }
+    printf("\n");
+  }
+
+  fclose(file);
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include "analysis_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace morse {
+
+static const size_t kBufferSize = 4 * 1024 * 1024;
+
+AnalysisWriter::~AnalysisWriter() { Close(); }
+
+int AnalysisWriter::Open(const std::string &file_name, uint32_t num_bins) {
+  fd_ = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    return -1;
+  }
+  num_bins_ = num_bins;
+  filling_.reserve(kBufferSize);
+  writing_.reserve(kBufferSize);
+
+  uint8_t header[kAnalysisHeaderSize];
+  memcpy(header, kAnalysisFileMagic, sizeof(kAnalysisFileMagic));
+  header[4] = kAnalysisFileVersion;
+  memcpy(header + 5, &num_bins_, sizeof(num_bins_));
+  filling_.insert(filling_.end(), header, header + kAnalysisHeaderSize);
+
+  thread_ = std::thread(&AnalysisWriter::Run, this);
+  return 0;
+}
+
+void AnalysisWriter::Add(uint32_t window, float level, bool detected,
+                         float diff, const float spectrum[]) {
+  size_t size = filling_.size();
+  filling_.resize(size + kAnalysisRecordSize + sizeof(float) * num_bins_);
+  uint8_t *record = filling_.data() + size;
+  uint8_t flag = detected ? 1 : 0;
+  memcpy(record, &window, 4);
+  memcpy(record + 4, &level, 4);
+  memcpy(record + 8, &flag, 1);
+  memcpy(record + 9, &diff, 4);
+  if (num_bins_ > 0) {
+    memcpy(record + kAnalysisRecordSize, spectrum, sizeof(float) * num_bins_);
+  }
+  if (filling_.size() >= kBufferSize) {
+    Submit();
+  }
+}
+
+int AnalysisWriter::Close() {
+  if (fd_ < 0) {
+    return 0;
+  }
+  Submit();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    closing_ = true;
+    cond_.notify_all();
+  }
+  thread_.join();
+  int result = failed_ ? -1 : 0;
+  if (close(fd_) < 0) {
+    result = -1;
+  }
+  fd_ = -1;
+  return result;
+}
+
+void AnalysisWriter::Submit() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // wait for the previous buffer to be written out
+  cond_.wait(lock, [this] { return !write_pending_; });
+  filling_.swap(writing_);
+  filling_.clear();
+  write_pending_ = true;
+  cond_.notify_all();
+}
+
+void AnalysisWriter::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this] { return write_pending_ || closing_; });
+    if (!write_pending_) {
+      return;
+    }
+    lock.unlock();
+    size_t written = 0;
+    while (!failed_ && written < writing_.size()) {
+      ssize_t result =
+          write(fd_, writing_.data() + written, writing_.size() - written);
+      if (result < 0) {
+        failed_ = errno != EINTR;
+        continue;
+      }
+      written += result;
+    }
+    lock.lock();
+    write_pending_ = false;
+    cond_.notify_all();
+  }
+}
+
+} // namespace morse
@@ -0,0 +1,80 @@
+#ifndef MORSE_ANALYSIS_FILE_H_
+#define MORSE_ANALYSIS_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace morse {
+
+/*
+ * Binary analysis file, in host byte order.
+ *
+ *   header : "MANL", version (1 byte), number of spectrum bins per record
+ *            (4 bytes, zero when the spectrum is not recorded)
+ *   record : window index (4 bytes), level (float), detected flag (1 byte),
+ *            diff (float), filtered spectrum (float * number of bins)
+ *
+ * analysis2txt converts the file to the text format for gnuplot.
+ */
+static const char kAnalysisFileMagic[] = {'M', 'A', 'N', 'L'};
+static const uint8_t kAnalysisFileVersion = 1;
+static const size_t kAnalysisHeaderSize = sizeof(kAnalysisFileMagic) + 1 + 4;
+static const size_t kAnalysisRecordSize = 4 + 4 + 1 + 4;
+
+/**
+ * Analysis writer. Records are collected in a large buffer that is written
+ * out by a background thread while the next buffer fills up.
+ */
+class AnalysisWriter {
+private:
+  int fd_ = -1;
+  uint32_t num_bins_ = 0;
+
+  std::vector<uint8_t> filling_;
+  std::vector<uint8_t> writing_;
+  bool write_pending_ = false;
+  bool closing_ = false;
+  bool failed_ = false;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::thread thread_;
+
+public:
+  AnalysisWriter() = default;
+  virtual ~AnalysisWriter();
+
+  /**
+   * Opens the file and starts the writer thread. num_bins is the size of the
+   * spectrum in each record, may be zero. Returns -1 on failure with errno
+   * set.
+   */
+  int Open(const std::string &file_name, uint32_t num_bins);
+
+  inline uint32_t GetNumBins() const { return num_bins_; }
+
+  /**
+   * Adds a record. The spectrum must have GetNumBins() values.
+   */
+  void Add(uint32_t window, float level, bool detected, float diff,
+           const float spectrum[]);
+
+  /**
+   * Writes out the remaining records and closes the file. Returns -1 if any
+   * write has failed.
+   */
+  int Close();
+
+private:
+  void Submit();
+  void Run();
+};
+
+} // namespace morse
+
+#endif // MORSE_ANALYSIS_FILE_H_
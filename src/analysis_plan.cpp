@@ -0,0 +1,84 @@
+#include "analysis_plan.h"
+
+#include <errno.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include "morse_signal_detector.h"
+
+namespace morse {
+
+// the reader needs a few windows per dot to tell the elements apart
+static const double kWindowsPerDot = 5.0;
+
+// window sizes are in hops; two hops are the default
+static const size_t kMinBuffers = 2;
+static const size_t kMaxBuffers = 8;
+
+// FFT size that the detector thresholds are tuned for
+static const double kReferenceFftSize = 512.0;
+
+DetectorParameters
+AnalysisPlan::Scale(const DetectorParameters &parameters) const {
+  DetectorParameters scaled = parameters;
+  double ratio = fft_size / kReferenceFftSize;
+  scaled.turn_on_level *= ratio * ratio;
+  return scaled;
+}
+
+int PlanAnalysis(const AnalysisSettings &settings, double sample_rate,
+                 AnalysisPlan *plan) {
+  if (sample_rate <= 0 || settings.max_wpm <= 0 ||
+      (settings.center_bin == 0 && settings.tone_frequency <= 0) ||
+      settings.time_resolution < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  // a dot is 1/50 of a minute per word
+  double dot_duration = 60000.0 / (50.0 * settings.max_wpm);
+  double resolution = dot_duration / kWindowsPerDot;
+  if (settings.time_resolution > 0) {
+    resolution = std::min(resolution, settings.time_resolution);
+  }
+  size_t hop_size = 1;
+  while (hop_size * 2 * 1000.0 / sample_rate <= resolution) {
+    hop_size *= 2;
+  }
+
+  // a longer window resolves a lower tone
+  size_t min_buffers = kMinBuffers;
+  size_t max_buffers = kMaxBuffers;
+  if (settings.num_buffers > 0) {
+    min_buffers = max_buffers = settings.num_buffers;
+  }
+  for (size_t num_buffers = min_buffers; num_buffers <= max_buffers;
+       num_buffers *= 2) {
+    size_t fft_size = hop_size * num_buffers;
+    double bin_width = sample_rate / fft_size;
+    size_t center_bin = settings.center_bin > 0
+                            ? settings.center_bin
+                            : lround(settings.tone_frequency / bin_width);
+    if (center_bin < MorseSignalDetector::kMinSignalBin) {
+      continue;
+    }
+    // the frequency domain filter looks at two bins on each side
+    size_t num_bins =
+        std::min(MorseSignalDetector::kAnalysisSize, fft_size / 2);
+    if (center_bin + 2 >= num_bins) {
+      break;
+    }
+    plan->hop_size = hop_size;
+    plan->num_buffers = num_buffers;
+    plan->fft_size = fft_size;
+    plan->center_bin = center_bin;
+    plan->bin_width = bin_width;
+    plan->hop_duration = hop_size * 1000.0 / sample_rate;
+    return 0;
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+} // namespace morse
@@ -0,0 +1,61 @@
+#ifndef MORSE_ANALYSIS_PLAN_H_
+#define MORSE_ANALYSIS_PLAN_H_
+
+#include <stddef.h>
+
+#include "parameters.h"
+
+namespace morse {
+
+/**
+ * What the decoding needs in physical units, independent of the sample rate
+ * of the source.
+ */
+struct AnalysisSettings {
+  // frequency of the tone in Hz
+  double tone_frequency = 950.0;
+  // the fastest expected speed in words per minute, timed by PARIS
+  double max_wpm = 40.0;
+  // longest hop in ms when it is shorter than what max_wpm needs; 0 for none
+  double time_resolution = 0.0;
+  // hops in the window; 0 for the shortest window that resolves the tone
+  size_t num_buffers = 0;
+  // frequency bin of the tone in the window instead of tone_frequency; 0 for
+  // the bin of tone_frequency
+  size_t center_bin = 0;
+};
+
+/**
+ * Sizes of the analysis that meet AnalysisSettings at a sample rate.
+ */
+struct AnalysisPlan {
+  // samples per hop, the detector decides once a hop
+  size_t hop_size;
+  // hops in the FFT window
+  size_t num_buffers;
+  size_t fft_size;
+  size_t center_bin;
+  // resolutions in Hz and ms
+  double bin_width;
+  double hop_duration;
+
+  /**
+   * Returns the detector parameters scaled for fft_size. The power of a tone
+   * grows with the square of the FFT size, so do the absolute thresholds.
+   */
+  DetectorParameters Scale(const DetectorParameters &parameters) const;
+};
+
+/**
+ * Picks the longest power of two hop that is not longer than the time
+ * resolution, and the shortest window of it that resolves the tone, or the
+ * window of AnalysisSettings::num_buffers hops. The tone is
+ * AnalysisSettings::center_bin of the window when given. Returns -1 with
+ * errno set to EINVAL if the tone cannot be analysed at the sample rate.
+ */
+int PlanAnalysis(const AnalysisSettings &settings, double sample_rate,
+                 AnalysisPlan *plan);
+
+} // namespace morse
+
+#endif // MORSE_ANALYSIS_PLAN_H_
@@ -0,0 +1,62 @@
+/*
+ * Radix-2 decimation in time FFT of several windows at once. The windows are
+ * interleaved point by point, so that each butterfly is a vector operation
+ * over the windows however short the transform is.
+ */
+
+#include <math.h>
+
+#include "batch_fft.h"
+
+#ifndef PI
+#define PI 3.14159265358979323846264338327950288
+#endif
+
+void batch_fft_make_twiddles(complex *twiddles, int n) {
+  int size, m;
+  for (size = 2; size <= n; size <<= 1) {
+    complex *stage = twiddles + size / 2 - 1;
+    for (m = 0; m < size / 2; m++) {
+      /* rounded as in fft() */
+      stage[m].Re = cos(2 * PI * m / (double)size);
+      stage[m].Im = -sin(2 * PI * m / (double)size);
+    }
+  }
+}
+
+void batch_fft(complex_batch *v, int n, const complex *twiddles) {
+  int i, j, k, size;
+
+  /* bit reversal permutation */
+  for (i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      complex_batch t = v[i];
+      v[i] = v[j];
+      v[j] = t;
+    }
+  }
+
+  for (size = 2; size <= n; size <<= 1) {
+    int half = size >> 1;
+    const complex *stage = twiddles + half - 1;
+    for (i = 0; i < n; i += size) {
+      for (k = 0; k < half; k++) {
+        real wr = stage[k].Re;
+        real wi = stage[k].Im;
+        complex_batch *a = v + i + k;
+        complex_batch *b = a + half;
+        fft_lanes tr = wr * b->Re - wi * b->Im;
+        fft_lanes ti = wr * b->Im + wi * b->Re;
+        b->Re = a->Re - tr;
+        b->Im = a->Im - ti;
+        a->Re = a->Re + tr;
+        a->Im = a->Im + ti;
+      }
+    }
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef BATCH_FFT_H_
+#define BATCH_FFT_H_
+
+#include "fft.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* number of transforms computed at once, one per vector lane */
+#define FFT_BATCH 8
+
+typedef real fft_lanes __attribute__((vector_size(FFT_BATCH * sizeof(real))));
+
+/* a point of FFT_BATCH transforms, lane b belongs to transform b */
+typedef struct {
+  fft_lanes Re;
+  fft_lanes Im;
+} complex_batch;
+
+/*
+ * Fills the twiddle factors of an n-point FFT; n - 1 of them, those of the
+ * stage of size s starting at s / 2 - 1.
+ */
+extern void batch_fft_make_twiddles(complex *twiddles, int n);
+
+/*
+ * FFT_BATCH FFTs in place with the same butterflies as fft(), so that each
+ * lane gives the same result as fft() on it. n must be a power of two.
+ */
+extern void batch_fft(complex_batch *v, int n, const complex *twiddles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BATCH_FFT_H_
@@ -0,0 +1,47 @@
+#ifndef MORSE_BLOCK_QUEUE_H_
+#define MORSE_BLOCK_QUEUE_H_
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace morse {
+
+/**
+ * Bounded blocking queue that hands blocks of samples from the input thread
+ * to a channel thread.
+ */
+template <typename T> class BlockQueue {
+private:
+  size_t capacity_;
+  std::deque<T> items_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+
+public:
+  explicit BlockQueue(size_t capacity) : capacity_(capacity) {}
+
+  void Push(T item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] { return items_.size() < capacity_; });
+    items_.push_back(std::move(item));
+    not_empty_.notify_one();
+  }
+
+  T Pop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return !items_.empty(); });
+    T item = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return item;
+  }
+};
+
+} // namespace morse
+
+#endif // MORSE_BLOCK_QUEUE_H_
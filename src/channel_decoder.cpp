@@ -0,0 +1,213 @@
+#include "channel_decoder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace morse {
+
+// the bin that the tone is mixed down to in a decimated spectrum of fft_size
+static size_t DecimatedCenter(size_t center_frequency, size_t fft_size) {
+  return std::min(center_frequency, std::max<size_t>(3, fft_size / 8));
+}
+
+ChannelDecoder::ChannelDecoder(size_t num_buffers, size_t buffer_size,
+                               size_t center_frequency, size_t decimation,
+                               double sample_rate, bool verbose)
+    : num_buffers_(num_buffers), buffer_size_(buffer_size) {
+  buffers_ = new short *[num_buffers_];
+  for (size_t i = 0; i < num_buffers_; ++i) {
+    buffers_mem_.push_back(new short[buffer_size_]);
+    buffers_[i] = buffers_mem_[i];
+    memset(buffers_[i], 0, sizeof(short) * buffer_size_);
+  }
+
+  // Setup decimating front end. The window keeps its duration, so the bin
+  // width in Hz stays the same while the FFT gets shorter by the decimation
+  // factor. The tone is mixed down to a low bin of the decimated spectrum.
+  size_t analysis_buffer_size = buffer_size_;
+  size_t analysis_center_frequency = center_frequency;
+  if (decimation > 1) {
+    analysis_buffer_size = buffer_size_ / decimation;
+    size_t fft_size = analysis_buffer_size * num_buffers_;
+    analysis_center_frequency = DecimatedCenter(center_frequency, fft_size);
+    double bin_width = sample_rate / (buffer_size_ * num_buffers_);
+    decimator_ = new Decimator(
+        decimation, sample_rate,
+        (center_frequency - analysis_center_frequency) * bin_width);
+    decimated_ = new complex *[num_buffers_];
+    for (size_t i = 0; i < num_buffers_; ++i) {
+      decimated_mem_.push_back(new complex[analysis_buffer_size]);
+      decimated_[i] = decimated_mem_[i];
+      memset(decimated_[i], 0, sizeof(complex) * analysis_buffer_size);
+    }
+    if (verbose) {
+      fprintf(stderr, "decimation = %ld (fft size %ld, center %ld)\n",
+              decimation, fft_size, analysis_center_frequency);
+    }
+  }
+
+  morse_reader_ = new MorseReader();
+  signal_detector_ =
+      new MorseSignalDetector(morse_reader_, num_buffers_,
+                              analysis_buffer_size, analysis_center_frequency);
+  signal_detector_->Verbose(verbose);
+}
+
+bool ChannelDecoder::CanAnalyze(size_t num_buffers, size_t buffer_size,
+                                size_t center_frequency, size_t decimation) {
+  size_t fft_size = buffer_size / decimation * num_buffers;
+  if (decimation > 1) {
+    center_frequency = DecimatedCenter(center_frequency, fft_size);
+  }
+  return MorseSignalDetector::CanAnalyze(fft_size, center_frequency);
+}
+
+ChannelDecoder::~ChannelDecoder() {
+  // the detector owns the reader
+  delete signal_detector_;
+  delete decimator_;
+  delete[] decimated_;
+  for (auto buffer : decimated_mem_) {
+    delete[] buffer;
+  }
+  delete[] buffers_;
+  for (auto buffer : buffers_mem_) {
+    delete[] buffer;
+  }
+}
+
+void ChannelDecoder::Process(const short samples[], size_t num_samples,
+                             Monitor *monitor) {
+  size_t analysis_size;
+  if (Fill(samples, num_samples, &analysis_size)) {
+    if (decimator_ != nullptr) {
+      signal_detector_->Process(decimated_, analysis_size, monitor);
+    } else {
+      signal_detector_->Process(buffers_, analysis_size, monitor);
+    }
+  }
+  Rotate();
+}
+
+bool ChannelDecoder::Analyze(const short samples[], size_t num_samples,
+                             float spectrum[]) {
+  size_t analysis_size;
+  bool filled = Fill(samples, num_samples, &analysis_size);
+  if (filled) {
+    if (decimator_ != nullptr) {
+      signal_detector_->MakeSpectrum(decimated_, analysis_size, spectrum);
+    } else {
+      signal_detector_->MakeSpectrum(buffers_, analysis_size, spectrum);
+    }
+  }
+  Rotate();
+  return filled;
+}
+
+size_t ChannelDecoder::AnalyzeHops(const short samples[], size_t num_hops,
+                                   float spectra[]) {
+  size_t num_bins = signal_detector_->GetNumBins();
+  bool batch = signal_detector_->CanBatch();
+  size_t num_spectra = 0;
+  for (size_t i = 0; i < num_hops; ++i) {
+    const short *hop = samples + i * buffer_size_;
+    if (!batch) {
+      if (Analyze(hop, buffer_size_, spectra + num_spectra * num_bins)) {
+        ++num_spectra;
+      }
+      continue;
+    }
+    size_t analysis_size;
+    if (Fill(hop, buffer_size_, &analysis_size)) {
+      bool full = decimator_ != nullptr
+                      ? signal_detector_->AddToBatch(decimated_, analysis_size)
+                      : signal_detector_->AddToBatch(buffers_, analysis_size);
+      if (full) {
+        num_spectra += signal_detector_->TransformBatch(spectra +
+                                                        num_spectra * num_bins);
+      }
+    }
+    Rotate();
+  }
+  // the rest of a batch
+  return num_spectra +
+         signal_detector_->TransformBatch(spectra + num_spectra * num_bins);
+}
+
+void ChannelDecoder::Detect(const float spectrum[], Monitor *monitor) {
+  signal_detector_->ProcessSpectrum(spectrum, monitor);
+}
+
+bool ChannelDecoder::Fill(const short samples[], size_t num_samples,
+                          size_t *analysis_size) {
+  short *current_buffer = buffers_[num_buffers_ - 1];
+  memcpy(current_buffer, samples, sizeof(short) * num_samples);
+  *analysis_size = num_samples;
+  if (decimator_ != nullptr) {
+    *analysis_size = decimator_->Process(current_buffer, num_samples,
+                                         decimated_[num_buffers_ - 1]);
+  }
+  return ++num_windows_ >= num_buffers_;
+}
+
+void ChannelDecoder::Rotate() {
+  if (decimator_ != nullptr) {
+    complex *temp = decimated_[0];
+    for (size_t i = 1; i < num_buffers_; ++i) {
+      decimated_[i - 1] = decimated_[i];
+    }
+    decimated_[num_buffers_ - 1] = temp;
+  }
+  short *temp = buffers_[0];
+  for (size_t i = 1; i < num_buffers_; ++i) {
+    buffers_[i - 1] = buffers_[i];
+  }
+  buffers_[num_buffers_ - 1] = temp;
+}
+
+void ChannelDecoder::Drain(Monitor *monitor) {
+  signal_detector_->Drain(monitor);
+}
+
+void ChannelDecoder::SaveState(StateWriter *writer) const {
+  writer->Put(num_buffers_);
+  writer->Put(buffer_size_);
+  writer->Put(decimator_ != nullptr);
+  for (size_t i = 0; i < num_buffers_; ++i) {
+    writer->PutArray(buffers_[i], buffer_size_);
+  }
+  if (decimator_ != nullptr) {
+    size_t analysis_buffer_size = buffer_size_ / decimator_->GetFactor();
+    for (size_t i = 0; i < num_buffers_; ++i) {
+      writer->PutArray(decimated_[i], analysis_buffer_size);
+    }
+    decimator_->SaveState(writer);
+  }
+  writer->Put(num_windows_);
+  signal_detector_->SaveState(writer);
+}
+
+bool ChannelDecoder::LoadState(StateReader *reader) {
+  reader->Expect(num_buffers_);
+  reader->Expect(buffer_size_);
+  reader->Expect(decimator_ != nullptr);
+  for (size_t i = 0; i < num_buffers_; ++i) {
+    reader->GetArray(buffers_[i], buffer_size_);
+  }
+  if (decimator_ != nullptr) {
+    size_t analysis_buffer_size = buffer_size_ / decimator_->GetFactor();
+    for (size_t i = 0; i < num_buffers_; ++i) {
+      reader->GetArray(decimated_[i], analysis_buffer_size);
+    }
+    decimator_->LoadState(reader);
+  }
+  reader->Get(&num_windows_);
+  if (reader->Failed()) {
+    return false;
+  }
+  return signal_detector_->LoadState(reader);
+}
+
+} // namespace morse
@@ -0,0 +1,100 @@
+#ifndef MORSE_CHANNEL_DECODER_H_
+#define MORSE_CHANNEL_DECODER_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "decimator.h"
+#include "fft.h"
+#include "monitor.h"
+#include "morse_reader.h"
+#include "morse_signal_detector.h"
+
+namespace morse {
+
+/**
+ * Decoding state of a single audio channel; the window buffers, the optional
+ * decimating front end, the signal detector, and the reader.
+ */
+class ChannelDecoder {
+private:
+  size_t num_buffers_;
+  size_t buffer_size_;
+  std::vector<short *> buffers_mem_;
+  short **buffers_;
+
+  Decimator *decimator_ = nullptr;
+  std::vector<complex *> decimated_mem_;
+  complex **decimated_ = nullptr;
+
+  MorseReader *morse_reader_;
+  MorseSignalDetector *signal_detector_;
+
+  size_t num_windows_ = 0;
+
+public:
+  /**
+   * center_frequency is the bin of the tone in the spectrum of
+   * num_buffers * buffer_size samples at the original sample rate.
+   */
+  ChannelDecoder(size_t num_buffers, size_t buffer_size,
+                 size_t center_frequency, size_t decimation,
+                 double sample_rate, bool verbose = false);
+  virtual ~ChannelDecoder();
+
+  /**
+   * Whether the detector can analyse the tone in the spectrum shortened by
+   * the decimation.
+   */
+  static bool CanAnalyze(size_t num_buffers, size_t buffer_size,
+                         size_t center_frequency, size_t decimation);
+
+  inline MorseReader *GetReader() { return morse_reader_; }
+  inline MorseSignalDetector *GetDetector() { return signal_detector_; }
+
+  /**
+   * Processes a hop of samples. Less than buffer_size samples mean the end of
+   * the stream.
+   */
+  void Process(const short samples[], size_t num_samples, Monitor *monitor);
+
+  /**
+   * Process split in two for a pipeline. Analyze runs the front end and the
+   * FFT of a hop into spectrum[0, GetDetector()->GetNumBins()) and returns
+   * false while the first window is not filled yet. Detect runs the rest on
+   * the spectrum. Each may run on its own thread.
+   */
+  bool Analyze(const short samples[], size_t num_samples, float spectrum[]);
+  void Detect(const float spectrum[], Monitor *monitor);
+
+  /**
+   * Analyze over num_hops whole hops at once for offline decoding; the
+   * windows are transformed in batches. Returns the number of spectra made
+   * into spectra, which has room for num_hops of them.
+   */
+  size_t AnalyzeHops(const short samples[], size_t num_hops, float spectra[]);
+
+  void Drain(Monitor *monitor);
+
+  /**
+   * Saves and loads the whole decoding state of the channel for a
+   * checkpoint; see MorseSignalDetector::SaveState. LoadState returns false
+   * if the state does not fit this channel or is broken, and the channel
+   * must not be used then.
+   */
+  void SaveState(StateWriter *writer) const;
+  bool LoadState(StateReader *reader);
+
+private:
+  /**
+   * Puts a hop into the window buffers. Returns false while the window is
+   * not filled yet. *analysis_size is the size of the hop after decimation.
+   */
+  bool Fill(const short samples[], size_t num_samples, size_t *analysis_size);
+  void Rotate();
+};
+
+} // namespace morse
+
+#endif // MORSE_CHANNEL_DECODER_H_
@@ -0,0 +1,104 @@
+#include "checkpoint.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace morse {
+
+static int WriteAll(int fd, const uint8_t *data, size_t size) {
+  size_t written = 0;
+  while (written < size) {
+    ssize_t result = write(fd, data + written, size - written);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    written += result;
+  }
+  return 0;
+}
+
+int SaveCheckpoint(const std::string &file_name, const StateWriter &state) {
+  // written aside and renamed over the previous checkpoint
+  std::string temp_name = file_name + ".tmp";
+  int fd = open(temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return -1;
+  }
+  const auto &buffer = state.GetBuffer();
+  uint8_t header[kCheckpointHeaderSize];
+  uint64_t size = buffer.size();
+  memcpy(header, kCheckpointFileMagic, sizeof(kCheckpointFileMagic));
+  memcpy(header + 4, &kCheckpointFileVersion, sizeof(kCheckpointFileVersion));
+  memcpy(header + 8, &size, sizeof(size));
+  if (WriteAll(fd, header, sizeof(header)) < 0 ||
+      WriteAll(fd, buffer.data(), buffer.size()) < 0 || fsync(fd) < 0) {
+    int saved_errno = errno;
+    close(fd);
+    unlink(temp_name.c_str());
+    errno = saved_errno;
+    return -1;
+  }
+  if (close(fd) < 0 || rename(temp_name.c_str(), file_name.c_str()) < 0) {
+    int saved_errno = errno;
+    unlink(temp_name.c_str());
+    errno = saved_errno;
+    return -1;
+  }
+  return 0;
+}
+
+int LoadCheckpoint(const std::string &file_name, std::vector<uint8_t> *state) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  std::vector<uint8_t> buffer(st.st_size);
+  size_t num_read = 0;
+  while (num_read < buffer.size()) {
+    ssize_t result =
+        read(fd, buffer.data() + num_read, buffer.size() - num_read);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      close(fd);
+      if (result == 0) {
+        errno = EINVAL;
+      }
+      return -1;
+    }
+    num_read += result;
+  }
+  close(fd);
+
+  uint32_t version;
+  uint64_t size;
+  if (buffer.size() < kCheckpointHeaderSize ||
+      memcmp(buffer.data(), kCheckpointFileMagic,
+             sizeof(kCheckpointFileMagic)) != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  memcpy(&version, buffer.data() + 4, sizeof(version));
+  memcpy(&size, buffer.data() + 8, sizeof(size));
+  if (version != kCheckpointFileVersion ||
+      size != buffer.size() - kCheckpointHeaderSize) {
+    errno = EINVAL;
+    return -1;
+  }
+  state->assign(buffer.begin() + kCheckpointHeaderSize, buffer.end());
+  return 0;
+}
+
+} // namespace morse
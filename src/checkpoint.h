@@ -0,0 +1,139 @@
+#ifndef MORSE_CHECKPOINT_H_
+#define MORSE_CHECKPOINT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace morse {
+
+/*
+ * Checkpoint file keeps the decoding state so that a decoding can resume
+ * where it was saved, e.g. after a restart or on another worker. All fields
+ * are in host byte order; a checkpoint is read back on the same kind of
+ * machine and with the same build.
+ *
+ *   header : "MCKP" followed by 32-bit version and 64-bit size of the state
+ *   state  : fields of the objects in the order they save them
+ */
+static const char kCheckpointFileMagic[] = {'M', 'C', 'K', 'P'};
+static const uint32_t kCheckpointFileVersion = 3;
+static const size_t kCheckpointHeaderSize = 16;
+
+/**
+ * Serializes the state of the decoding objects; see their SaveState.
+ */
+class StateWriter {
+private:
+  std::vector<uint8_t> buffer_;
+
+public:
+  template <typename T> void Put(const T &value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only plain values are saved as they are");
+    Append(&value, sizeof(value));
+  }
+
+  template <typename T> void PutArray(const T values[], size_t num_values) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only plain values are saved as they are");
+    Append(values, sizeof(T) * num_values);
+  }
+
+  void PutString(const std::string &value) {
+    Put<uint64_t>(value.size());
+    PutArray(value.data(), value.size());
+  }
+
+  inline const std::vector<uint8_t> &GetBuffer() const { return buffer_; }
+
+private:
+  void Append(const void *data, size_t size) {
+    if (size > 0) {
+      size_t offset = buffer_.size();
+      buffer_.resize(offset + size);
+      memcpy(buffer_.data() + offset, data, size);
+    }
+  }
+};
+
+/**
+ * Reads the state written by StateWriter. A read past the end, or a value
+ * that the object finds inconsistent, fails the reader, and all the later
+ * reads fail as well.
+ */
+class StateReader {
+private:
+  const uint8_t *data_;
+  size_t size_;
+  size_t position_ = 0;
+  bool failed_ = false;
+
+public:
+  StateReader(const uint8_t *data, size_t size) : data_(data), size_(size) {}
+
+  template <typename T> bool Get(T *value) {
+    return GetArray(value, 1);
+  }
+
+  template <typename T> bool GetArray(T values[], size_t num_values) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only plain values are loaded as they are");
+    size_t size = sizeof(T) * num_values;
+    if (failed_ || size > size_ - position_) {
+      failed_ = true;
+      return false;
+    }
+    memcpy(values, data_ + position_, size);
+    position_ += size;
+    return true;
+  }
+
+  bool GetString(std::string *value) {
+    uint64_t size;
+    if (!Get(&size) || size > size_ - position_) {
+      failed_ = true;
+      return false;
+    }
+    value->assign(reinterpret_cast<const char *>(data_ + position_), size);
+    position_ += size;
+    return true;
+  }
+
+  /**
+   * Reads a value saved as a check of the configuration, e.g. a buffer size,
+   * and fails unless it is the expected one.
+   */
+  template <typename T> bool Expect(const T &expected) {
+    T value;
+    if (!Get(&value) || value != expected) {
+      failed_ = true;
+    }
+    return !failed_;
+  }
+
+  inline void Fail() { failed_ = true; }
+  inline bool Failed() const { return failed_; }
+  inline bool AtEnd() const { return position_ == size_; }
+};
+
+/**
+ * Writes the state to a checkpoint file. The file is replaced atomically, so
+ * that a crash while saving leaves the previous checkpoint. Returns -1 on
+ * failure with errno set.
+ */
+int SaveCheckpoint(const std::string &file_name, const StateWriter &state);
+
+/**
+ * Reads the state of a checkpoint file. Returns -1 on failure with errno
+ * set, EINVAL if the file is not a checkpoint file.
+ */
+int LoadCheckpoint(const std::string &file_name, std::vector<uint8_t> *state);
+
+} // namespace morse
+
+#endif // MORSE_CHECKPOINT_H_
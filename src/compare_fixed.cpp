@@ -0,0 +1,151 @@
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <sndfile.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "channel_decoder.h"
+
+/**
+ * Runs the float and the integer detection paths side by side and compares
+ * the mark and space decisions of every window.
+ */
+
+namespace {
+
+const size_t kBufferSize = 256;
+// the readers are capped, so that a window that blurs the code does not hold
+// up the comparison of the decisions
+const size_t kMaxWorldLines = 256;
+
+/**
+ * Compares the paths on a file. Returns the ratio of windows that differ, or
+ * a negative value on failure.
+ */
+double Compare(const char *file_name, size_t num_buffers, size_t center_freq,
+               bool verbose) {
+  SF_INFO sf_info;
+  memset(&sf_info, 0, sizeof(sf_info));
+  SNDFILE *sndfile = sf_open(file_name, SFM_READ, &sf_info);
+  if (sndfile == nullptr) {
+    fprintf(stderr, "File error: %s: %s\n", file_name, sf_strerror(nullptr));
+    return -1.0;
+  }
+
+  morse::ChannelDecoder float_path(num_buffers, kBufferSize, center_freq, 1,
+                                   sf_info.samplerate);
+  morse::ChannelDecoder fixed_path(num_buffers, kBufferSize, center_freq, 1,
+                                   sf_info.samplerate);
+  morse::ReaderParameters parameters = float_path.GetReader()->GetParameters();
+  parameters.max_world_lines = kMaxWorldLines;
+  float_path.GetReader()->SetParameters(parameters);
+  fixed_path.GetReader()->SetParameters(parameters);
+  if (fixed_path.GetDetector()->EnableFixedPoint() < 0) {
+    fprintf(stderr, "%s: %s\n", file_name, strerror(errno));
+    sf_close(sndfile);
+    return -1.0;
+  }
+
+  // the first channel is compared
+  std::vector<short> frames(kBufferSize * sf_info.channels);
+  std::vector<short> samples(kBufferSize);
+  size_t num_windows = 0;
+  size_t num_differences = 0;
+  sf_count_t num_frames;
+  do {
+    num_frames = sf_readf_short(sndfile, frames.data(), kBufferSize);
+    for (sf_count_t i = 0; i < num_frames; ++i) {
+      samples[i] = frames[i * sf_info.channels];
+    }
+    float_path.Process(samples.data(), num_frames, nullptr);
+    fixed_path.Process(samples.data(), num_frames, nullptr);
+    uint8_t expected = float_path.GetDetector()->GetOutputSignal();
+    uint8_t actual = fixed_path.GetDetector()->GetOutputSignal();
+    if (expected != actual) {
+      ++num_differences;
+      if (verbose) {
+        printf("%s: window %ld: float %d fixed %d\n", file_name, num_windows,
+               expected, actual);
+      }
+    }
+    ++num_windows;
+  } while (num_frames == static_cast<sf_count_t>(kBufferSize));
+  float_path.Drain(nullptr);
+  fixed_path.Drain(nullptr);
+  sf_close(sndfile);
+
+  double ratio = num_windows > 0
+                     ? static_cast<double>(num_differences) / num_windows
+                     : 0.0;
+  printf("%s: %ld of %ld windows differ (%.2f%%)\n", file_name,
+         num_differences, num_windows, ratio * 100);
+  printf("  float: %s\n", float_path.GetReader()->GetCharacters().c_str());
+  printf("  fixed: %s\n", fixed_path.GetReader()->GetCharacters().c_str());
+  return ratio;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t num_buffers = 2;
+  size_t center_freq = 11;
+  double tolerance = 0.0;
+  bool verbose = false;
+  while (true) {
+    int c = getopt(argc, argv, "b:f:t:v");
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'b':
+      num_buffers = std::max(1ul, strtoul(optarg, nullptr, 10));
+      break;
+    case 'f':
+      center_freq = strtoul(optarg, nullptr, 10);
+      break;
+    case 't':
+      tolerance = strtod(optarg, nullptr) / 100;
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    }
+  }
+
+  if (optind >= argc) {
+    fprintf(stderr, "Usage: %s [options] <wav_file>[:<center_freq>] ...\n",
+            basename(argv[0]));
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -b <hops> : Hops of %zu samples in the window, a power "
+                    "of two (default 2)\n",
+            kBufferSize);
+    fprintf(stderr, "  -f <center_freq> : Frequency bin of the tone unless "
+                    "given with the file (default 11)\n");
+    fprintf(stderr, "  -t <percent> : Differing windows allowed per file "
+                    "(default 0)\n");
+    fprintf(stderr, "  -v : Print every differing window\n");
+    return 1;
+  }
+
+  int result = 0;
+  for (int i = optind; i < argc; ++i) {
+    std::string file_name = argv[i];
+    size_t file_center_freq = center_freq;
+    size_t colon = file_name.rfind(':');
+    if (colon != std::string::npos) {
+      file_center_freq = strtoul(file_name.c_str() + colon + 1, nullptr, 10);
+      file_name.resize(colon);
+    }
+    double ratio = Compare(file_name.c_str(), num_buffers, file_center_freq, verbose);
+    if (ratio < 0 || ratio > tolerance) {
+      result = 1;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,99 @@
+#include "curses_monitor.h"
+
+#include <ncurses.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
+#include "world_line.h"
+
+namespace morse {
+
+CursesMonitor::CursesMonitor() {
+  initscr();
+  int height;
+  int width;
+  getmaxyx(stdscr, height, width);
+  curs_set(0);
+  int window_start = height / 4;
+  dump_window_ = newwin(height - window_start - 2, width - 6, window_start, 3);
+  height_ = height;
+  width_ = width;
+}
+
+CursesMonitor::~CursesMonitor() {
+  getmaxyx(stdscr, height_, width_);
+  mvprintw(height_ - 1, 0, "press any key to exit");
+  getch();
+  endwin();
+}
+
+void CursesMonitor::AddSignal(char signal) {
+  // mvprintw(irow_, icol_++, "%c", signal == '^' ? '*' : ' ');
+  refresh();
+  if (icol_ == width_ - 1) {
+    ++irow_;
+    icol_ = 1;
+  }
+}
+
+void CursesMonitor::ShowSpectrum(const char *center, const int levels[],
+                                 size_t num_levels) {
+  move(0, 1);
+  clrtoeol();
+  printw("center: %s", center);
+  for (size_t i = 0; i < num_levels; ++i) {
+    move(i + 1, 1);
+    clrtoeol();
+    char buf[kMaxSpectrumLevel + 1];
+    memset(buf, '*', levels[i]);
+    buf[levels[i]] = 0;
+    printw("%s", buf);
+  }
+}
+
+void CursesMonitor::Dump(MorseReader *reader) {
+  std::vector<const WorldLine *> candidates;
+  reader->GetWorldLines(&candidates);
+  if (candidates.empty()) {
+    wprintw(dump_window_, "Nothing to dump");
+  }
+
+  std::sort(candidates.begin(), candidates.end(), [](auto a, auto b) {
+    return a->GetConfidence() > b->GetConfidence();
+  });
+
+  if (prev_dump_size_ > candidates.size()) {
+    wclear(dump_window_);
+  }
+  prev_dump_size_ = candidates.size();
+
+  // the committed text that fits the first row, above the world lines
+  int width = getmaxx(dump_window_);
+  std::string_view committed = reader->GetCommittedCharacters();
+  if (width > 0 && committed.size() >= static_cast<size_t>(width)) {
+    committed = committed.substr(committed.size() - width + 1);
+  }
+  wmove(dump_window_, 0, 0);
+  wclrtoeol(dump_window_);
+  wprintw(dump_window_, "%.*s", static_cast<int>(committed.size()),
+          committed.data());
+
+  int irow = 2;
+  for (auto *world_line : candidates) {
+    wmove(dump_window_, irow++, 0);
+    wclrtoeol(dump_window_);
+    wprintw(dump_window_, "(%f) %f : %s", world_line->GetDotLength(),
+            world_line->GetConfidence(), world_line->GetCharacters().c_str());
+    wmove(dump_window_, irow++, 4);
+    wclrtoeol(dump_window_);
+    wprintw(dump_window_, "%s", world_line->GetSignals().c_str());
+    ++irow;
+  }
+  refresh();
+  wrefresh(dump_window_);
+}
+
+} // namespace morse
@@ -0,0 +1,35 @@
+#ifndef MORSE_CURSES_MONITOR_H_
+#define MORSE_CURSES_MONITOR_H_
+
+#include <ncurses.h>
+
+#include "monitor.h"
+#include "morse_reader.h"
+
+namespace morse {
+
+/**
+ * Shows the spectrum and the world lines on the terminal.
+ */
+class CursesMonitor : public Monitor {
+private:
+  int irow_ = 0;
+  int icol_ = 1;
+  int width_;
+  int height_;
+  WINDOW *dump_window_;
+  size_t prev_dump_size_ = 0;
+
+public:
+  CursesMonitor();
+  ~CursesMonitor();
+
+  void AddSignal(char signal) override;
+  void ShowSpectrum(const char *center, const int levels[],
+                    size_t num_levels) override;
+  void Dump(MorseReader *reader) override;
+};
+
+} // namespace morse
+
+#endif // MORSE_CURSES_MONITOR_H_
@@ -0,0 +1,44 @@
+#include "deadline_monitor.h"
+
+#include <algorithm>
+
+namespace morse {
+
+// the level rises when the backlog exceeds this many hops
+static const double kRaiseBacklog = 2.0;
+// hops to wait after a change before raising the level again, so that the
+// last change takes effect
+static const size_t kRaiseHold = 16;
+// hops of no backlog before the level falls by one
+static const size_t kRestoreHops = 256;
+
+bool DeadlineMonitor::AddHop(double elapsed) {
+  ++num_hops_;
+  ++hops_at_level_;
+  if (level_ > 0) {
+    ++num_degraded_hops_;
+  }
+  max_elapsed_ = std::max(max_elapsed_, elapsed);
+  if (elapsed > hop_duration_) {
+    ++num_overruns_;
+  }
+  backlog_ = std::max(0.0, backlog_ + elapsed - hop_duration_);
+  max_backlog_ = std::max(max_backlog_, backlog_);
+  clear_hops_ = backlog_ > 0.0 ? 0 : clear_hops_ + 1;
+
+  int level = level_;
+  if (backlog_ > kRaiseBacklog * hop_duration_ && hops_at_level_ >= kRaiseHold) {
+    level = std::min(level_ + 1, kMaxLevel);
+  } else if (clear_hops_ >= kRestoreHops && hops_at_level_ >= kRestoreHops) {
+    level = std::max(level_ - 1, 0);
+  }
+  if (level == level_) {
+    return false;
+  }
+  level_ = level;
+  hops_at_level_ = 0;
+  ++num_level_changes_;
+  return true;
+}
+
+} // namespace morse
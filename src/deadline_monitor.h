@@ -0,0 +1,62 @@
+#ifndef MORSE_DEADLINE_MONITOR_H_
+#define MORSE_DEADLINE_MONITOR_H_
+
+#include <stddef.h>
+
+namespace morse {
+
+/**
+ * Accounts the processing time of each hop against its duration on the audio
+ * clock in live decoding. The time over the budget accumulates as a backlog,
+ * and the load level rises while the backlog grows so that the caller sheds
+ * load, and falls back once the backlog has been clear for a while.
+ */
+class DeadlineMonitor {
+public:
+  static constexpr int kMaxLevel = 3;
+
+private:
+  double hop_duration_;
+
+  int level_ = 0;
+  double backlog_ = 0.0;
+  // hops since the level changed, and since the backlog was last non-zero
+  size_t hops_at_level_ = 0;
+  size_t clear_hops_ = 0;
+
+  size_t num_hops_ = 0;
+  size_t num_overruns_ = 0;
+  size_t num_degraded_hops_ = 0;
+  size_t num_level_changes_ = 0;
+  double max_elapsed_ = 0.0;
+  double max_backlog_ = 0.0;
+
+public:
+  /**
+   * hop_duration is the length of a hop in seconds.
+   */
+  explicit DeadlineMonitor(double hop_duration)
+      : hop_duration_(hop_duration) {}
+
+  /**
+   * Accounts a hop that took elapsed seconds to process. Returns true if the
+   * load level has changed.
+   */
+  bool AddHop(double elapsed);
+
+  /**
+   * Returns the load level from 0 for the full quality to kMaxLevel.
+   */
+  inline int GetLevel() const { return level_; }
+
+  inline size_t GetNumHops() const { return num_hops_; }
+  inline size_t GetNumOverruns() const { return num_overruns_; }
+  inline size_t GetNumDegradedHops() const { return num_degraded_hops_; }
+  inline size_t GetNumLevelChanges() const { return num_level_changes_; }
+  inline double GetMaxElapsed() const { return max_elapsed_; }
+  inline double GetMaxBacklog() const { return max_backlog_; }
+};
+
+} // namespace morse
+
+#endif // MORSE_DEADLINE_MONITOR_H_
@@ -0,0 +1,125 @@
+#include "decimator.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace morse {
+
+// filter length per decimation factor
+static const size_t kTapsPerPhase = 8;
+
+// the oscillator is renormalized this often to keep its magnitude at one
+static const size_t kRenormalizeInterval = 1024;
+
+Decimator::Decimator(size_t factor, double sample_rate, double mix_frequency)
+    : factor_(factor > 0 ? factor : 1) {
+  num_taps_ = factor_ > 1 ? kTapsPerPhase * factor_ : 1;
+  coefficients_ = new float[num_taps_];
+  // pass band is slightly narrower than the output Nyquist to leave a
+  // transition band for the filter
+  MakeLowPassFilter(num_taps_, 0.45 / factor_, coefficients_);
+
+  history_ = new complex[num_taps_ * 2];
+  memset(history_, 0, sizeof(complex) * num_taps_ * 2);
+
+  double step = -2 * M_PI * mix_frequency / sample_rate;
+  step_re_ = cos(step);
+  step_im_ = sin(step);
+}
+
+Decimator::~Decimator() {
+  delete[] coefficients_;
+  delete[] history_;
+}
+
+size_t Decimator::Process(const short input[], size_t num_samples,
+                          complex output[]) {
+  size_t num_outputs = 0;
+  for (size_t i = 0; i < num_samples; ++i) {
+    complex mixed;
+    mixed.Re = input[i] * nco_re_;
+    mixed.Im = input[i] * nco_im_;
+    history_[history_ptr_] = mixed;
+    history_[history_ptr_ + num_taps_] = mixed;
+    history_ptr_ = (history_ptr_ + 1) % num_taps_;
+
+    double re = nco_re_ * step_re_ - nco_im_ * step_im_;
+    double im = nco_re_ * step_im_ + nco_im_ * step_re_;
+    if (++num_rotations_ == kRenormalizeInterval) {
+      double scale = 1.0 / sqrt(re * re + im * im);
+      re *= scale;
+      im *= scale;
+      num_rotations_ = 0;
+    }
+    nco_re_ = re;
+    nco_im_ = im;
+
+    if (++phase_ < factor_) {
+      continue;
+    }
+    phase_ = 0;
+
+    // history_[history_ptr_] is the oldest sample
+    const complex *span = history_ + history_ptr_;
+    float sum_re = 0.0;
+    float sum_im = 0.0;
+    for (size_t k = 0; k < num_taps_; ++k) {
+      sum_re += coefficients_[k] * span[k].Re;
+      sum_im += coefficients_[k] * span[k].Im;
+    }
+    output[num_outputs].Re = sum_re;
+    output[num_outputs].Im = sum_im;
+    ++num_outputs;
+  }
+  return num_outputs;
+}
+
+void Decimator::SaveState(StateWriter *writer) const {
+  writer->Put(factor_);
+  writer->PutArray(history_, num_taps_ * 2);
+  writer->Put(history_ptr_);
+  writer->Put(phase_);
+  writer->Put(nco_re_);
+  writer->Put(nco_im_);
+  writer->Put(num_rotations_);
+}
+
+bool Decimator::LoadState(StateReader *reader) {
+  reader->Expect(factor_);
+  reader->GetArray(history_, num_taps_ * 2);
+  reader->Get(&history_ptr_);
+  reader->Get(&phase_);
+  reader->Get(&nco_re_);
+  reader->Get(&nco_im_);
+  reader->Get(&num_rotations_);
+  if (history_ptr_ >= num_taps_ || phase_ >= factor_) {
+    reader->Fail();
+  }
+  return !reader->Failed();
+}
+
+void Decimator::MakeLowPassFilter(size_t num_taps, float cutoff,
+                                  float coefficients[]) {
+  if (num_taps == 1) {
+    coefficients[0] = 1.0;
+    return;
+  }
+  // Blackman windowed sinc. The gain is set to the decimation factor so that
+  // the power spectrum of the shorter FFT keeps the levels that the detector
+  // thresholds are tuned for.
+  double sum = 0.0;
+  double center = (num_taps - 1) / 2.0;
+  for (size_t n = 0; n < num_taps; ++n) {
+    double x = n - center;
+    double sinc = x == 0.0 ? 2 * cutoff : sin(2 * M_PI * cutoff * x) / (M_PI * x);
+    double window = 0.42 - 0.5 * cos(2 * M_PI * n / (num_taps - 1)) +
+                    0.08 * cos(4 * M_PI * n / (num_taps - 1));
+    coefficients[n] = sinc * window;
+    sum += coefficients[n];
+  }
+  for (size_t n = 0; n < num_taps; ++n) {
+    coefficients[n] *= factor_ / sum;
+  }
+}
+
+} // namespace morse
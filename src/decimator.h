@@ -0,0 +1,57 @@
+#ifndef MORSE_DECIMATOR_H_
+#define MORSE_DECIMATOR_H_
+
+#include <stddef.h>
+
+#include "checkpoint.h"
+#include "fft.h"
+
+namespace morse {
+
+/**
+ * Front end that mixes the signal of interest down with a complex NCO and
+ * decimates it by a polyphase FIR low-pass filter. The FIR is evaluated only
+ * at output sample positions, so the cost is num_taps / factor per input
+ * sample.
+ */
+class Decimator {
+private:
+  size_t factor_;
+  size_t num_taps_;
+  float *coefficients_;
+
+  // mixed input history, kept twice so that the filter can run on a
+  // contiguous span without wrapping
+  complex *history_;
+  size_t history_ptr_ = 0;
+  size_t phase_ = 0; // input samples since the last output
+
+  // numerically controlled oscillator, rotated by one step per input sample
+  double nco_re_ = 1.0;
+  double nco_im_ = 0.0;
+  double step_re_;
+  double step_im_;
+  size_t num_rotations_ = 0;
+
+public:
+  Decimator(size_t factor, double sample_rate, double mix_frequency);
+  virtual ~Decimator();
+
+  inline size_t GetFactor() const { return factor_; }
+
+  /**
+   * Mixes and decimates the input. Returns the number of output samples,
+   * which is at most num_samples / factor rounded up.
+   */
+  size_t Process(const short input[], size_t num_samples, complex output[]);
+
+  void SaveState(StateWriter *writer) const;
+  bool LoadState(StateReader *reader);
+
+private:
+  void MakeLowPassFilter(size_t num_taps, float cutoff, float coefficients[]);
+};
+
+} // namespace morse
+
+#endif // MORSE_DECIMATOR_H_
@@ -0,0 +1,222 @@
+#include "decoder.h"
+
+#include <algorithm>
+
+namespace morse {
+
+// initial capacity of the event buffers, they grow only for larger batches
+static const size_t kInitialEvents = 64;
+static const size_t kInitialText = 4096;
+
+Decoder::Decoder(double sample_rate, size_t center_frequency,
+                 EventListener *listener, size_t decimation)
+    : listener_(listener), hop_size_(kHopSize), sample_rate_(sample_rate) {
+  channel_ = new ChannelDecoder(kNumBuffers, hop_size_, center_frequency,
+                                decimation, sample_rate);
+  Reserve();
+}
+
+Decoder::Decoder(double sample_rate, const AnalysisPlan &plan,
+                 EventListener *listener)
+    : listener_(listener), hop_size_(plan.hop_size), sample_rate_(sample_rate) {
+  channel_ = new ChannelDecoder(plan.num_buffers, hop_size_, plan.center_bin, 1,
+                                sample_rate);
+  channel_->GetDetector()->SetParameters(plan.Scale(DetectorParameters{}));
+  Reserve();
+}
+
+void Decoder::Reserve() {
+  pending_samples_.reserve(hop_size_);
+  pending_events_.reserve(kInitialEvents);
+  events_.reserve(kInitialEvents);
+  text_.reserve(kInitialText);
+  recent_.reserve(kMaxRecent);
+}
+
+Decoder::~Decoder() { delete channel_; }
+
+void Decoder::PushSamples(const short samples[], size_t num_samples) {
+  while (num_samples > 0) {
+    const short *hop = samples;
+    size_t n = hop_size_;
+    if (!pending_samples_.empty() || num_samples < hop_size_) {
+      n = std::min(num_samples, hop_size_ - pending_samples_.size());
+      pending_samples_.insert(pending_samples_.end(), samples, samples + n);
+      hop = pending_samples_.data();
+    }
+    samples += n;
+    num_samples -= n;
+    num_samples_ += n;
+    if (pending_samples_.size() % hop_size_ != 0) {
+      break;
+    }
+
+    channel_->Process(hop, hop_size_, nullptr);
+    pending_samples_.clear();
+    Update();
+  }
+  Deliver();
+}
+
+void Decoder::Flush() {
+  // less than a hop of samples ends the stream
+  channel_->Process(pending_samples_.data(), pending_samples_.size(), nullptr);
+  pending_samples_.clear();
+  channel_->Drain(nullptr);
+
+  Update();
+  Commit(EventType::FLUSH, channel_->GetReader()->GetCharacters());
+  Deliver();
+}
+
+void Decoder::SaveState(StateWriter *writer) const {
+  writer->Put(hop_size_);
+  writer->Put(sample_rate_);
+  writer->Put<uint64_t>(pending_samples_.size());
+  writer->PutArray(pending_samples_.data(), pending_samples_.size());
+  writer->Put(num_samples_);
+  writer->Put(num_delivered_);
+  writer->PutString(recent_);
+  writer->Put(num_corrections_);
+  writer->PutString(provisional_);
+  writer->Put(latency_);
+  writer->Put(num_shown_);
+  writer->Put(num_windows_);
+  writer->Put(current_signal_);
+  channel_->SaveState(writer);
+}
+
+bool Decoder::LoadState(StateReader *reader) {
+  reader->Expect(hop_size_);
+  reader->Expect(sample_rate_);
+  uint64_t num_pending = 0;
+  if (!reader->Get(&num_pending) || num_pending >= hop_size_) {
+    return false;
+  }
+  pending_samples_.resize(num_pending);
+  reader->GetArray(pending_samples_.data(), num_pending);
+  reader->Get(&num_samples_);
+  reader->Get(&num_delivered_);
+  reader->GetString(&recent_);
+  reader->Get(&num_corrections_);
+  reader->GetString(&provisional_);
+  reader->Get(&latency_);
+  reader->Get(&num_shown_);
+  reader->Get(&num_windows_);
+  reader->Get(&current_signal_);
+  if (reader->Failed() || recent_.size() > kMaxRecent ||
+      recent_.size() > num_delivered_) {
+    return false;
+  }
+  return channel_->LoadState(reader);
+}
+
+void Decoder::Update() {
+  MorseSignalDetector *detector = channel_->GetDetector();
+  MorseReader *reader = channel_->GetReader();
+  size_t num_windows = detector->GetWindowCount();
+  if (num_windows == num_windows_) {
+    return;
+  }
+  num_windows_ = num_windows;
+  uint8_t current_signal = detector->GetCurrentSignal();
+  if (current_signal_ && !current_signal) {
+    latency_.AddToneEnd(num_windows - 1, num_samples_);
+  }
+  current_signal_ = current_signal;
+
+  // a correction may rewind the reader before what it had committed
+  if (detector->GetNumCorrections() != num_corrections_) {
+    num_corrections_ = detector->GetNumCorrections();
+    Retract();
+  }
+  std::string_view committed = reader->GetCommittedCharacters();
+  uint64_t num_committed = reader->GetNumCommitted();
+  if (num_committed > num_delivered_) {
+    Commit(EventType::CHARACTERS,
+           committed.substr(committed.size() - (num_committed - num_delivered_)));
+  }
+  reader->ReleaseCommittedCharacters();
+
+  // without the committed characters, the rest of the best world line
+  const std::string &rest = reader->GetCharacters();
+  if (provisional_output_ && rest != provisional_) {
+    AddEvent(EventType::PROVISIONAL, rest);
+    provisional_.assign(rest);
+  }
+
+  uint64_t num_shown =
+      num_delivered_ + (provisional_output_ ? rest.size() : 0);
+  if (num_shown > num_shown_) {
+    bool has_character = false;
+    uint64_t recent_start = num_delivered_ - recent_.size();
+    for (uint64_t i = std::max(num_shown_, recent_start); i < num_shown; ++i) {
+      char c = i < num_delivered_ ? recent_[i - recent_start]
+                                  : rest[i - num_delivered_];
+      has_character |= c != ' ';
+    }
+    num_shown_ = num_shown;
+    size_t delay = detector->GetDetectionDelay();
+    if (has_character && num_windows > delay) {
+      latency_.AddEmission(num_windows - 1 - delay, num_samples_);
+    }
+  }
+}
+
+void Decoder::Retract() {
+  MorseReader *reader = channel_->GetReader();
+  std::string_view committed = reader->GetCommittedCharacters();
+  uint64_t num_committed = reader->GetNumCommitted();
+  uint64_t committed_start = num_committed - committed.size();
+  uint64_t recent_start = num_delivered_ - recent_.size();
+
+  // characters before both are not affected by the correction
+  uint64_t position = std::max(committed_start, recent_start);
+  while (position < num_committed && position < num_delivered_ &&
+         committed[position - committed_start] ==
+             recent_[position - recent_start]) {
+    ++position;
+  }
+  if (position < num_delivered_) {
+    AddEvent(EventType::RETRACT,
+             std::string_view(recent_).substr(position - recent_start));
+    recent_.resize(position - recent_start);
+    num_delivered_ = position;
+  }
+}
+
+void Decoder::Commit(EventType type, std::string_view characters) {
+  // the end of the stream is notified even without characters
+  if (characters.empty() && type != EventType::FLUSH) {
+    return;
+  }
+  AddEvent(type, characters);
+  num_delivered_ += characters.size();
+  recent_.append(characters);
+  if (recent_.size() > kMaxRecent) {
+    recent_.erase(0, recent_.size() - kMaxRecent);
+  }
+}
+
+void Decoder::AddEvent(EventType type, std::string_view text) {
+  pending_events_.push_back(
+      PendingEvent{type, num_samples_, text_.size(), text.size()});
+  text_.append(text);
+}
+
+void Decoder::Deliver() {
+  if (pending_events_.empty()) {
+    return;
+  }
+  events_.clear();
+  for (const auto &pending : pending_events_) {
+    events_.push_back(Event{pending.type, pending.timestamp,
+                            std::string_view(text_.data() + pending.offset,
+                                             pending.length)});
+  }
+  listener_->OnEvents(events_.data(), events_.size());
+  pending_events_.clear();
+  text_.clear();
+}
+
+} // namespace morse
@@ -0,0 +1,142 @@
+#ifndef MORSE_DECODER_H_
+#define MORSE_DECODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "analysis_plan.h"
+#include "channel_decoder.h"
+#include "event_listener.h"
+#include "latency_meter.h"
+
+namespace morse {
+
+/**
+ * Decodes a stream of samples pushed in pieces of any size and delivers the
+ * decoded characters to an event listener. This is the entry point for
+ * embedding the decoder, it does not depend on the terminal or the audio
+ * device.
+ */
+class Decoder {
+private:
+  ChannelDecoder *channel_;
+  EventListener *listener_;
+  size_t hop_size_;
+
+  // samples that do not make a whole hop yet
+  std::vector<short> pending_samples_;
+  uint64_t num_samples_ = 0;
+
+  double sample_rate_;
+
+  // characters delivered so far; the last ones are kept since a correction
+  // may retract them
+  uint64_t num_delivered_ = 0;
+  std::string recent_;
+  static constexpr size_t kMaxRecent = 256;
+  size_t num_corrections_ = 0;
+
+  bool provisional_output_ = false;
+  std::string provisional_;
+
+  // the latency is measured on the characters shown for the first time
+  LatencyMeter latency_;
+  uint64_t num_shown_ = 0;
+  size_t num_windows_ = 0;
+  uint8_t current_signal_ = 0;
+
+  // events are batched until the end of PushSamples; their texts are kept
+  // as offsets since the buffer may grow
+  struct PendingEvent {
+    EventType type;
+    uint64_t timestamp;
+    size_t offset;
+    size_t length;
+  };
+  std::vector<PendingEvent> pending_events_;
+  std::vector<Event> events_;
+  std::string text_;
+
+public:
+  static const size_t kHopSize = 256;
+  static const size_t kNumBuffers = 2;
+
+  /**
+   * center_frequency is the bin of the tone in the spectrum of
+   * kNumBuffers * kHopSize samples. The decoder does not take the ownership
+   * of the listener.
+   */
+  Decoder(double sample_rate, size_t center_frequency, EventListener *listener,
+          size_t decimation = 1);
+
+  /**
+   * Sizes the analysis by a plan of PlanAnalysis for the sample rate. The
+   * samples are processed in hops of plan.hop_size.
+   */
+  Decoder(double sample_rate, const AnalysisPlan &plan,
+          EventListener *listener);
+  virtual ~Decoder();
+
+  /**
+   * Gives the detector for further settings, e.g. frequency tracking.
+   */
+  inline MorseSignalDetector *GetDetector() {
+    return channel_->GetDetector();
+  }
+
+  /**
+   * Delivers the characters that are not agreed yet as PROVISIONAL events.
+   * Combined with a short detection delay, this shows characters as early as
+   * possible at the cost of RETRACT events.
+   */
+  inline void EnableProvisionalOutput(bool enabled = true) {
+    provisional_output_ = enabled;
+  }
+
+  inline const LatencyMeter &GetLatency() const { return latency_; }
+  inline double GetSampleRate() const { return sample_rate_; }
+
+  void PushSamples(const short samples[], size_t num_samples);
+
+  /**
+   * Ends the stream. The characters that are not agreed yet are delivered as
+   * a FLUSH event.
+   */
+  void Flush();
+
+  /**
+   * Saves and loads the state of the stream for a checkpoint, between calls
+   * of PushSamples, so that a decoding can resume where it was saved, e.g.
+   * after a restart or on another worker. The loading decoder must be made
+   * and set up like the saving one. The position of the stream is that of
+   * the saved one; LoadState returns false if the state does not fit this
+   * decoder or is broken, and the decoder must not be used then.
+   */
+  void SaveState(StateWriter *writer) const;
+  bool LoadState(StateReader *reader);
+
+private:
+  void Reserve();
+
+  /**
+   * Follows the detector and the reader after a hop.
+   */
+  void Update();
+
+  /**
+   * Withdraws the delivered characters that the reader no longer has after
+   * a correction.
+   */
+  void Retract();
+
+  void Commit(EventType type, std::string_view characters);
+  void AddEvent(EventType type, std::string_view text);
+  void Deliver();
+};
+
+} // namespace morse
+
+#endif // MORSE_DECODER_H_
@@ -0,0 +1,265 @@
+#include "ensemble_decoder.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace morse {
+
+// marks are 1 or 3 dots, spaces 1, 3, or 7; longer spaces are pauses
+static const double kMarkUnits[] = {1.0, 3.0};
+static const double kSpaceUnits[] = {1.0, 3.0, 7.0};
+static const double kMaxSpaceUnits = 10.0;
+// weights of the latest run in the averages
+static const double kDotLengthWeight = 0.25;
+static const double kTimingErrorWeight = 0.125;
+// a member loses its vote as its timing error grows to this, in dots
+static const double kMaxTimingError = 0.5;
+// a member keeps a little weight however bad its timing
+static const double kMinReliability = 0.01;
+
+EnsembleDecoder::EnsembleDecoder(size_t hop_size,
+                                 const std::vector<EnsembleMember> &members,
+                                 size_t decimation, double sample_rate,
+                                 const ReaderParameters &reader_parameters)
+    : hop_size_(hop_size), members_(members.size()) {
+  for (size_t i = 0; i < members.size(); ++i) {
+    Member &member = members_[i];
+    member.num_buffers = members[i].num_buffers;
+    member.offset = (member.num_buffers - 1) / 2;
+    max_offset_ = std::max(max_offset_, member.offset);
+    member.channel =
+        new ChannelDecoder(member.num_buffers, hop_size, members[i].center_bin,
+                           decimation, sample_rate);
+    // the decisions are fused as they are made; a delay would only hold
+    // them back
+    DetectorParameters parameters = members[i].parameters;
+    parameters.detection_delay = 0;
+    MorseSignalDetector *detector = member.channel->GetDetector();
+    detector->SetParameters(parameters);
+    detector->DecideOnly();
+    min_toggle_interval_ =
+        std::max(min_toggle_interval_, parameters.min_toggle_interval);
+  }
+  // windows are fused from the first center that all the members have
+  next_center_ = max_offset_;
+  reader_ = new MorseReader(reader_parameters);
+
+  for (size_t i = 1; i < members_.size(); ++i) {
+    members_[i].thread = std::thread(&EnsembleDecoder::Run, this, i);
+  }
+}
+
+EnsembleDecoder::~EnsembleDecoder() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    closing_ = true;
+    cond_.notify_all();
+  }
+  for (auto &member : members_) {
+    if (member.thread.joinable()) {
+      member.thread.join();
+    }
+    delete member.channel;
+  }
+  delete reader_;
+}
+
+void EnsembleDecoder::Process(const short samples[], size_t num_samples,
+                              bool last, Monitor *monitor) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    samples_ = samples;
+    num_samples_ = num_samples;
+    last_ = last;
+    num_running_ = members_.size() - 1;
+    ++generation_;
+    cond_.notify_all();
+  }
+  ProcessMember(&members_[0]);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return num_running_ == 0; });
+  }
+  Fuse(monitor, false);
+}
+
+void EnsembleDecoder::Run(size_t index) {
+  uint64_t generation = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this, generation] {
+      return generation_ != generation || closing_;
+    });
+    if (closing_) {
+      return;
+    }
+    generation = generation_;
+    lock.unlock();
+    ProcessMember(&members_[index]);
+    lock.lock();
+    if (--num_running_ == 0) {
+      cond_.notify_all();
+    }
+  }
+}
+
+void EnsembleDecoder::ProcessMember(Member *member) {
+  ChannelDecoder *channel = member->channel;
+  size_t num_hops = num_samples_ / hop_size_;
+  size_t offset = num_hops * hop_size_;
+  if (batch_ && channel->GetDetector()->CanBatch()) {
+    size_t num_bins = channel->GetDetector()->GetNumBins();
+    member->spectra.resize(num_bins * (num_hops + 1));
+    size_t num_spectra =
+        channel->AnalyzeHops(samples_, num_hops, member->spectra.data());
+    if (last_ && channel->Analyze(samples_ + offset, num_samples_ - offset,
+                                  member->spectra.data() +
+                                      num_spectra * num_bins)) {
+      ++num_spectra;
+    }
+    for (size_t i = 0; i < num_spectra; ++i) {
+      channel->Detect(member->spectra.data() + i * num_bins, nullptr);
+      Record(member);
+    }
+    return;
+  }
+  for (size_t i = 0; i < num_hops; ++i) {
+    channel->Process(samples_ + i * hop_size_, hop_size_, nullptr);
+    Record(member);
+  }
+  if (last_) {
+    channel->Process(samples_ + offset, num_samples_ - offset, nullptr);
+    Record(member);
+  }
+}
+
+void EnsembleDecoder::Record(Member *member) {
+  MorseSignalDetector *detector = member->channel->GetDetector();
+  if (detector->GetWindowCount() >
+      member->first_window + member->decisions.size()) {
+    member->decisions.push_back(detector->GetCurrentSignal());
+  }
+}
+
+void EnsembleDecoder::Drain(Monitor *monitor) {
+  Fuse(monitor, true);
+  // one more window of silence after the end of the input
+  if (reader_->UpdateSilence() && monitor != nullptr) {
+    monitor->Dump(reader_);
+  }
+}
+
+void EnsembleDecoder::AddRun(Member *member) {
+  double length = member->run_length;
+  bool mark = member->last_signal != 0;
+  if (member->dot_length <= 0.0) {
+    // the first mark gives the first guess
+    if (mark) {
+      member->dot_length = length;
+    }
+    return;
+  }
+  double dot_length = member->dot_length;
+  if (!mark && length > dot_length * kMaxSpaceUnits) {
+    return;
+  }
+  const double *units = mark ? kMarkUnits : kSpaceUnits;
+  size_t num_units = mark ? sizeof(kMarkUnits) / sizeof(kMarkUnits[0])
+                          : sizeof(kSpaceUnits) / sizeof(kSpaceUnits[0]);
+  double unit = units[0];
+  for (size_t i = 1; i < num_units; ++i) {
+    if (fabs(length - units[i] * dot_length) <
+        fabs(length - unit * dot_length)) {
+      unit = units[i];
+    }
+  }
+  double error = std::min(1.0, fabs(length - unit * dot_length) / dot_length);
+  member->timing_error += (error - member->timing_error) * kTimingErrorWeight;
+  if (mark) {
+    member->dot_length += (length / unit - dot_length) * kDotLengthWeight;
+  }
+}
+
+void EnsembleDecoder::Fuse(Monitor *monitor, bool partial) {
+  while (true) {
+    double marks = 0.0;
+    double total = 0.0;
+    size_t num_available = 0;
+    for (auto &member : members_) {
+      size_t window = next_center_ - member.offset;
+      if (window >= member.first_window + member.decisions.size()) {
+        continue;
+      }
+      ++num_available;
+      uint8_t signal = member.decisions[window - member.first_window];
+      double reliability = std::max(
+          kMinReliability, 1.0 - member.timing_error / kMaxTimingError);
+      double weight = reliability * reliability;
+      marks += signal ? weight : 0.0;
+      total += weight;
+    }
+    if (num_available == 0 ||
+        (num_available < members_.size() && !partial)) {
+      break;
+    }
+    // a tie keeps the decision
+    uint8_t fused_signal = fused_signal_;
+    if (marks * 2.0 > total) {
+      fused_signal = 1;
+    } else if (marks * 2.0 < total) {
+      fused_signal = 0;
+    }
+    if (fused_signal != fused_signal_ &&
+        num_fused_ - last_toggled_ >= min_toggle_interval_) {
+      fused_signal_ = fused_signal;
+      last_toggled_ = num_fused_;
+    }
+
+    for (auto &member : members_) {
+      size_t window = next_center_ - member.offset;
+      if (window >= member.first_window + member.decisions.size()) {
+        continue;
+      }
+      uint8_t signal = member.decisions[window - member.first_window];
+      if (signal != member.last_signal && member.run_length > 0) {
+        AddRun(&member);
+        member.run_length = 0;
+      }
+      member.last_signal = signal;
+      ++member.run_length;
+      if (signal == fused_signal_) {
+        ++member.num_agreed;
+      }
+    }
+    ++next_center_;
+    ++num_fused_;
+
+    if (monitor != nullptr) {
+      monitor->AddSignal(fused_signal_ ? '^' : '_');
+    }
+    bool some_changed = fused_signal_ ? reader_->Update(fused_signal_)
+                                      : reader_->UpdateSilence();
+    if (some_changed && monitor != nullptr) {
+      monitor->Dump(reader_);
+    }
+  }
+
+  // the decisions before the next center are done with
+  for (auto &member : members_) {
+    size_t window = next_center_ - member.offset;
+    size_t num_done = std::min(window - std::min(window, member.first_window),
+                               member.decisions.size());
+    member.decisions.erase(member.decisions.begin(),
+                           member.decisions.begin() + num_done);
+    member.first_window += num_done;
+  }
+}
+
+double EnsembleDecoder::GetAgreement(size_t index) const {
+  return num_fused_ > 0
+             ? static_cast<double>(members_[index].num_agreed) / num_fused_
+             : 0.0;
+}
+
+} // namespace morse
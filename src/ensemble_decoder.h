@@ -0,0 +1,147 @@
+#ifndef MORSE_ENSEMBLE_DECODER_H_
+#define MORSE_ENSEMBLE_DECODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "channel_decoder.h"
+#include "monitor.h"
+#include "morse_reader.h"
+#include "parameters.h"
+
+namespace morse {
+
+/**
+ * Window configuration of an ensemble member.
+ */
+struct EnsembleMember {
+  // window length in hops
+  size_t num_buffers;
+  // bin of the tone in the spectrum of num_buffers hops
+  size_t center_bin;
+  // detector parameters scaled for the FFT size of the window
+  DetectorParameters parameters;
+};
+
+/**
+ * Decodes a channel with several window lengths at once, each member on its
+ * own thread, and feeds a single reader with the fused decisions. A long
+ * window hears weak signals and a short one resolves fast code. The members
+ * vote by how well their marks and spaces keep the timing of Morse code; a
+ * window too short for the signal breaks marks into random pieces, and one
+ * too long for the speed merges the elements.
+ *
+ * All the members share the hop so that their windows are aligned by their
+ * centers hop by hop.
+ */
+class EnsembleDecoder {
+private:
+  struct Member {
+    ChannelDecoder *channel = nullptr;
+    size_t num_buffers = 0;
+    // center of a window from its first hop
+    size_t offset = 0;
+    // decisions of windows [first_window, first_window + size) not fused yet
+    std::vector<uint8_t> decisions{};
+    size_t first_window = 0;
+    std::vector<float> spectra{};
+
+    // reliability by the lengths of the runs of the same decision in
+    // windows; the dot length and the timing error are averaged over them
+    uint8_t last_signal = 0;
+    size_t run_length = 0;
+    double dot_length = 0.0;
+    double timing_error = 0.0;
+    uint64_t num_agreed = 0;
+
+    std::thread thread{};
+  };
+
+  size_t hop_size_;
+  std::vector<Member> members_;
+  size_t max_offset_ = 0;
+  bool batch_ = false;
+
+  MorseReader *reader_;
+  uint8_t fused_signal_ = 0;
+  // the fused signal avoids chattering like a detector
+  size_t min_toggle_interval_ = 0;
+  uint64_t last_toggled_ = 0;
+  // center hop of the next window to fuse
+  size_t next_center_ = 0;
+  uint64_t num_fused_ = 0;
+
+  // the members beyond the first run on their own threads over the samples
+  // of each Process
+  const short *samples_ = nullptr;
+  size_t num_samples_ = 0;
+  bool last_ = false;
+  uint64_t generation_ = 0;
+  size_t num_running_ = 0;
+  bool closing_ = false;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+
+public:
+  EnsembleDecoder(size_t hop_size, const std::vector<EnsembleMember> &members,
+                  size_t decimation, double sample_rate,
+                  const ReaderParameters &reader_parameters);
+  virtual ~EnsembleDecoder();
+
+  inline MorseReader *GetReader() { return reader_; }
+  inline size_t GetNumMembers() const { return members_.size(); }
+
+  /**
+   * Gives a member for further settings, e.g. frequency tracking.
+   */
+  inline ChannelDecoder *GetMember(size_t index) {
+    return members_[index].channel;
+  }
+
+  /**
+   * Lets the members transform their windows in batches, for offline
+   * decoding.
+   */
+  inline void EnableBatch(bool enabled = true) { batch_ = enabled; }
+
+  /**
+   * Processes samples of any number of whole hops. last marks the end of the
+   * stream, where the samples may end with a partial hop.
+   */
+  void Process(const short samples[], size_t num_samples, bool last,
+               Monitor *monitor);
+
+  /**
+   * Fuses the windows that only some members have at the end of the stream.
+   */
+  void Drain(Monitor *monitor);
+
+  /**
+   * Returns the ratio of the fused windows where the member agreed with the
+   * fused decision.
+   */
+  double GetAgreement(size_t index) const;
+  /**
+   * Returns the average distance of the runs of the member from the nearest
+   * Morse timing, in dots.
+   */
+  inline double GetTimingError(size_t index) const {
+    return members_[index].timing_error;
+  }
+
+private:
+  void Run(size_t index);
+  void ProcessMember(Member *member);
+  void Record(Member *member);
+  static void AddRun(Member *member);
+  void Fuse(Monitor *monitor, bool partial);
+};
+
+} // namespace morse
+
+#endif // MORSE_ENSEMBLE_DECODER_H_
@@ -1,30 +1,62 @@
 #ifndef EVENT_LISTENER_H_
 #define EVENT_LISTENER_H_
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
-#include <string>
+#include <string_view>
 
 namespace morse {
 
 enum class EventType {
-  SIGNAL,
-  OUT,
+  // characters that all the world lines agree on; they change only by a
+  // RETRACT after the detector corrected the reader
+  CHARACTERS,
+  // characters of the most confident world line after the committed ones,
+  // replacing the previous provisional text
+  PROVISIONAL,
+  // committed characters that are withdrawn, from the end
+  RETRACT,
+  // the rest of the most confident world line at the end of the stream
+  FLUSH,
+};
+
+struct Event {
+  EventType type;
+  // position in samples of the input when the event was made
+  uint64_t timestamp;
+  std::string_view text;
 };
 
 class EventListener {
 public:
   virtual ~EventListener() = default;
-  virtual void OnEvent(EventType event_type, const std::string &event) = 0;
+
+  /**
+   * Receives a batch of events. The events and their texts are valid only
+   * during the call.
+   */
+  virtual void OnEvents(const Event events[], size_t num_events) = 0;
 };
 
 class DefaultEventListener : public EventListener {
 public:
-  void OnEvent(EventType event_type, const std::string &event) {
-    if (event_type == EventType::OUT) {
-      printf(" %s  ", event.c_str());
-    } else {
-      printf("%s", event.c_str());
+  void OnEvents(const Event events[], size_t num_events) override {
+    for (size_t i = 0; i < num_events; ++i) {
+      if (events[i].type == EventType::PROVISIONAL) {
+        continue;
+      }
+      if (events[i].type == EventType::RETRACT) {
+        for (size_t j = 0; j < events[i].text.size(); ++j) {
+          fputs("\b \b", stdout);
+        }
+        continue;
+      }
+      fwrite(events[i].text.data(), 1, events[i].text.size(), stdout);
+      if (events[i].type == EventType::FLUSH) {
+        putchar('\n');
+      }
     }
     fflush(stdout);
   }
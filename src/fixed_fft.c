@@ -0,0 +1,94 @@
+/*
+ * Radix-2 decimation in time FFT on integers, for processors without fast
+ * floating point.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "fixed_fft.h"
+
+#ifndef PI
+#define PI 3.14159265358979323846264338327950288
+#endif
+
+/* a butterfly grows values by at most 1 + sqrt(2), keep them below 2^15 */
+#define MAX_STAGE_INPUT (1 << 13)
+
+void fixed_fft_make_twiddles(int16_t *twiddles, int n) {
+  int m;
+  for (m = 0; m < n / 2; m++) {
+    twiddles[2 * m] = (int16_t)lrint(32767 * cos(2 * PI * m / (double)n));
+    twiddles[2 * m + 1] = (int16_t)lrint(-32767 * sin(2 * PI * m / (double)n));
+  }
+}
+
+static int32_t max_magnitude(const complex32 *v, int n) {
+  int32_t max = 0;
+  int k;
+  for (k = 0; k < n; k++) {
+    int32_t re = abs(v[k].Re);
+    int32_t im = abs(v[k].Im);
+    if (re > max) {
+      max = re;
+    }
+    if (im > max) {
+      max = im;
+    }
+  }
+  return max;
+}
+
+int fixed_fft(complex32 *v, int n, const int16_t *twiddles) {
+  int exponent = 0;
+  int i, j, k, size;
+
+  /* bit reversal permutation */
+  for (i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      complex32 t = v[i];
+      v[i] = v[j];
+      v[j] = t;
+    }
+  }
+
+  for (size = 2; size <= n; size <<= 1) {
+    int half = size >> 1;
+    int step = n / size;
+    /* scale the block down when the stage may overflow */
+    int32_t max = max_magnitude(v, n);
+    int shift = 0;
+    while ((max >> shift) >= MAX_STAGE_INPUT) {
+      shift++;
+    }
+    if (shift > 0) {
+      int32_t round = 1 << (shift - 1);
+      for (k = 0; k < n; k++) {
+        v[k].Re = (v[k].Re + round) >> shift;
+        v[k].Im = (v[k].Im + round) >> shift;
+      }
+      exponent += shift;
+    }
+
+    for (i = 0; i < n; i += size) {
+      for (k = 0; k < half; k++) {
+        int32_t wr = twiddles[2 * k * step];
+        int32_t wi = twiddles[2 * k * step + 1];
+        complex32 *a = v + i + k;
+        complex32 *b = a + half;
+        int32_t tr = (wr * b->Re - wi * b->Im + (1 << 14)) >> 15;
+        int32_t ti = (wr * b->Im + wi * b->Re + (1 << 14)) >> 15;
+        b->Re = a->Re - tr;
+        b->Im = a->Im - ti;
+        a->Re += tr;
+        a->Im += ti;
+      }
+    }
+  }
+  return exponent;
+}
@@ -0,0 +1,33 @@
+#ifndef FIXED_FFT_H_
+#define FIXED_FFT_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  int32_t Re;
+  int32_t Im;
+} complex32;
+
+/*
+ * Fills the twiddle factors of an n-point FFT in Q15; n / 2 pairs of cosine
+ * and negated sine.
+ */
+extern void fixed_fft_make_twiddles(int16_t *twiddles, int n);
+
+/*
+ * Block floating point FFT in place. Values of v must fit in 16 bits. They
+ * are halved as a block whenever a stage might overflow 16 bits, so the
+ * result is v * 2^exponent where the returned exponent is the number of
+ * halvings. n must be a power of two.
+ */
+extern int fixed_fft(complex32 *v, int n, const int16_t *twiddles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FIXED_FFT_H_
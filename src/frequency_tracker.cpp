@@ -0,0 +1,139 @@
+#include "frequency_tracker.h"
+
+#include <algorithm>
+
+namespace morse {
+
+// bins to look at on each side of the tracked tone
+static const size_t kSearchRadius = 2;
+
+// the lock is verified by a full scan this often
+static const size_t kScanInterval = 256;
+
+// once the tone has been quiet for kQuietThreshold windows the spectrum is
+// scanned more often, the lock is released after kLockTimeout windows
+static const size_t kQuietThreshold = 64;
+static const size_t kQuietScanInterval = 16;
+static const size_t kLockTimeout = 512;
+
+// a new tone must be the peak for this many consecutive scans to be locked,
+// so that key clicks and other transients are not taken
+static const size_t kAcquireCount = 3;
+
+// same as the level the detector turns a signal on
+static const float kToneLevel = 3.e10;
+
+// portion of the measured offset applied per window, keeps retuning smooth
+static const double kSmoothing = 0.1;
+
+FrequencyTracker::FrequencyTracker(size_t initial_bin, size_t min_bin,
+                                   size_t max_bin, bool locked)
+    : min_bin_(min_bin), max_bin_(max_bin), frequency_(initial_bin),
+      locked_(locked) {}
+
+void FrequencyTracker::GetSearchRange(size_t *first, size_t *last) const {
+  if (!locked_ || windows_since_scan_ >= kScanInterval ||
+      (windows_without_tone_ >= kQuietThreshold &&
+       windows_since_scan_ >= kQuietScanInterval)) {
+    *first = min_bin_;
+    *last = max_bin_;
+    return;
+  }
+  size_t bin = GetBin();
+  *first = std::max(min_bin_, bin - std::min(bin, kSearchRadius));
+  *last = std::min(max_bin_, bin + kSearchRadius + 1);
+}
+
+void FrequencyTracker::Update(const float values[], size_t first,
+                              size_t last) {
+  bool full_scan = first == min_bin_ && last == max_bin_;
+  if (full_scan) {
+    windows_since_scan_ = 0;
+  } else {
+    ++windows_since_scan_;
+  }
+
+  size_t peak = first;
+  for (size_t bin = first; bin < last; ++bin) {
+    if (values[bin - first] > values[peak - first]) {
+      peak = bin;
+    }
+  }
+  float value = values[peak - first];
+  if (value < kToneLevel) {
+    if (locked_ && ++windows_without_tone_ >= kLockTimeout) {
+      locked_ = false;
+    }
+    return;
+  }
+
+  if (!locked_ || full_scan) {
+    // Acquire only a sharp peak, a wide band noise is not a tone. While
+    // locked, a full scan moves the lock only to a tone that is much stronger
+    // than the current one.
+    bool sharp = (peak < first + 2 || values[peak - first - 2] < value * 0.05) &&
+                 (peak + 2 >= last || values[peak - first + 2] < value * 0.05);
+    size_t bin = GetBin();
+    if (locked_ && bin >= first && bin < last &&
+        values[bin - first] * 4 > value) {
+      windows_without_tone_ = 0;
+      candidate_count_ = 0;
+    } else if (!sharp) {
+      candidate_count_ = 0;
+    } else if (candidate_count_ > 0 && peak + 1 >= candidate_bin_ &&
+               peak <= candidate_bin_ + 1) {
+      candidate_bin_ = peak;
+      if (++candidate_count_ >= kAcquireCount) {
+        frequency_ = peak;
+        locked_ = true;
+        windows_without_tone_ = 0;
+        candidate_count_ = 0;
+      }
+    } else {
+      candidate_bin_ = peak;
+      candidate_count_ = 1;
+    }
+    if (!locked_ || bin != peak) {
+      return;
+    }
+  }
+
+  windows_without_tone_ = 0;
+
+  // refine the peak position by parabolic interpolation
+  double offset = 0.0;
+  if (peak > first && peak + 1 < last) {
+    float left = values[peak - first - 1];
+    float right = values[peak - first + 1];
+    float denominator = left - 2 * value + right;
+    if (denominator < 0) {
+      offset = std::max(-0.5, std::min(0.5, 0.5 * (left - right) / denominator));
+    }
+  }
+  frequency_ += (peak + offset - frequency_) * kSmoothing;
+}
+
+void FrequencyTracker::SaveState(StateWriter *writer) const {
+  writer->Put(min_bin_);
+  writer->Put(max_bin_);
+  writer->Put(frequency_);
+  writer->Put(locked_);
+  writer->Put(windows_since_scan_);
+  writer->Put(windows_without_tone_);
+  writer->Put(candidate_bin_);
+  writer->Put(candidate_count_);
+}
+
+bool FrequencyTracker::LoadState(StateReader *reader) {
+  reader->Expect(min_bin_);
+  reader->Expect(max_bin_);
+  reader->Get(&frequency_);
+  reader->Get(&locked_);
+  reader->Get(&windows_since_scan_);
+  reader->Get(&windows_without_tone_);
+  reader->Get(&candidate_bin_);
+  reader->Get(&candidate_count_);
+  return !reader->Failed();
+}
+
+} // namespace morse
@@ -0,0 +1,58 @@
+#ifndef MORSE_FREQUENCY_TRACKER_H_
+#define MORSE_FREQUENCY_TRACKER_H_
+
+#include <stddef.h>
+
+#include "checkpoint.h"
+
+namespace morse {
+
+/**
+ * Automatic frequency control. The tracker holds on to the active tone and
+ * asks for a small neighborhood around it every window. The whole spectrum
+ * is scanned only while the lock is lost and once in a while to verify the
+ * lock.
+ */
+class FrequencyTracker {
+private:
+  size_t min_bin_;
+  size_t max_bin_;
+  double frequency_; // in bins, fractional
+  bool locked_ = false;
+  size_t windows_since_scan_ = 0;
+  size_t windows_without_tone_ = 0;
+  size_t candidate_bin_ = 0;
+  size_t candidate_count_ = 0;
+
+public:
+  /**
+   * Bins in [min_bin, max_bin) are candidates for the tone.
+   */
+  FrequencyTracker(size_t initial_bin, size_t min_bin, size_t max_bin,
+                   bool locked);
+
+  /**
+   * Returns the range of bins [*first, *last) the tracker needs for the next
+   * update.
+   */
+  void GetSearchRange(size_t *first, size_t *last) const;
+
+  /**
+   * Updates the tracker by filtered spectrum values. values[i] is the value
+   * for bin first + i.
+   */
+  void Update(const float values[], size_t first, size_t last);
+
+  inline size_t GetBin() const {
+    return static_cast<size_t>(frequency_ + 0.5);
+  }
+  inline double GetFrequency() const { return frequency_; }
+  inline bool IsLocked() const { return locked_; }
+
+  void SaveState(StateWriter *writer) const;
+  bool LoadState(StateReader *reader);
+};
+
+} // namespace morse
+
+#endif // MORSE_FREQUENCY_TRACKER_H_
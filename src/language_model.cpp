@@ -0,0 +1,206 @@
+#include "language_model.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace morse {
+
+static_assert(sizeof(LanguageHeader) == kLanguageHeaderSize,
+              "language header must not be padded");
+
+// a known word makes its world line this much more likely, as a log
+static const float kKnownWordScore = 1.4f;
+
+static size_t TableSize(uint32_t order) {
+  size_t size = 1;
+  for (uint32_t i = 0; i < order; ++i) {
+    size *= kModelAlphabetSize;
+  }
+  return size;
+}
+
+LanguageModel::~LanguageModel() {
+  if (data_ != nullptr) {
+    munmap(const_cast<uint8_t *>(data_), size_);
+  }
+}
+
+int LanguageModel::Open(const std::string &file_name) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  if (static_cast<size_t>(st.st_size) < kLanguageHeaderSize) {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+  size_ = st.st_size;
+  void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+  data_ = static_cast<const uint8_t *>(data);
+
+  memcpy(&header_, data_, sizeof(header_));
+  size_t table_end =
+      kLanguageHeaderSize + sizeof(float) * TableSize(header_.order);
+  size_t offsets_end = static_cast<size_t>(header_.words_offset) +
+                       sizeof(uint32_t) * header_.num_words;
+  if (memcmp(header_.magic, kLanguageFileMagic, sizeof(header_.magic)) != 0 ||
+      header_.version != kLanguageFileVersion || header_.order < 1 ||
+      header_.order > kMaxModelOrder || table_end > size_ ||
+      header_.words_offset < table_end ||
+      header_.words_offset % sizeof(uint32_t) != 0 || offsets_end > size_ ||
+      data_[size_ - 1] != '\0') {
+    errno = EINVAL;
+    return -1;
+  }
+  const auto *word_offsets =
+      reinterpret_cast<const uint32_t *>(data_ + header_.words_offset);
+  // every word lies past the offsets and the word before it, and ends
+  // within the file
+  size_t word_end = offsets_end;
+  for (uint32_t i = 0; i < header_.num_words; ++i) {
+    const void *terminator = nullptr;
+    if (word_offsets[i] >= word_end && word_offsets[i] < size_) {
+      terminator = memchr(data_ + word_offsets[i], '\0',
+                          size_ - word_offsets[i]);
+    }
+    if (terminator == nullptr) {
+      errno = EINVAL;
+      return -1;
+    }
+    word_end = static_cast<const uint8_t *>(terminator) - data_ + 1;
+  }
+  table_ = reinterpret_cast<const float *>(data_ + kLanguageHeaderSize);
+  word_offsets_ = word_offsets;
+  context_mask_ = TableSize(header_.order - 1) - 1;
+  return 0;
+}
+
+float LanguageModel::ScoreWord(std::string_view word) const {
+  if (word.empty() || header_.num_words == 0) {
+    return 0.0f;
+  }
+  auto word_at = [this](uint32_t offset) {
+    return std::string_view(reinterpret_cast<const char *>(data_ + offset));
+  };
+  const uint32_t *end = word_offsets_ + header_.num_words;
+  const uint32_t *found = std::lower_bound(
+      word_offsets_, end, word, [&word_at](uint32_t offset, std::string_view w) {
+        return word_at(offset) < w;
+      });
+  return found != end && word_at(*found) == word ? kKnownWordScore : 0.0f;
+}
+
+LanguageModelBuilder::LanguageModelBuilder(uint32_t order)
+    : order_(order), counts_(TableSize(order)) {}
+
+void LanguageModelBuilder::AddText(std::string_view text) {
+  for (char c : text) {
+    AddSymbol(LanguageModel::ToSymbol(c));
+  }
+}
+
+void LanguageModelBuilder::AddSymbol(uint32_t symbol) {
+  // runs of separators count as a single space
+  if (symbol == 0 && (context_ % kModelAlphabetSize) == 0) {
+    return;
+  }
+  uint32_t context_mask = TableSize(order_ - 1) - 1;
+  ++counts_[(context_ & context_mask) * kModelAlphabetSize + symbol];
+  context_ = LanguageModel::PushContext(context_, ' ' + symbol);
+  if (symbol != 0) {
+    word_.push_back(static_cast<char>(' ' + symbol));
+  } else {
+    words_.insert(word_);
+    word_.clear();
+  }
+}
+
+int LanguageModelBuilder::Write(const std::string &file_name) {
+  if (!word_.empty()) {
+    words_.insert(word_);
+    word_.clear();
+  }
+
+  // add-one smoothing; contexts never seen stay neutral
+  std::vector<float> table(counts_.size());
+  for (size_t context = 0; context < counts_.size();
+       context += kModelAlphabetSize) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < kModelAlphabetSize; ++i) {
+      total += counts_[context + i];
+    }
+    if (total == 0) {
+      continue;
+    }
+    for (size_t i = 0; i < kModelAlphabetSize; ++i) {
+      double probability = (counts_[context + i] + 1.0) /
+                           (total + static_cast<double>(kModelAlphabetSize));
+      table[context + i] = log(probability * kModelAlphabetSize);
+    }
+  }
+
+  LanguageHeader header{};
+  memcpy(header.magic, kLanguageFileMagic, sizeof(header.magic));
+  header.version = kLanguageFileVersion;
+  header.order = order_;
+  header.num_words = words_.size();
+  header.words_offset = kLanguageHeaderSize + sizeof(float) * table.size();
+
+  std::vector<uint8_t> buffer{};
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&header);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(header));
+  bytes = reinterpret_cast<const uint8_t *>(table.data());
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(float) * table.size());
+  uint32_t offset = header.words_offset + sizeof(uint32_t) * words_.size();
+  for (const auto &word : words_) {
+    bytes = reinterpret_cast<const uint8_t *>(&offset);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(offset));
+    offset += word.size() + 1;
+  }
+  for (const auto &word : words_) {
+    buffer.insert(buffer.end(), word.begin(), word.end());
+    buffer.push_back('\0');
+  }
+  // the strings end within the file even without words
+  buffer.push_back('\0');
+
+  int fd = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return -1;
+  }
+  size_t written = 0;
+  while (written < buffer.size()) {
+    ssize_t result =
+        write(fd, buffer.data() + written, buffer.size() - written);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      int saved_errno = errno;
+      close(fd);
+      errno = saved_errno;
+      return -1;
+    }
+    written += result;
+  }
+  return close(fd);
+}
+
+} // namespace morse
@@ -0,0 +1,139 @@
+#ifndef MORSE_LANGUAGE_MODEL_H_
+#define MORSE_LANGUAGE_MODEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace morse {
+
+/*
+ * Language model file scores the characters that a world line reads. All
+ * fields are in host byte order, the file is meant to be mapped into memory.
+ *
+ *   header : "MLNG" followed by 32-bit version, order of the n-grams, number
+ *            of words, and offset of the words, padded to
+ *            kLanguageHeaderSize bytes
+ *   table  : score of every character after every context of order - 1
+ *            characters as floats, kModelAlphabetSize ^ order of them
+ *   words  : 32-bit offsets of the words from the start of the file, then
+ *            the words in ascending order, each terminated by '\0'
+ *
+ * A score is the natural log of the probability of the character relative to
+ * the uniform one, so that 0 is neutral.
+ */
+static const char kLanguageFileMagic[] = {'M', 'L', 'N', 'G'};
+static const uint32_t kLanguageFileVersion = 1;
+static const size_t kLanguageHeaderSize = 32;
+
+// the decoder reads characters from ' ' to '_'
+static const size_t kModelAlphabetSize = 64;
+// the table of order 3 takes 1MB
+static const uint32_t kMaxModelOrder = 3;
+
+struct LanguageHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t order;
+  uint32_t num_words;
+  uint32_t words_offset;
+  uint32_t reserved[3];
+};
+
+/**
+ * Character n-gram table and word list mapped from a language model file.
+ */
+class LanguageModel {
+private:
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+  LanguageHeader header_{};
+  const float *table_ = nullptr;
+  const uint32_t *word_offsets_ = nullptr;
+  uint32_t context_mask_ = 0;
+
+public:
+  LanguageModel() = default;
+  virtual ~LanguageModel();
+
+  /**
+   * Maps the model file into memory. Returns -1 on failure with errno set,
+   * EINVAL if the file is not a model file.
+   */
+  int Open(const std::string &file_name);
+
+  inline uint32_t GetOrder() const { return header_.order; }
+  inline uint32_t GetNumWords() const { return header_.num_words; }
+
+  /**
+   * Returns the score of a character after the context made by PushContext.
+   */
+  inline float ScoreCharacter(uint32_t context, char c) const {
+    return table_[(context & context_mask_) * kModelAlphabetSize +
+                  ToSymbol(c)];
+  }
+
+  /**
+   * Returns the score of a complete word, positive if the word is known.
+   */
+  float ScoreWord(std::string_view word) const;
+
+  /**
+   * Appends a character to a context of the last kMaxModelOrder - 1
+   * characters.
+   */
+  static inline uint32_t PushContext(uint32_t context, char c) {
+    return (context * kModelAlphabetSize + ToSymbol(c)) %
+           (kModelAlphabetSize * kModelAlphabetSize);
+  }
+
+  /**
+   * Returns the symbol of a character; anything outside the alphabet is a
+   * space.
+   */
+  static inline uint32_t ToSymbol(char c) {
+    if (c >= 'a' && c <= 'z') {
+      c = c - 'a' + 'A';
+    }
+    return c > ' ' && c < ' ' + static_cast<int>(kModelAlphabetSize)
+               ? c - ' '
+               : 0;
+  }
+};
+
+/**
+ * Counts the n-grams and the words of texts and writes a model file.
+ */
+class LanguageModelBuilder {
+private:
+  uint32_t order_;
+  std::vector<uint32_t> counts_;
+  std::set<std::string> words_;
+  uint32_t context_ = 0;
+  std::string word_;
+
+public:
+  explicit LanguageModelBuilder(uint32_t order);
+  virtual ~LanguageModelBuilder() = default;
+
+  /**
+   * Adds a piece of text. Characters outside the alphabet separate words.
+   */
+  void AddText(std::string_view text);
+
+  /**
+   * Writes the model file. Returns -1 on failure with errno set.
+   */
+  int Write(const std::string &file_name);
+
+private:
+  void AddSymbol(uint32_t symbol);
+};
+
+} // namespace morse
+
+#endif // MORSE_LANGUAGE_MODEL_H_
@@ -0,0 +1,45 @@
+#include "latency_meter.h"
+
+#include <algorithm>
+
+namespace morse {
+
+void LatencyMeter::AddToneEnd(size_t window, uint64_t sample) {
+  size_t slot = num_edges_++ % kNumEdges;
+  edge_windows_[slot] = window;
+  edge_samples_[slot] = sample;
+}
+
+void LatencyMeter::AddEmission(size_t reader_window, uint64_t sample) {
+  // the latest tone end that the reader has seen
+  size_t num_kept = std::min(num_edges_, kNumEdges);
+  for (size_t i = 1; i <= num_kept; ++i) {
+    size_t slot = (num_edges_ - i) % kNumEdges;
+    if (edge_windows_[slot] > reader_window) {
+      continue;
+    }
+    uint64_t latency = sample - edge_samples_[slot];
+    ++histogram_[std::min<uint64_t>(latency / kBucketWidth, kNumBuckets - 1)];
+    ++count_;
+    sum_ += latency;
+    max_ = std::max(max_, latency);
+    return;
+  }
+}
+
+uint64_t LatencyMeter::GetPercentile(double percent) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  size_t target = std::max<size_t>(1, count_ * percent / 100);
+  size_t sum = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    sum += histogram_[i];
+    if (sum >= target) {
+      return std::min(max_, (i + 1) * kBucketWidth);
+    }
+  }
+  return max_;
+}
+
+} // namespace morse
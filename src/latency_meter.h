@@ -0,0 +1,58 @@
+#ifndef MORSE_LATENCY_METER_H_
+#define MORSE_LATENCY_METER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace morse {
+
+/**
+ * Measures the latency from the end of a tone to the emission of the
+ * character that it completes. Tone ends are recorded with the window in
+ * which the detector saw them. A character is attributed to the last tone
+ * end that the reader has seen, since the reader completes a character only
+ * in the gap after its last element.
+ */
+class LatencyMeter {
+private:
+  static constexpr size_t kNumEdges = 8;
+  size_t edge_windows_[kNumEdges] = {};
+  uint64_t edge_samples_[kNumEdges] = {};
+  size_t num_edges_ = 0;
+
+  // histogram in kBucketWidth samples, the last bucket holds the rest
+  static constexpr size_t kNumBuckets = 1024;
+  static constexpr uint64_t kBucketWidth = 64;
+  uint32_t histogram_[kNumBuckets] = {};
+  size_t count_ = 0;
+  uint64_t sum_ = 0;
+  uint64_t max_ = 0;
+
+public:
+  /**
+   * Records the end of a tone detected in the window.
+   */
+  void AddToneEnd(size_t window, uint64_t sample);
+
+  /**
+   * Records the emission of a character at the sample when the reader has
+   * seen the windows up to reader_window.
+   */
+  void AddEmission(size_t reader_window, uint64_t sample);
+
+  inline size_t GetCount() const { return count_; }
+  inline uint64_t GetMax() const { return max_; }
+  inline double GetMean() const {
+    return count_ > 0 ? static_cast<double>(sum_) / count_ : 0.0;
+  }
+
+  /**
+   * Returns the latency in samples below which the percentage of the
+   * emissions are, in the resolution of the histogram.
+   */
+  uint64_t GetPercentile(double percent) const;
+};
+
+} // namespace morse
+
+#endif // MORSE_LATENCY_METER_H_
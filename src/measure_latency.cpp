@@ -0,0 +1,191 @@
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <sndfile.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "decoder.h"
+
+/**
+ * Decodes files through the embedding interface with a given detection delay
+ * and reports how long after the end of a tone its character is shown, and
+ * how many characters are corrected afterwards.
+ */
+
+namespace {
+
+// samples pushed at once, not aligned to the hop of the decoder
+const size_t kChunkSize = 100;
+
+class LatencyListener : public morse::EventListener {
+private:
+  bool print_events_;
+
+public:
+  std::string text_{};
+  size_t num_retracted_ = 0;
+
+  explicit LatencyListener(bool print_events) : print_events_(print_events) {}
+
+  void OnEvents(const morse::Event events[], size_t num_events) override {
+    static const char *const kTypeNames[] = {"CHARACTERS", "PROVISIONAL",
+                                             "RETRACT", "FLUSH"};
+    for (size_t i = 0; i < num_events; ++i) {
+      const morse::Event &event = events[i];
+      if (print_events_) {
+        printf("%10ld %-11s \"%.*s\"\n", event.timestamp,
+               kTypeNames[static_cast<int>(event.type)],
+               static_cast<int>(event.text.size()), event.text.data());
+      }
+      switch (event.type) {
+      case morse::EventType::CHARACTERS:
+      case morse::EventType::FLUSH:
+        text_.append(event.text);
+        break;
+      case morse::EventType::RETRACT:
+        num_retracted_ += event.text.size();
+        text_.resize(text_.size() - event.text.size());
+        break;
+      case morse::EventType::PROVISIONAL:
+        break;
+      }
+    }
+  }
+};
+
+int Measure(const char *file_name, size_t center_freq,
+            const morse::AnalysisSettings *settings,
+            const morse::DetectorParameters &parameters, bool provisional,
+            bool print_events) {
+  SF_INFO sf_info;
+  memset(&sf_info, 0, sizeof(sf_info));
+  SNDFILE *sndfile = sf_open(file_name, SFM_READ, &sf_info);
+  if (sndfile == nullptr) {
+    fprintf(stderr, "File error: %s: %s\n", file_name, sf_strerror(nullptr));
+    return -1;
+  }
+
+  // the tone in Hz sizes the analysis for the sample rate
+  morse::AnalysisPlan plan;
+  if (settings != nullptr &&
+      morse::PlanAnalysis(*settings, sf_info.samplerate, &plan) < 0) {
+    fprintf(stderr, "%s: %s\n", file_name, strerror(errno));
+    sf_close(sndfile);
+    return -1;
+  }
+  LatencyListener listener(print_events);
+  morse::Decoder *decoder =
+      settings != nullptr
+          ? new morse::Decoder(sf_info.samplerate, plan, &listener)
+          : new morse::Decoder(sf_info.samplerate, center_freq, &listener);
+  decoder->GetDetector()->SetParameters(
+      settings != nullptr ? plan.Scale(parameters) : parameters);
+  decoder->EnableProvisionalOutput(provisional);
+
+  // the first channel is decoded
+  std::vector<short> frames(kChunkSize * sf_info.channels);
+  std::vector<short> samples(kChunkSize);
+  sf_count_t num_frames;
+  while ((num_frames = sf_readf_short(sndfile, frames.data(), kChunkSize)) >
+         0) {
+    for (sf_count_t i = 0; i < num_frames; ++i) {
+      samples[i] = frames[i * sf_info.channels];
+    }
+    decoder->PushSamples(samples.data(), num_frames);
+  }
+  decoder->Flush();
+  sf_close(sndfile);
+
+  const morse::LatencyMeter &latency = decoder->GetLatency();
+  double ms_per_sample = 1000.0 / sf_info.samplerate;
+  printf("%s: delay %ld windows, %ld corrections, %ld characters retracted\n",
+         file_name, decoder->GetDetector()->GetDetectionDelay(),
+         decoder->GetDetector()->GetNumCorrections(), listener.num_retracted_);
+  printf("  text: %s\n", listener.text_.c_str());
+  printf("  latency of %ld characters: mean %.0f p50 %.0f p90 %.0f max %.0f "
+         "ms\n",
+         latency.GetCount(), latency.GetMean() * ms_per_sample,
+         latency.GetPercentile(50) * ms_per_sample,
+         latency.GetPercentile(90) * ms_per_sample,
+         latency.GetMax() * ms_per_sample);
+  delete decoder;
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t center_freq = 11;
+  morse::DetectorParameters parameters{};
+  morse::AnalysisSettings settings{};
+  bool tone_given = false;
+  bool provisional = false;
+  bool print_events = false;
+  while (true) {
+    int c = getopt(argc, argv, "f:t:w:D:Pp");
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'f':
+      center_freq = strtoul(optarg, nullptr, 10);
+      break;
+    case 't':
+      tone_given = true;
+      settings.tone_frequency = strtod(optarg, nullptr);
+      break;
+    case 'w':
+      settings.max_wpm = strtod(optarg, nullptr);
+      break;
+    case 'D':
+      parameters.detection_delay = strtoul(optarg, nullptr, 10);
+      break;
+    case 'P':
+      provisional = true;
+      break;
+    case 'p':
+      print_events = true;
+      break;
+    }
+  }
+
+  if (optind >= argc) {
+    fprintf(stderr, "Usage: %s [options] <wav_file>[:<center_freq>] ...\n",
+            basename(argv[0]));
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -f <center_freq> : Frequency bin of the tone unless "
+                    "given with the file (default 11)\n");
+    fprintf(stderr, "  -t <Hz> : Tone frequency; sizes the analysis for the "
+                    "sample rate instead of -f\n");
+    fprintf(stderr, "  -w <wpm> : Fastest expected speed with -t (default "
+                    "%.0f)\n",
+            settings.max_wpm);
+    fprintf(stderr, "  -D <windows> : Detection delay (default %ld)\n",
+            parameters.detection_delay);
+    fprintf(stderr, "  -P : Measure the provisional characters\n");
+    fprintf(stderr, "  -p : Print the events\n");
+    return 1;
+  }
+
+  int result = 0;
+  for (int i = optind; i < argc; ++i) {
+    std::string file_name = argv[i];
+    size_t file_center_freq = center_freq;
+    size_t colon = file_name.rfind(':');
+    if (colon != std::string::npos) {
+      file_center_freq = strtoul(file_name.c_str() + colon + 1, nullptr, 10);
+      file_name.resize(colon);
+    }
+    if (Measure(file_name.c_str(), file_center_freq,
+                tone_given ? &settings : nullptr, parameters, provisional,
+                print_events) < 0) {
+      result = 1;
+    }
+  }
+  return result;
+}
@@ -1,26 +1,32 @@
 #ifndef MORSE_MONITOR_H_
 #define MORSE_MONITOR_H_
 
-#include <ncurses.h>
+#include <stddef.h>
 
 #include "morse_reader.h"
 
 namespace morse {
 
+/**
+ * Watches the decoding, e.g. to show it on a terminal. The decoder itself
+ * does not depend on how it is shown.
+ */
 class Monitor {
-private:
-  int irow_ = 0;
-  int icol_ = 1;
-  int width_;
-  int height_;
-  WINDOW *dump_window_;
-
 public:
-  Monitor();
-  ~Monitor();
+  virtual ~Monitor() = default;
+
+  virtual void AddSignal(char signal) = 0;
+
+  /**
+   * Shows the center frequency and the levels of groups of spectrum bins.
+   * Levels are in [0, kMaxSpectrumLevel].
+   */
+  virtual void ShowSpectrum(const char *center, const int levels[],
+                            size_t num_levels) = 0;
+
+  virtual void Dump(MorseReader *reader) = 0;
 
-  void AddSignal(char signal);
-  void Dump(MorseReader *reader);
+  static constexpr int kMaxSpectrumLevel = 50;
 };
 
 } // namespace morse
@@ -0,0 +1,219 @@
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <sndfile.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stream_protocol.h"
+
+/**
+ * Sends a file to morse_daemon as a stream, as many times concurrently as
+ * asked, and prints what the daemon decodes for each copy. Retractions are
+ * applied to the printed text.
+ */
+
+namespace {
+
+// samples sent at once
+const size_t kChunkSize = 4096;
+
+struct Options {
+  const char *socket_path = nullptr;
+  float tone_frequency = 950.0f;
+  float max_wpm = 40.0f;
+  bool real_time = false;
+};
+
+int Connect(const char *socket_path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&address),
+              sizeof(address)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int WriteAll(int fd, const void *data, size_t size) {
+  const char *p = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    p += n;
+    size -= n;
+  }
+  return 0;
+}
+
+/**
+ * Streams the samples and collects the reply in text.
+ */
+int RunStream(const Options &options, uint32_t sample_rate,
+              const std::vector<short> &samples, std::string *text) {
+  int fd = Connect(options.socket_path);
+  if (fd < 0) {
+    *text = std::string("connect failed: ") + strerror(errno);
+    return -1;
+  }
+
+  // the reply is read while sending, the daemon may pause a stream whose
+  // characters are not read
+  std::string reply;
+  std::thread reader([fd, &reply]() {
+    char buffer[1024];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) != 0) {
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        break;
+      }
+      reply.append(buffer, n);
+    }
+  });
+
+  morse::StreamHeader header;
+  memcpy(header.magic, morse::kStreamMagic, sizeof(header.magic));
+  header.sample_rate = sample_rate;
+  header.tone_frequency = options.tone_frequency;
+  header.max_wpm = options.max_wpm;
+  int result = WriteAll(fd, &header, sizeof(header));
+  for (size_t i = 0; result == 0 && i < samples.size(); i += kChunkSize) {
+    size_t n = std::min(kChunkSize, samples.size() - i);
+    result = WriteAll(fd, samples.data() + i, n * sizeof(short));
+    if (options.real_time) {
+      struct timespec duration;
+      double seconds = static_cast<double>(n) / sample_rate;
+      duration.tv_sec = static_cast<time_t>(seconds);
+      duration.tv_nsec = static_cast<long>((seconds - duration.tv_sec) * 1e9);
+      nanosleep(&duration, nullptr);
+    }
+  }
+  shutdown(fd, SHUT_WR);
+  reader.join();
+  close(fd);
+
+  text->clear();
+  for (char c : reply) {
+    if (c == '\b') {
+      if (!text->empty()) {
+        text->pop_back();
+      }
+    } else {
+      text->push_back(c);
+    }
+  }
+  // a stream cut short by the daemon has no final newline
+  return result == 0 && !text->empty() && text->back() == '\n' &&
+                 text->compare(0, strlen(morse::kRejectPrefix),
+                               morse::kRejectPrefix) != 0
+             ? 0
+             : -1;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options{};
+  size_t num_copies = 1;
+  while (true) {
+    int c = getopt(argc, argv, "s:t:w:c:r");
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 's':
+      options.socket_path = optarg;
+      break;
+    case 't':
+      options.tone_frequency = atof(optarg);
+      break;
+    case 'w':
+      options.max_wpm = atof(optarg);
+      break;
+    case 'c':
+      num_copies = std::max(1l, atol(optarg));
+      break;
+    case 'r':
+      options.real_time = true;
+      break;
+    }
+  }
+
+  if (options.socket_path == nullptr || optind + 1 != argc) {
+    fprintf(stderr, "Usage: %s -s <socket_path> [options] <file>\n",
+            basename(argv[0]));
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -t <frequency> : Tone frequency in Hz (default %.0f)\n",
+            options.tone_frequency);
+    fprintf(stderr, "  -w <wpm> : Fastest expected speed in WPM (default "
+                    "%.0f)\n",
+            options.max_wpm);
+    fprintf(stderr, "  -c <copies> : Streams of the file sent concurrently\n");
+    fprintf(stderr, "  -r : Send the samples in real time\n");
+    return 1;
+  }
+
+  const char *file_name = argv[optind];
+  SF_INFO sf_info;
+  memset(&sf_info, 0, sizeof(sf_info));
+  SNDFILE *file = sf_open(file_name, SFM_READ, &sf_info);
+  if (file == nullptr) {
+    fprintf(stderr, "Can't open file: %s\n", file_name);
+    return 1;
+  }
+  if (sf_info.channels != 1) {
+    fprintf(stderr, "Not a monaural file: %s\n", file_name);
+    sf_close(file);
+    return 1;
+  }
+  std::vector<short> samples(sf_info.frames);
+  samples.resize(sf_read_short(file, samples.data(), sf_info.frames));
+  sf_close(file);
+
+  std::vector<std::string> texts(num_copies);
+  std::vector<int> results(num_copies);
+  std::vector<std::thread> threads{};
+  for (size_t i = 0; i < num_copies; ++i) {
+    threads.emplace_back([&, i]() {
+      results[i] = RunStream(options, sf_info.samplerate, samples, &texts[i]);
+    });
+  }
+  int num_failed = 0;
+  for (size_t i = 0; i < num_copies; ++i) {
+    threads[i].join();
+    printf("%ld: %s", i, texts[i].c_str());
+    if (texts[i].empty() || texts[i].back() != '\n') {
+      putchar('\n');
+    }
+    num_failed += results[i] < 0 ? 1 : 0;
+  }
+  if (num_failed > 0) {
+    fprintf(stderr, "%d of %ld streams failed\n", num_failed, num_copies);
+  }
+  return num_failed > 0 ? 1 : 0;
+}
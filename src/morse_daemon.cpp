@@ -0,0 +1,480 @@
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "analysis_plan.h"
+#include "decoder.h"
+#include "stream_protocol.h"
+
+/**
+ * Decodes many PCM streams in one process. Streams connect to a Unix-domain
+ * socket and are spread over a fixed pool of workers, each of which
+ * multiplexes its streams with epoll. Every stream has its own decoder.
+ *
+ * Quotas: a stream may not send samples faster than max_speed times real
+ * time, it is paused until it is back within the budget; and a stream that
+ * does not read its characters is closed when they pile up.
+ *
+ * Load shedding: a new stream goes to the worker with the fewest streams
+ * among those below their share of max_streams and below max_load, the
+ * fraction of time spent decoding. Without such a worker the stream is
+ * rejected, so that the streams already running keep up.
+ */
+
+namespace {
+
+// bytes read from a stream at a time
+const size_t kReadSize = 16384;
+// characters that a stream may leave unread
+const size_t kMaxPendingOutput = 65536;
+// streams within the speed budget may run ahead by this much of real time
+const double kBurstSeconds = 2.0;
+// workers measure their load over this period
+const double kLoadPeriod = 1.0;
+// paused streams are checked this often
+const int kPollTimeoutMs = 10;
+const int kMaxEvents = 64;
+// bounds on what a stream header may ask for
+const uint32_t kMinSampleRate = 1000;
+const uint32_t kMaxSampleRate = 192000;
+const float kMinToneFrequency = 100.0f;
+const float kMaxWpm = 100.0f;
+
+struct Limits {
+  size_t max_streams = 256;
+  double max_speed = 4.0;
+  double max_load = 0.9;
+};
+
+double Now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+class Stream : public morse::EventListener {
+private:
+  int fd_;
+  std::vector<uint8_t> input_{};
+  morse::Decoder *decoder_ = nullptr;
+  std::string output_{};
+
+  // samples the stream may send before it is paused
+  double budget_ = 0.0;
+  double budget_time_ = 0.0;
+  double max_speed_;
+
+public:
+  bool paused_ = false;
+  bool ended_ = false;
+  // false while the stream is out of its worker's epoll set
+  bool polled_ = true;
+
+  Stream(int fd, double max_speed) : fd_(fd), max_speed_(max_speed) {}
+
+  ~Stream() override {
+    delete decoder_;
+    close(fd_);
+  }
+
+  inline int GetFd() const { return fd_; }
+  inline bool HasOutput() const { return !output_.empty(); }
+
+  void OnEvents(const morse::Event events[], size_t num_events) override {
+    for (size_t i = 0; i < num_events; ++i) {
+      switch (events[i].type) {
+      case morse::EventType::CHARACTERS:
+        output_.append(events[i].text);
+        break;
+      case morse::EventType::RETRACT:
+        output_.append(events[i].text.size(), '\b');
+        break;
+      case morse::EventType::FLUSH:
+        output_.append(events[i].text);
+        output_.push_back('\n');
+        break;
+      case morse::EventType::PROVISIONAL:
+        break;
+      }
+    }
+  }
+
+  /**
+   * Reads what the stream has sent within its budget and decodes it. Returns
+   * -1 when the stream is to be closed.
+   */
+  int Read() {
+    if (ended_) {
+      return 0;
+    }
+    size_t size = kReadSize;
+    if (decoder_ != nullptr) {
+      Refill();
+      size = std::min(size, static_cast<size_t>(budget_) * sizeof(short));
+      if (size < sizeof(short)) {
+        paused_ = true;
+        return 0;
+      }
+    }
+    size_t offset = input_.size();
+    input_.resize(offset + size);
+    ssize_t n = read(fd_, input_.data() + offset, size);
+    if (n < 0) {
+      input_.resize(offset);
+      return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    }
+    input_.resize(offset + n);
+    if (n == 0) {
+      // the client ends the stream
+      if (decoder_ == nullptr) {
+        return -1;
+      }
+      decoder_->Flush();
+      ended_ = true;
+      return 0;
+    }
+
+    size_t consumed = 0;
+    if (decoder_ == nullptr) {
+      if (input_.size() < sizeof(morse::StreamHeader)) {
+        return 0;
+      }
+      if (Start() < 0) {
+        return -1;
+      }
+      consumed = sizeof(morse::StreamHeader);
+    }
+    size_t num_samples = (input_.size() - consumed) / sizeof(short);
+    if (num_samples > 0) {
+      std::vector<short> samples(num_samples);
+      memcpy(samples.data(), input_.data() + consumed,
+             num_samples * sizeof(short));
+      decoder_->PushSamples(samples.data(), num_samples);
+      consumed += num_samples * sizeof(short);
+      budget_ -= num_samples;
+    }
+    input_.erase(input_.begin(), input_.begin() + consumed);
+    return output_.size() > kMaxPendingOutput ? -1 : 0;
+  }
+
+  /**
+   * Sends the pending characters. Returns -1 when the stream is to be
+   * closed.
+   */
+  int Write() {
+    while (!output_.empty()) {
+      ssize_t n = send(fd_, output_.data(), output_.size(), MSG_NOSIGNAL);
+      if (n < 0) {
+        return errno == EAGAIN || errno == EINTR ? 0 : -1;
+      }
+      output_.erase(0, n);
+    }
+    return 0;
+  }
+
+  /**
+   * Returns true when the stream may be read again after a pause.
+   */
+  bool Resume() {
+    Refill();
+    paused_ = budget_ < 1.0;
+    return !paused_;
+  }
+
+  void Reject(const char *reason) {
+    output_ = std::string(morse::kRejectPrefix) + reason + "\n";
+    Write();
+  }
+
+private:
+  int Start() {
+    morse::StreamHeader header;
+    memcpy(&header, input_.data(), sizeof(header));
+    if (memcmp(header.magic, morse::kStreamMagic, sizeof(header.magic)) != 0) {
+      Reject("bad header");
+      return -1;
+    }
+    if (header.sample_rate < kMinSampleRate ||
+        header.sample_rate > kMaxSampleRate ||
+        !std::isfinite(header.tone_frequency) ||
+        header.tone_frequency < kMinToneFrequency ||
+        header.tone_frequency >= header.sample_rate / 2.0f ||
+        !std::isfinite(header.max_wpm) || header.max_wpm <= 0 ||
+        header.max_wpm > kMaxWpm) {
+      Reject("unsupported tone or sample rate");
+      return -1;
+    }
+    morse::AnalysisSettings settings{};
+    settings.tone_frequency = header.tone_frequency;
+    settings.max_wpm = header.max_wpm;
+    morse::AnalysisPlan plan;
+    if (morse::PlanAnalysis(settings, header.sample_rate, &plan) < 0) {
+      Reject("unsupported tone or sample rate");
+      return -1;
+    }
+    decoder_ = new morse::Decoder(header.sample_rate, plan, this);
+    budget_ = header.sample_rate * max_speed_ * kBurstSeconds;
+    budget_time_ = Now();
+    return 0;
+  }
+
+  void Refill() {
+    double now = Now();
+    double sample_rate = decoder_->GetSampleRate();
+    budget_ = std::min(budget_ + (now - budget_time_) * sample_rate * max_speed_,
+                       sample_rate * max_speed_ * kBurstSeconds);
+    budget_time_ = now;
+  }
+};
+
+class Worker {
+private:
+  int epoll_fd_;
+  std::thread thread_{};
+  std::vector<Stream *> paused_{};
+
+  double load_start_ = 0.0;
+  double busy_ = 0.0;
+
+public:
+  std::atomic<size_t> num_streams_{0};
+  std::atomic<double> load_{0.0};
+
+  Worker() { epoll_fd_ = epoll_create1(EPOLL_CLOEXEC); }
+
+  inline bool IsReady() const { return epoll_fd_ >= 0; }
+
+  void Start() { thread_ = std::thread(&Worker::Run, this); }
+
+  /**
+   * Takes a stream; called from the accepting thread.
+   */
+  int Add(Stream *stream) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = stream;
+    ++num_streams_;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, stream->GetFd(), &event) < 0) {
+      --num_streams_;
+      return -1;
+    }
+    return 0;
+  }
+
+private:
+  void Run() {
+    struct epoll_event events[kMaxEvents];
+    load_start_ = Now();
+    while (true) {
+      int n = epoll_wait(epoll_fd_, events, kMaxEvents,
+                         paused_.empty() ? 1000 : kPollTimeoutMs);
+      double start = Now();
+      for (int i = 0; i < n; ++i) {
+        auto *stream = static_cast<Stream *>(events[i].data.ptr);
+        int result = 0;
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+          result = stream->Read();
+        }
+        if (result == 0) {
+          result = stream->Write();
+        }
+        Update(stream, result);
+      }
+      for (size_t i = 0; i < paused_.size();) {
+        Stream *stream = paused_[i];
+        if (stream->Resume()) {
+          paused_[i] = paused_.back();
+          paused_.pop_back();
+          Update(stream, 0);
+        } else {
+          ++i;
+        }
+      }
+
+      double end = Now();
+      busy_ += end - start;
+      if (end - load_start_ >= kLoadPeriod) {
+        load_ = busy_ / (end - load_start_);
+        busy_ = 0.0;
+        load_start_ = end;
+      }
+    }
+  }
+
+  /**
+   * Sets what the stream waits for, or closes it.
+   */
+  void Update(Stream *stream, int result) {
+    bool paused = stream->paused_;
+    if (result < 0 || (stream->ended_ && !stream->HasOutput())) {
+      if (stream->polled_) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, stream->GetFd(), nullptr);
+      }
+      if (paused) {
+        for (auto &p : paused_) {
+          if (p == stream) {
+            p = paused_.back();
+            paused_.pop_back();
+            break;
+          }
+        }
+      }
+      delete stream;
+      --num_streams_;
+      return;
+    }
+    struct epoll_event event;
+    event.events = (paused || stream->ended_ ? 0 : EPOLLIN) |
+                   (stream->HasOutput() ? EPOLLOUT : 0);
+    event.data.ptr = stream;
+    if (event.events == 0) {
+      // epoll reports a hang-up even without events, and a paused stream
+      // would not read it; it is polled again when it resumes
+      if (stream->polled_) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, stream->GetFd(), nullptr);
+        stream->polled_ = false;
+      }
+    } else {
+      epoll_ctl(epoll_fd_, stream->polled_ ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                stream->GetFd(), &event);
+      stream->polled_ = true;
+    }
+    if (paused && !stream->ended_ &&
+        std::find(paused_.begin(), paused_.end(), stream) == paused_.end()) {
+      paused_.push_back(stream);
+    }
+  }
+};
+
+/**
+ * Picks the worker for a new stream, or nullptr to shed it.
+ */
+Worker *PickWorker(const std::vector<Worker *> &workers, const Limits &limits) {
+  size_t share = (limits.max_streams + workers.size() - 1) / workers.size();
+  Worker *best = nullptr;
+  for (auto *worker : workers) {
+    if (worker->num_streams_ >= share || worker->load_ >= limits.max_load) {
+      continue;
+    }
+    if (best == nullptr || worker->num_streams_ < best->num_streams_) {
+      best = worker;
+    }
+  }
+  return best;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const char *socket_path = nullptr;
+  size_t num_workers = std::max(1u, std::thread::hardware_concurrency());
+  Limits limits{};
+  while (true) {
+    int c = getopt(argc, argv, "s:w:n:x:l:");
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 's':
+      socket_path = optarg;
+      break;
+    case 'w':
+      num_workers = std::max(1l, atol(optarg));
+      break;
+    case 'n':
+      limits.max_streams = atol(optarg);
+      break;
+    case 'x':
+      limits.max_speed = atof(optarg);
+      break;
+    case 'l':
+      limits.max_load = atof(optarg);
+      break;
+    }
+  }
+
+  if (socket_path == nullptr) {
+    fprintf(stderr, "Usage: %s -s <socket_path> [options]\n",
+            basename(argv[0]));
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -w <workers> : Decoding threads (default: number of "
+                    "CPUs)\n");
+    fprintf(stderr, "  -n <streams> : Streams at most (default %ld)\n",
+            limits.max_streams);
+    fprintf(stderr, "  -x <speed> : Samples a stream may send per second in "
+                    "multiples of its sample rate (default %.1f)\n",
+            limits.max_speed);
+    fprintf(stderr, "  -l <load> : Busy fraction of a worker above which it "
+                    "takes no new streams (default %.2f)\n",
+            limits.max_load);
+    return 1;
+  }
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "socket path is too long: %s\n", socket_path);
+    return 1;
+  }
+  strcpy(address.sun_path, socket_path);
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  unlink(socket_path);
+  if (listen_fd < 0 ||
+      bind(listen_fd, reinterpret_cast<struct sockaddr *>(&address),
+           sizeof(address)) < 0 ||
+      listen(listen_fd, SOMAXCONN) < 0) {
+    fprintf(stderr, "Socket error: %s: %s\n", socket_path, strerror(errno));
+    return 1;
+  }
+
+  std::vector<Worker *> workers{};
+  for (size_t i = 0; i < num_workers; ++i) {
+    auto *worker = new Worker();
+    if (!worker->IsReady()) {
+      fprintf(stderr, "epoll_create1 failed: %s\n", strerror(errno));
+      return 1;
+    }
+    worker->Start();
+    workers.push_back(worker);
+  }
+
+  while (true) {
+    int fd = accept4(listen_fd, nullptr, nullptr,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      fprintf(stderr, "accept failed: %s\n", strerror(errno));
+      break;
+    }
+    auto *stream = new Stream(fd, limits.max_speed);
+    Worker *worker = PickWorker(workers, limits);
+    if (worker == nullptr) {
+      stream->Reject("busy");
+      delete stream;
+    } else if (worker->Add(stream) < 0) {
+      delete stream;
+    }
+  }
+  close(listen_fd);
+  unlink(socket_path);
+  return 1;
+}
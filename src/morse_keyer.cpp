@@ -0,0 +1,50 @@
+#include "morse_keyer.h"
+
+#include <time.h>
+
+namespace morse {
+
+const char kKeyerText[] =
+    "CQ CQ DE JA1ABC JA1ABC K  JA1ABC DE W1XYZ GM UR 599 5NN TNX FER CALL "
+    "NAME JOHN QTH BOSTON HW?  W1XYZ DE JA1ABC R R FB JOHN RST 579 ES "
+    "73 SK  ";
+
+const char *MorseCode(char c) {
+  static const char *const kLetters[] = {
+      ".-",   "-...", "-.-.", "-..",  ".",   "..-.", "--.",  "....", "..",
+      ".---", "-.-",  ".-..", "--",   "-.",  "---",  ".--.", "--.-", ".-.",
+      "...",  "-",    "..-",  "...-", ".--", "-..-", "-.--", "--.."};
+  static const char *const kDigits[] = {"-----", ".----", "..---", "...--",
+                                        "....-", ".....", "-....", "--...",
+                                        "---..", "----."};
+  if (c >= 'A' && c <= 'Z') {
+    return kLetters[c - 'A'];
+  }
+  if (c >= '0' && c <= '9') {
+    return kDigits[c - '0'];
+  }
+  return c == '?' ? "..--.." : nullptr;
+}
+
+void KeyText(const char *text, const KeyElement &key) {
+  for (const char *p = text; *p != '\0'; ++p) {
+    const char *code = MorseCode(*p);
+    if (code == nullptr) {
+      // the character break is already there
+      key(false, 4);
+      continue;
+    }
+    for (const char *element = code; *element != '\0'; ++element) {
+      key(true, *element == '.' ? 1 : 3);
+      key(false, element[1] != '\0' ? 1 : 3);
+    }
+  }
+}
+
+double MonotonicTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1.e-9;
+}
+
+} // namespace morse
@@ -0,0 +1,41 @@
+#ifndef MORSE_MORSE_KEYER_H_
+#define MORSE_MORSE_KEYER_H_
+
+#include <functional>
+
+namespace morse {
+
+/*
+ * Synthetic code shared by the test tools, which key it into patterns or
+ * audio of their own timing.
+ */
+
+// a QSO of calls, reports, and numbers that the tools send over and over
+extern const char kKeyerText[];
+
+/**
+ * Takes a mark or a gap of the nominal length in dots.
+ */
+using KeyElement = std::function<void(bool mark, int dots)>;
+
+/**
+ * Returns the elements of a letter, a digit, or '?', or nullptr for the other
+ * characters.
+ */
+const char *MorseCode(char c);
+
+/**
+ * Keys the text element by element: a gap of a dot follows an element, 3 the
+ * last one of a character, and a character without a code adds 4 to make a
+ * word space of 7.
+ */
+void KeyText(const char *text, const KeyElement &key);
+
+/**
+ * Returns the seconds of the monotonic clock.
+ */
+double MonotonicTime();
+
+} // namespace morse
+
+#endif // MORSE_MORSE_KEYER_H_
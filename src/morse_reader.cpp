@@ -1,8 +1,8 @@
 #include "morse_reader.h"
 
 #include <algorithm>
-#include <curses.h>
 #include <map>
+#include <stdint.h>
 #include <stdio.h>
 #include <vector>
 
@@ -11,21 +11,30 @@
 
 namespace morse {
 
-MorseReader::MorseReader()
+MorseReader::MorseReader(const ReaderParameters &parameters)
     : clock_(0), state_(IDLE), last_interval_(0), estimated_dit_length_(0),
-      dit_count_(0), sum_dit_length_(0) {
+      dit_count_(0), sum_dit_length_(0), parameters_(parameters) {
   observer_ = new Observer{};
   // attach the first world line
-  observer_->Append(new WorldLine{});
+  observer_->Append(new WorldLine{&parameters_});
 }
 
-MorseReader::~MorseReader() = default;
+MorseReader::~MorseReader() {
+  DeleteWorldLines();
+  delete observer_;
+}
 
 bool MorseReader::Update(uint8_t level) {
+  ApplySkippedWindows();
+  quiet_windows_ = 0;
+
   WorldLine *current = reinterpret_cast<WorldLine *>(observer_->next_);
   bool some_changed = false;
+  // forks are inserted before the forking line, so they are not visited here
+  size_t num_updated = 0;
   while (current != nullptr) {
     some_changed |= current->Update(level);
+    ++num_updated;
     current = current->Next();
   }
 
@@ -35,10 +44,13 @@ bool MorseReader::Update(uint8_t level) {
   // we start over iteration since new worldlines may have been inserted in the
   // previous loop
   current = reinterpret_cast<WorldLine *>(observer_->next_);
+  size_t num_lines = 0;
   while (current != nullptr) {
     max_confidence = std::max(max_confidence, current->GetConfidence());
+    ++num_lines;
     current = current->Next();
   }
+  num_forks_ += num_lines - num_updated;
 
   // bool do_square = num_scans_since_startup_++ > 10;
   bool do_square = false;
@@ -46,70 +58,312 @@ bool MorseReader::Update(uint8_t level) {
   // iterate again to drop world lines that are not confident enough
   current = reinterpret_cast<WorldLine *>(observer_->next_);
   std::vector<WorldLine *> to_delete;
+  num_world_lines_ = 0;
   while (current != nullptr) {
-    if (max_confidence / current->GetConfidence() >= 8.0) {
+    if (max_confidence / current->GetConfidence() >= parameters_.prune_ratio) {
       to_delete.push_back(current);
       current->Remove();
+    } else {
+      ++num_world_lines_;
     }
     current->NormalizeConfidence(max_confidence, do_square);
     current = current->Next();
   }
 
+  if (parameters_.max_world_lines > 0 &&
+      num_world_lines_ > parameters_.max_world_lines) {
+    CapWorldLines(&to_delete);
+  }
+
+  peak_num_world_lines_ = std::max(peak_num_world_lines_, num_world_lines_);
+
   // delete dropped lines
   for (auto *world_line : to_delete) {
     delete world_line;
   }
+
+  if (some_changed || !to_delete.empty() || observer_->has_results_) {
+    observer_->has_results_ = false;
+    Collect();
+  }
   return some_changed;
 }
 
-double MorseReader::GetEstimatedDotLength() {
-  WorldLine *first = reinterpret_cast<WorldLine *>(observer_->next_);
-  return first != nullptr ? first->GetDotLength() : 0.0;
+bool MorseReader::UpdateSilence(size_t num_windows) {
+  bool some_changed = false;
+  while (num_windows > 0) {
+    if (quiet_windows_ > 0) {
+      // the confidences are normalized by the last Update, so that one
+      // without changes has no effect either
+      size_t n = std::min(num_windows, quiet_windows_);
+      quiet_windows_ -= n;
+      skipped_windows_ += n;
+      num_windows -= n;
+      continue;
+    }
+    some_changed |= Update(0);
+    --num_windows;
+
+    quiet_windows_ = SIZE_MAX;
+    for (WorldLine *current = reinterpret_cast<WorldLine *>(observer_->next_);
+         current != nullptr; current = current->Next()) {
+      quiet_windows_ = std::min(quiet_windows_, current->GetQuietWindows());
+    }
+  }
+  return some_changed;
 }
 
-void MorseReader::Dump() {
+void MorseReader::CapWorldLines(std::vector<WorldLine *> *to_delete) {
+  std::vector<WorldLine *> world_lines;
+  for (WorldLine *current = reinterpret_cast<WorldLine *>(observer_->next_);
+       current != nullptr; current = current->Next()) {
+    world_lines.push_back(current);
+  }
+  auto last = world_lines.begin() + parameters_.max_world_lines;
+  std::nth_element(world_lines.begin(), last, world_lines.end(),
+                   [](const WorldLine *a, const WorldLine *b) {
+                     return a->GetConfidence() > b->GetConfidence();
+                   });
+  for (auto it = last; it != world_lines.end(); ++it) {
+    (*it)->Remove();
+    to_delete->push_back(*it);
+  }
+  num_world_lines_ = parameters_.max_world_lines;
+}
+
+void MorseReader::ApplySkippedWindows() {
+  if (skipped_windows_ == 0) {
+    return;
+  }
+  for (WorldLine *current = reinterpret_cast<WorldLine *>(observer_->next_);
+       current != nullptr; current = current->Next()) {
+    current->SkipQuietWindows(skipped_windows_);
+  }
+  skipped_windows_ = 0;
+}
+
+void MorseReader::Collect() {
+  WorldLine *best = GetBestWorldLine();
+  if (best == nullptr) {
+    return;
+  }
+  const std::string &best_characters = best->GetCharacters();
+  uint64_t position = num_committed_ + best_characters.size();
+
+  // characters that all the world lines agree on, but those dominated for
+  // commit_lead characters
+  size_t length = best_characters.size();
+  for (WorldLine *current = reinterpret_cast<WorldLine *>(observer_->next_);
+       current != nullptr; current = current->Next()) {
+    if (current == best) {
+      current->SetDominatedSince(WorldLine::kNotDominated);
+      continue;
+    }
+    if (current->GetConfidence() * parameters_.dominance_ratio >
+        best->GetConfidence()) {
+      current->SetDominatedSince(WorldLine::kNotDominated);
+    } else if (current->GetDominatedSince() == WorldLine::kNotDominated) {
+      current->SetDominatedSince(position);
+    }
+    uint64_t since = current->GetDominatedSince();
+    if (parameters_.commit_lead > 0 && since != WorldLine::kNotDominated &&
+        position >= since + parameters_.commit_lead) {
+      continue;
+    }
+    const std::string &characters = current->GetCharacters();
+    size_t i = 0;
+    while (i < length && i < characters.size() &&
+           characters[i] == best_characters[i]) {
+      ++i;
+    }
+    length = i;
+  }
+  if (length == 0) {
+    return;
+  }
+
+  committed_.append(best_characters, 0, length);
+  num_committed_ += length;
+
+  // the dominated world lines that disagree with the most confident one
+  // are dropped
+  std::string_view prefix = std::string_view(committed_).substr(
+      committed_.size() - length);
   WorldLine *current = reinterpret_cast<WorldLine *>(observer_->next_);
   while (current != nullptr) {
-    printf("%s: %f\n", current->GetCharacters().c_str(),
-           current->GetConfidence());
-    current = current->Next();
+    WorldLine *next = current->Next();
+    if (std::string_view(current->GetCharacters()).substr(0, length) ==
+        prefix) {
+      current->DropCharacters(length);
+    } else {
+      current->Remove();
+      delete current;
+      --num_world_lines_;
+    }
+    current = next;
   }
 }
 
-void MorseReader::Dumpw(int width, int height, WINDOW *window) {
+void MorseReader::DeleteWorldLines() {
   WorldLine *current = reinterpret_cast<WorldLine *>(observer_->next_);
-  if (current == nullptr) {
-    wprintw(window, "Nothing to dump");
+  while (current != nullptr) {
+    WorldLine *next = current->Next();
+    delete current;
+    current = next;
+  }
+  observer_->next_ = nullptr;
+}
+
+void MorseReader::CopyFrom(const MorseReader &src) {
+  DeleteWorldLines();
+
+  clock_ = src.clock_;
+  state_ = src.state_;
+  last_interval_ = src.last_interval_;
+  estimated_dit_length_ = src.estimated_dit_length_;
+  dit_count_ = src.dit_count_;
+  sum_dit_length_ = src.sum_dit_length_;
+  num_world_lines_ = src.num_world_lines_;
+  peak_num_world_lines_ = src.peak_num_world_lines_;
+  num_scans_since_startup_ = src.num_scans_since_startup_;
+  quiet_windows_ = src.quiet_windows_;
+  skipped_windows_ = src.skipped_windows_;
+  committed_ = src.committed_;
+  num_committed_ = src.num_committed_;
+
+  Node *last = observer_;
+  for (WorldLine *line = reinterpret_cast<WorldLine *>(src.observer_->next_);
+       line != nullptr; line = line->Next()) {
+    auto *copy = new WorldLine(*line, &parameters_);
+    last->Append(copy);
+    last = copy;
+  }
+}
+
+void MorseReader::SaveState(StateWriter *writer) const {
+  writer->Put(clock_);
+  writer->Put(state_);
+  writer->Put(last_interval_);
+  writer->Put(estimated_dit_length_);
+  writer->Put(dit_count_);
+  writer->Put(sum_dit_length_);
+  writer->Put(peak_num_world_lines_);
+  writer->Put(num_scans_since_startup_);
+  writer->Put(quiet_windows_);
+  writer->Put(skipped_windows_);
+  writer->PutString(committed_);
+  writer->Put(num_committed_);
+  writer->Put(observer_->has_results_);
+
+  uint64_t num_world_lines = 0;
+  for (WorldLine *line = reinterpret_cast<WorldLine *>(observer_->next_);
+       line != nullptr; line = line->Next()) {
+    ++num_world_lines;
   }
+  writer->Put(num_world_lines);
+  for (WorldLine *line = reinterpret_cast<WorldLine *>(observer_->next_);
+       line != nullptr; line = line->Next()) {
+    line->SaveState(writer);
+  }
+}
+
+bool MorseReader::LoadState(StateReader *reader) {
+  DeleteWorldLines();
+
+  reader->Get(&clock_);
+  reader->Get(&state_);
+  reader->Get(&last_interval_);
+  reader->Get(&estimated_dit_length_);
+  reader->Get(&dit_count_);
+  reader->Get(&sum_dit_length_);
+  reader->Get(&peak_num_world_lines_);
+  reader->Get(&num_scans_since_startup_);
+  reader->Get(&quiet_windows_);
+  reader->Get(&skipped_windows_);
+  reader->GetString(&committed_);
+  reader->Get(&num_committed_);
+  reader->Get(&observer_->has_results_);
+
+  uint64_t num_world_lines = 0;
+  reader->Get(&num_world_lines);
+  Node *last = observer_;
+  num_world_lines_ = 0;
+  for (uint64_t i = 0; i < num_world_lines && !reader->Failed(); ++i) {
+    auto *line = new WorldLine(&parameters_);
+    last->Append(line);
+    last = line;
+    line->LoadState(reader);
+    ++num_world_lines_;
+  }
+  // a reader always has a world line
+  if (reader->Failed() || num_world_lines_ == 0) {
+    reader->Fail();
+    DeleteWorldLines();
+    observer_->Append(new WorldLine{&parameters_});
+    num_world_lines_ = 1;
+    return false;
+  }
+  return true;
+}
 
-  std::vector<WorldLine *> candidates;
+double MorseReader::GetEstimatedDotLength() {
+  WorldLine *first = reinterpret_cast<WorldLine *>(observer_->next_);
+  return first != nullptr ? first->GetDotLength() : 0.0;
+}
+
+void MorseReader::SetDotLength(double dot_length) {
+  for (WorldLine *current = reinterpret_cast<WorldLine *>(observer_->next_);
+       current != nullptr; current = current->Next()) {
+    current->SetDotLength(dot_length);
+  }
+}
+
+WorldLine *MorseReader::GetBestWorldLine() const {
+  WorldLine *best = nullptr;
+  for (WorldLine *current = reinterpret_cast<WorldLine *>(observer_->next_);
+       current != nullptr; current = current->Next()) {
+    if (best == nullptr || current->GetConfidence() > best->GetConfidence()) {
+      best = current;
+    }
+  }
+  return best;
+}
+
+const std::string &MorseReader::GetCharacters() {
+  characters_ = committed_;
+  WorldLine *best = GetBestWorldLine();
+  if (best != nullptr) {
+    characters_.append(best->GetCharacters());
+  }
+  return characters_;
+}
+
+void MorseReader::Dump() {
+  WorldLine *current = reinterpret_cast<WorldLine *>(observer_->next_);
   while (current != nullptr) {
-    candidates.push_back(current);
+    printf("%s%s: %f\n", committed_.c_str(), current->GetCharacters().c_str(),
+           current->GetConfidence());
     current = current->Next();
   }
+}
 
-  std::sort(candidates.begin(), candidates.end(), [](auto a, auto b) {
-    return a->GetConfidence() > b->GetConfidence();
-  });
-
-  if (prev_dump_size_ > candidates.size()) {
-    wclear(window);
+size_t MorseReader::GetMemoryUsage() const {
+  size_t size = sizeof(*this) + sizeof(*observer_) + committed_.capacity() +
+                characters_.capacity();
+  for (WorldLine *current = reinterpret_cast<WorldLine *>(observer_->next_);
+       current != nullptr; current = current->Next()) {
+    size += current->GetMemoryUsage();
   }
-  prev_dump_size_ = candidates.size();
+  return size;
+}
 
-  int irow = 0;
-  for (auto *world_line : candidates) {
-    // double ratio = 1.0 / world_line->GetConfidence();
-    wmove(window, irow++, 0);
-    wclrtoeol(window);
-    wprintw(window, "(%f) %f : %s", world_line->GetDotLength(),
-            world_line->GetConfidence(), world_line->GetCharacters().c_str());
-    wmove(window, irow++, 4);
-    wclrtoeol(window);
-    wprintw(window, "%s", world_line->GetSignals().c_str());
-    ++irow;
+void MorseReader::GetWorldLines(
+    std::vector<const WorldLine *> *world_lines) const {
+  world_lines->clear();
+  for (WorldLine *current = reinterpret_cast<WorldLine *>(observer_->next_);
+       current != nullptr; current = current->Next()) {
+    world_lines->push_back(current);
   }
-  refresh();
 }
 
 } // namespace morse
\ No newline at end of file
@@ -1,15 +1,19 @@
 #ifndef MORSE_READER_H_
 #define MORSE_READER_H_
 
-#include <ncurses.h>
-
 #include <cstdint>
+#include <string>
+#include <string_view>
 #include <vector>
 
+#include "checkpoint.h"
 #include "node.h"
+#include "parameters.h"
 
 namespace morse {
 
+class WorldLine;
+
 enum ReaderState {
   IDLE,
   HIGH,
@@ -21,9 +25,10 @@ class Observer : public Node {
 public:
   ~Observer() = default;
 
-  void ChildRemoved() {
-    // TODO(Naoki): Collect available results
-  }
+  // the remaining world lines may agree on more characters
+  void ChildRemoved() { has_results_ = true; }
+
+  bool has_results_ = false;
 };
 
 class MorseReader {
@@ -37,20 +42,137 @@ private:
 
   Observer *observer_;
 
+  ReaderParameters parameters_;
+  size_t num_world_lines_ = 1;
+  size_t peak_num_world_lines_ = 1;
+  // forks since the construction, not rewound by CopyFrom nor saved
+  uint64_t num_forks_ = 0;
+
   size_t num_scans_since_startup_ = 0;
 
-  size_t prev_dump_size_ = 0;
+  // windows of silence known not to change any world line, and those passed
+  // but not applied to the world lines yet
+  size_t quiet_windows_ = 0;
+  size_t skipped_windows_ = 0;
+
+  // characters removed from the world lines, kept until released
+  std::string committed_;
+  uint64_t num_committed_ = 0;
+
+  std::string characters_;
 
 public:
-  MorseReader();
+  explicit MorseReader(const ReaderParameters &parameters = ReaderParameters{});
+  MorseReader(const MorseReader &) = delete;
+  MorseReader &operator=(const MorseReader &) = delete;
   virtual ~MorseReader();
 
   bool Update(uint8_t level);
 
+  /**
+   * Changes the parameters, e.g. to shed load; the world lines follow from
+   * the next update.
+   */
+  inline void SetParameters(const ReaderParameters &parameters) {
+    parameters_ = parameters;
+  }
+  inline const ReaderParameters &GetParameters() const { return parameters_; }
+
+  /**
+   * Same as Update(0) for num_windows windows. The windows in which no world
+   * line would change are passed without visiting the world lines, so that
+   * long silence costs little.
+   */
+  bool UpdateSilence(size_t num_windows = 1);
+
+  /**
+   * Replaces the state with a copy of another reader, e.g. to take a snapshot
+   * and to rewind to it. The parameters are kept, so that a rewind does not
+   * undo SetParameters.
+   */
+  void CopyFrom(const MorseReader &src);
+
+  /**
+   * Saves and loads the state with the world lines for a checkpoint. The
+   * parameters are not saved; they are those of the loading reader.
+   * LoadState returns false if the state is broken.
+   */
+  void SaveState(StateWriter *writer) const;
+  bool LoadState(StateReader *reader);
+
   double GetEstimatedDotLength();
 
+  /**
+   * Starts the world lines with a known dot length in windows instead of
+   * learning it from the first marks.
+   */
+  void SetDotLength(double dot_length);
+
+  inline size_t GetNumWorldLines() const { return num_world_lines_; }
+  inline size_t GetPeakNumWorldLines() const { return peak_num_world_lines_; }
+
+  /**
+   * Returns the number of world lines forked since the reader was made,
+   * including those forked again after a rewind, to measure the work done.
+   */
+  inline uint64_t GetNumForks() const { return num_forks_; }
+
+  /**
+   * Returns the bytes held by the reader with its world lines and characters,
+   * to watch the memory over long runs.
+   */
+  size_t GetMemoryUsage() const;
+
+  /**
+   * Returns the committed characters that are not released yet followed by
+   * the characters read by the most confident world line.
+   */
+  const std::string &GetCharacters();
+
+  /**
+   * Returns the committed characters that are not released yet. They are
+   * removed from the world lines and never change.
+   */
+  inline std::string_view GetCommittedCharacters() const { return committed_; }
+
+  /**
+   * Returns the number of characters committed since the start, including
+   * the released ones.
+   */
+  inline uint64_t GetNumCommitted() const { return num_committed_; }
+
+  /**
+   * Forgets the committed characters once the caller has taken them, so that
+   * the memory stays bounded on an endless stream.
+   */
+  inline void ReleaseCommittedCharacters() { committed_.clear(); }
+
+  /**
+   * Lists the live world lines.
+   */
+  void GetWorldLines(std::vector<const WorldLine *> *world_lines) const;
+
   void Dump();
-  void Dumpw(int width, int height, WINDOW *window);
+
+private:
+  WorldLine *GetBestWorldLine() const;
+
+  void DeleteWorldLines();
+
+  void ApplySkippedWindows();
+
+  /**
+   * Removes the least confident world lines beyond
+   * parameters_.max_world_lines into to_delete.
+   */
+  void CapWorldLines(std::vector<WorldLine *> *to_delete);
+
+  /**
+   * Moves the characters that all the world lines agree on, or that the most
+   * confident one has kept for long enough, from the world lines to
+   * committed_.
+   */
+  void Collect();
 };
 
 } // namespace morse
@@ -1,9 +1,11 @@
 #include "morse_signal_detector.h"
 
+#include <errno.h>
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
 #include <utility>
 #include <vector>
 
@@ -13,7 +15,51 @@ static float kFreqDomainFilterCoef[] = {-0.1, -0.3, 1.0, -0.3, -0.1};
 static const size_t kFreqDomainFilterSize =
     sizeof(kFreqDomainFilterCoef) / sizeof(*kFreqDomainFilterCoef);
 
-static const float kThreshold = 2.0e12;
+// the frequency domain filter of the integer path, scaled by
+// kFixedFilterScale
+static const int64_t kFixedFilterCoef[] = {-1, -3, 10, -3, -1};
+static const int64_t kFixedFilterScale = 10;
+
+// threshold ratios of the integer path are in 1 / kFixedRatioOne
+static const int64_t kFixedRatioOne = 256;
+
+// a filtered power times a ratio exceeds 64 bits with a full scale tone in
+// the larger FFTs
+typedef __int128 fixed_product;
+
+static inline fixed_product Multiply(int64_t a, int64_t b) {
+  return static_cast<fixed_product>(a) * b;
+}
+
+// spectrum bins shown by the monitor, in groups of four
+static const size_t kDisplayFirstBin = 2;
+static const size_t kNumDisplayBins = 20;
+
+// the noise floor follows the window energy down at once, and up by this
+// factor a window
+static const double kNoiseFloorRise = 1.001;
+// lowest noise floor relative to the average window energy, so that the floor
+// does not stick at zero after digital silence; relative, since the level of
+// the input differs by recording and by the gain of the decimation
+static const double kMinNoiseRatio = 1e-5;
+// weight of a window in the average window energy
+static const double kEnergyAverageWeight = 1.0 / 1024;
+
+static double HopEnergy(const short samples[], size_t num_samples) {
+  double energy = 0.0;
+  for (size_t i = 0; i < num_samples; ++i) {
+    energy += samples[i] * samples[i];
+  }
+  return energy;
+}
+
+static double HopEnergy(const complex samples[], size_t num_samples) {
+  double energy = 0.0;
+  for (size_t i = 0; i < num_samples; ++i) {
+    energy += samples[i].Re * samples[i].Re + samples[i].Im * samples[i].Im;
+  }
+  return energy;
+}
 
 MorseSignalDetector::MorseSignalDetector(MorseReader *timing_tracker,
                                          size_t num_buffers, size_t buffer_size,
@@ -22,33 +68,132 @@ MorseSignalDetector::MorseSignalDetector(MorseReader *timing_tracker,
       morse_reader_(timing_tracker), center_frequency_(center_frequency) {
   window_ = new float[buffer_size_ * num_buffers_];
   MakeBlackmanNuttallWindow(buffer_size_ * num_buffers_, window_);
+  transform_ = MakeSpectrumTransform(num_buffers_, buffer_size_);
   input_data_ = new complex[buffer_size_ * num_buffers_];
   temp_data_ = new complex[buffer_size_ * num_buffers_];
+  num_bins_ = std::min(kAnalysisSize, buffer_size_ * num_buffers_ / 2);
+  spectrum_.resize(num_bins_);
+  hop_energies_.resize(num_buffers_);
 
   memset(filtered_values_, 0, sizeof(filtered_values_));
   peak_ = 1.e11;
+  memset(fixed_filtered_values_, 0, sizeof(fixed_filtered_values_));
+  fixed_peak_ = 1.e11 * kFixedFilterScale;
+  UpdateFixedThresholds();
   memset(detected_signal_, 0, sizeof(detected_signal_));
-  signal_ptr_ = 1;
 }
 
 MorseSignalDetector::~MorseSignalDetector() {
   delete morse_reader_;
+  delete tracker_;
+  delete dump_file_;
+  delete analysis_file_;
+  delete capture_file_;
+  for (auto *snapshot : snapshots_) {
+    delete snapshot;
+  }
+  delete transform_;
   delete[] input_data_;
   delete[] temp_data_;
   delete[] window_;
+  delete[] fixed_window_;
+  delete[] twiddles_;
+  delete[] fixed_data_;
+  delete[] batch_data_;
+  delete[] batch_twiddles_;
+}
+
+bool MorseSignalDetector::CanAnalyze(size_t fft_size,
+                                     size_t center_frequency) {
+  size_t num_bins = std::min(kAnalysisSize, fft_size / 2);
+  return num_bins >= kMinSignalBin + kFreqDomainFilterSize &&
+         center_frequency >= kFreqDomainFilterSize / 2 &&
+         center_frequency + kFreqDomainFilterSize / 2 < num_bins;
 }
 
 void MorseSignalDetector::Verbose(bool value) { verbose_ = value; }
 
-int MorseSignalDetector::SetDumpFile(const std::string &pattern_file_name) {
-  dump_file_ = fopen(pattern_file_name.c_str(), "w");
-  return dump_file_ != nullptr ? 0 : -1;
+void MorseSignalDetector::SetParameters(const DetectorParameters &parameters) {
+  parameters_ = parameters;
+  parameters_.detection_delay =
+      std::min(parameters_.detection_delay, kMaxDetectionDelay);
+  UpdateFixedThresholds();
+}
+
+int MorseSignalDetector::EnableFixedPoint(bool enabled) {
+  size_t fft_size = buffer_size_ * num_buffers_;
+  if (enabled && (fft_size & (fft_size - 1)) != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  fixed_point_ = enabled;
+  if (enabled && fixed_window_ == nullptr) {
+    fixed_window_ = new int16_t[fft_size];
+    for (size_t i = 0; i < fft_size; ++i) {
+      // the window slightly exceeds 1.0 at the center
+      fixed_window_[i] = std::min(lrint(window_[i] * 32767), 32767l);
+    }
+    twiddles_ = new int16_t[fft_size];
+    fixed_fft_make_twiddles(twiddles_, fft_size);
+    fixed_data_ = new complex32[fft_size];
+    power_.resize(num_bins_);
+  }
+  return 0;
+}
+
+void MorseSignalDetector::UpdateFixedThresholds() {
+  fixed_turn_on_level_ = parameters_.turn_on_level * kFixedFilterScale;
+  fixed_turn_off_ratio_ = lrint(parameters_.turn_off_ratio * kFixedRatioOne);
+  fixed_rise_factor_ = lrint(parameters_.rise_factor * kFixedRatioOne);
+  fixed_drop_factor_ = lrint(parameters_.drop_factor * kFixedRatioOne);
+}
+
+int MorseSignalDetector::SetCaptureFile(const std::string &capture_file_name,
+                                        uint32_t sample_rate,
+                                        uint32_t hop_size) {
+  delete capture_file_;
+  capture_file_ = new SpectrumCaptureWriter();
+  if (capture_file_->Open(capture_file_name, num_bins_, sample_rate, hop_size,
+                          buffer_size_ * num_buffers_, center_frequency_) < 0) {
+    delete capture_file_;
+    capture_file_ = nullptr;
+    return -1;
+  }
+  return 0;
+}
+
+void MorseSignalDetector::EnableFrequencyTracking(bool locked) {
+  delete tracker_;
+  size_t max_bin = num_bins_ - kFreqDomainFilterSize / 2;
+  tracker_ = new FrequencyTracker(center_frequency_, kMinSignalBin, max_bin,
+                                  locked);
+  tracker_values_.resize(max_bin - kMinSignalBin);
 }
 
-int MorseSignalDetector::SetAnalysisFile(
-    const std::string &analysis_file_name) {
-  analysis_file_ = fopen(analysis_file_name.c_str(), "w");
-  return analysis_file_ != nullptr ? 0 : -1;
+int MorseSignalDetector::SetDumpFile(const std::string &pattern_file_name,
+                                     uint32_t sample_rate, uint32_t hop_size) {
+  delete dump_file_;
+  dump_file_ = new PatternWriter();
+  if (dump_file_->Open(pattern_file_name, sample_rate, hop_size) < 0) {
+    delete dump_file_;
+    dump_file_ = nullptr;
+    return -1;
+  }
+  return 0;
+}
+
+int MorseSignalDetector::SetAnalysisFile(const std::string &analysis_file_name,
+                                         bool with_spectrum) {
+  delete analysis_file_;
+  analysis_file_ = new AnalysisWriter();
+  if (analysis_file_->Open(analysis_file_name, with_spectrum ? num_bins_ : 0) <
+      0) {
+    delete analysis_file_;
+    analysis_file_ = nullptr;
+    return -1;
+  }
+  analysis_spectrum_.resize(analysis_file_->GetNumBins());
+  return 0;
 }
 
 float MorseSignalDetector::Filter(float data[], float coefficients[],
@@ -60,186 +205,512 @@ float MorseSignalDetector::Filter(float data[], float coefficients[],
   return value;
 }
 
-static ssize_t peak = -1;
+float MorseSignalDetector::FilterAt(size_t bin) {
+  return Filter(spectrum_.data() + bin - kFreqDomainFilterSize / 2,
+                kFreqDomainFilterCoef, kFreqDomainFilterSize);
+}
+
+int64_t MorseSignalDetector::FixedFilterAt(size_t bin) {
+  const int64_t *data = power_.data() + bin - kFreqDomainFilterSize / 2;
+  int64_t value = 0;
+  for (size_t i = 0; i < kFreqDomainFilterSize; ++i) {
+    value += data[i] * kFixedFilterCoef[i];
+  }
+  return value;
+}
 
 void MorseSignalDetector::Process(short *buffers[], size_t current_buffer_size,
                                   Monitor *monitor) {
+  if (parameters_.squelch_level > 0.0 &&
+      Squelch(HopEnergy(buffers[num_buffers_ - 1], current_buffer_size))) {
+    Detect(monitor, fixed_point_, true);
+    return;
+  }
+  if (fixed_point_) {
+    int exponent = MakeFixedInputData(buffers, current_buffer_size);
+    Analyze(monitor, nullptr, exponent);
+  } else {
+    Analyze(monitor, Transform(buffers, current_buffer_size));
+  }
+}
+
+void MorseSignalDetector::Process(complex *buffers[],
+                                  size_t current_buffer_size,
+                                  Monitor *monitor) {
+  if (parameters_.squelch_level > 0.0 &&
+      Squelch(HopEnergy(buffers[num_buffers_ - 1], current_buffer_size))) {
+    Detect(monitor, false, true);
+    return;
+  }
+  Analyze(monitor, Transform(buffers, current_buffer_size));
+}
+
+bool MorseSignalDetector::Squelch(double hop_energy) {
+  hop_energies_[hop_index_] = hop_energy;
+  hop_index_ = (hop_index_ + 1) % num_buffers_;
+  double energy = 0.0;
+  for (double e : hop_energies_) {
+    energy += e;
+  }
+  energy_average_ =
+      energy_average_ < 0.0
+          ? energy
+          : energy_average_ + (energy - energy_average_) * kEnergyAverageWeight;
+  double min_floor = energy_average_ * kMinNoiseRatio;
+  noise_floor_ = std::max(
+      min_floor, noise_floor_ < 0.0
+                     ? energy
+                     : std::min(energy, noise_floor_ * kNoiseFloorRise));
+
+  // A signal that is on is analyzed until it drops, and the spectrum is
+  // needed for the capture file.
+  uint8_t prev_signal = detected_signal_[(window_count_ - 1) % kHistorySize];
+  if (prev_signal || capture_file_ != nullptr ||
+      energy > noise_floor_ * parameters_.squelch_level) {
+    return false;
+  }
+  ++num_squelched_;
+  return true;
+}
+
+const complex *MorseSignalDetector::Transform(short *buffers[],
+                                              size_t current_buffer_size) {
+  if (transform_ == nullptr) {
+    MakeInputData(input_data_, window_, buffers, current_buffer_size);
+    memset(temp_data_, 0, sizeof(complex) * num_buffers_ * buffer_size_);
+    fft(input_data_, buffer_size_ * num_buffers_, temp_data_);
+    return input_data_;
+  }
+  // cleared as by MakeInputData
+  memset(buffers[num_buffers_ - 1] + current_buffer_size, 0,
+         sizeof(short) * (buffer_size_ - current_buffer_size));
+  return transform_->Transform(buffers);
+}
+
+const complex *MorseSignalDetector::Transform(complex *buffers[],
+                                              size_t current_buffer_size) {
+  if (transform_ == nullptr) {
+    MakeInputData(input_data_, window_, buffers, current_buffer_size);
+    memset(temp_data_, 0, sizeof(complex) * num_buffers_ * buffer_size_);
+    fft(input_data_, buffer_size_ * num_buffers_, temp_data_);
+    return input_data_;
+  }
+  memset(buffers[num_buffers_ - 1] + current_buffer_size, 0,
+         sizeof(complex) * (buffer_size_ - current_buffer_size));
+  return transform_->Transform(buffers);
+}
+
+void MorseSignalDetector::Analyze(Monitor *monitor, const complex *data,
+                                  int exponent) {
+  bool fixed_point = data == nullptr;
+  if (fixed_point) {
+    exponent += fixed_fft(fixed_data_, buffer_size_ * num_buffers_, twiddles_);
+  }
+
+  // The power spectrum is evaluated only for the bins that are looked at; the
+  // signal bin, the frequency tracker's search range, and the monitor bars.
+  size_t lower;
+  size_t upper;
+  GetSearchRange(&lower, &upper);
+  if (monitor != nullptr) {
+    lower = std::min(lower, kDisplayFirstBin);
+    upper = std::max(upper, kDisplayFirstBin + kNumDisplayBins);
+  }
+  if (!analysis_spectrum_.empty() || capture_file_ != nullptr) {
+    lower = 0;
+    upper = num_bins_;
+  }
+  const size_t half_filter = kFreqDomainFilterSize / 2;
+  lower = lower >= half_filter ? lower - half_filter : 0;
+  upper = std::min(upper + half_filter, num_bins_);
+  if (fixed_point) {
+    // the float spectrum is only made for the tracker, the monitor, and the
+    // output files
+    bool with_spectrum = tracker_ != nullptr || monitor != nullptr ||
+                         analysis_file_ != nullptr || capture_file_ != nullptr;
+    for (size_t i = lower; i < upper; ++i) {
+      int64_t re = fixed_data_[i].Re;
+      int64_t im = fixed_data_[i].Im;
+      int64_t power = re * re + im * im;
+      power_[i] = exponent >= 0 ? power << (2 * exponent)
+                                : power >> (-2 * exponent);
+      if (with_spectrum) {
+        spectrum_[i] = power_[i];
+      }
+    }
+  } else {
+    for (size_t i = lower; i < upper; ++i) {
+      spectrum_[i] = Power(data[i]);
+    }
+  }
+
+  if (capture_file_ != nullptr) {
+    capture_file_->Add(spectrum_.data());
+  }
+
+  Detect(monitor, fixed_point);
+}
+
+void MorseSignalDetector::MakeSpectrum(short *buffers[],
+                                       size_t current_buffer_size,
+                                       float spectrum[]) {
+  const complex *data = Transform(buffers, current_buffer_size);
+  for (size_t i = 0; i < num_bins_; ++i) {
+    spectrum[i] = Power(data[i]);
+  }
+}
+
+void MorseSignalDetector::MakeSpectrum(complex *buffers[],
+                                       size_t current_buffer_size,
+                                       float spectrum[]) {
+  const complex *data = Transform(buffers, current_buffer_size);
+  for (size_t i = 0; i < num_bins_; ++i) {
+    spectrum[i] = Power(data[i]);
+  }
+}
+
+double MorseSignalDetector::GetToneBin() const {
+  return tracker_ != nullptr ? tracker_->GetFrequency()
+                             : static_cast<double>(center_frequency_);
+}
+
+bool MorseSignalDetector::CanBatch() const {
+  size_t fft_size = buffer_size_ * num_buffers_;
+  return (fft_size & (fft_size - 1)) == 0;
+}
+
+bool MorseSignalDetector::AddToBatch(short *buffers[],
+                                     size_t current_buffer_size) {
+  MakeInputData(input_data_, window_, buffers, current_buffer_size);
+  return AddInputToBatch();
+}
+
+bool MorseSignalDetector::AddToBatch(complex *buffers[],
+                                     size_t current_buffer_size) {
   MakeInputData(input_data_, window_, buffers, current_buffer_size);
-  memset(temp_data_, 0, sizeof(complex) * num_buffers_ * buffer_size_);
-  fft(input_data_, buffer_size_ * num_buffers_, temp_data_);
-
-  size_t center = center_frequency_;
-
-  const size_t kAnalysisSize = 100;
-  std::vector<float> data{kAnalysisSize};
-  for (size_t i = 0; i < kAnalysisSize; ++i) {
-    data.push_back(Power(input_data_[i]));
-  }
-
-  float max_value = 0.0;
-  std::vector<float> temp;
-  for (size_t i = 0; i < kAnalysisSize - kFreqDomainFilterSize; ++i) {
-    auto value =
-        Filter(data.data() + i, kFreqDomainFilterCoef, kFreqDomainFilterSize);
-    // fprintf(analysis_file_, "%ld %f\n", index, data[index]);
-    temp.push_back(value);
-    if (value > max_value && i >= 2 &&
-        i < kAnalysisSize - kFreqDomainFilterSize - 2) {
-      max_value = value;
-      if (temp[i - 2] < value * 0.05) {
-        peak = i + kFreqDomainFilterSize / 2;
+  return AddInputToBatch();
+}
+
+bool MorseSignalDetector::AddInputToBatch() {
+  size_t fft_size = buffer_size_ * num_buffers_;
+  if (batch_data_ == nullptr) {
+    batch_data_ = new complex_batch[fft_size];
+    batch_twiddles_ = new complex[fft_size];
+    batch_fft_make_twiddles(batch_twiddles_, fft_size);
+  }
+  for (size_t i = 0; i < fft_size; ++i) {
+    batch_data_[i].Re[batch_size_] = input_data_[i].Re;
+    batch_data_[i].Im[batch_size_] = input_data_[i].Im;
+  }
+  return ++batch_size_ == FFT_BATCH;
+}
+
+size_t MorseSignalDetector::TransformBatch(float spectra[]) {
+  if (batch_size_ == 0) {
+    return 0;
+  }
+  batch_fft(batch_data_, buffer_size_ * num_buffers_, batch_twiddles_);
+  for (size_t i = 0; i < num_bins_; ++i) {
+    const complex_batch &data = batch_data_[i];
+    fft_lanes power = data.Re * data.Re + data.Im * data.Im;
+    for (size_t lane = 0; lane < batch_size_; ++lane) {
+      spectra[lane * num_bins_ + i] = power[lane];
+    }
+  }
+  size_t num_spectra = batch_size_;
+  batch_size_ = 0;
+  return num_spectra;
+}
+
+void MorseSignalDetector::ProcessSpectrum(const float spectrum[],
+                                          Monitor *monitor) {
+  memcpy(spectrum_.data(), spectrum, sizeof(float) * num_bins_);
+  if (capture_file_ != nullptr) {
+    capture_file_->Add(spectrum_.data());
+  }
+  if (fixed_point_) {
+    for (size_t i = 0; i < num_bins_; ++i) {
+      power_[i] = llrint(spectrum[i]);
+    }
+  }
+  Detect(monitor, fixed_point_);
+}
+
+void MorseSignalDetector::GetSearchRange(size_t *first, size_t *last) {
+  if (tracker_ != nullptr) {
+    tracker_->GetSearchRange(first, last);
+  } else {
+    *first = center_frequency_;
+    *last = center_frequency_ + 1;
+  }
+}
+
+void MorseSignalDetector::Detect(Monitor *monitor, bool fixed_point,
+                                 bool silent) {
+  const size_t half_filter = kFreqDomainFilterSize / 2;
+  size_t first;
+  size_t last;
+  GetSearchRange(&first, &last);
+
+  // the tracker holds its lock through silence
+  if (tracker_ != nullptr && !silent) {
+    for (size_t bin = first; bin < last; ++bin) {
+      tracker_values_[bin - first] = FilterAt(bin);
+    }
+    tracker_->Update(tracker_values_.data(), first, last);
+    center_frequency_ = tracker_->GetBin();
+  }
+
+  if (monitor != nullptr) {
+    char center[32];
+    if (tracker_ != nullptr) {
+      snprintf(center, sizeof(center), "%.1f%s", tracker_->GetFrequency(),
+               tracker_->IsLocked() ? "" : " (unlocked)");
+    } else {
+      snprintf(center, sizeof(center), "%ld", center_frequency_);
+    }
+    int levels[kNumDisplayBins / 4];
+    for (size_t i = 0; i < kNumDisplayBins / 4; ++i) {
+      float sum = 0.0;
+      for (size_t bin = kDisplayFirstBin + 4 * i;
+           !silent && bin < kDisplayFirstBin + 4 * i + 4 &&
+           bin + half_filter < num_bins_;
+           ++bin) {
+        sum += FilterAt(bin);
       }
+      int level = sum * 1.e-10;
+      levels[i] = std::max(0, std::min(level, Monitor::kMaxSpectrumLevel));
     }
+    monitor->ShowSpectrum(center, levels, kNumDisplayBins / 4);
   }
-  move(0, 1);
-  clrtoeol();
-  printw("center: %ld", peak);
-  for (int i = 0; i < 5; ++i) {
-    move(i + 1, 1);
-    clrtoeol();
-    int level =
-        (temp[4 * i] + temp[4 * i + 1] + temp[4 * i + 2] + temp[4 * i + 3]) *
-        1.e-10;
-    if (level > 50) {
-      level = 50;
+
+  // detect signal for this window
+  uint8_t prev_signal = detected_signal_[(window_count_ - 1) % kHistorySize];
+  float current_value;
+  float diff;
+  uint8_t current_signal =
+      silent        ? DecideSilence(&current_value, &diff)
+      : fixed_point ? DecideFixed(&prev_signal, &current_value, &diff)
+                    : Decide(&prev_signal, &current_value, &diff);
+  if (current_signal != prev_signal) {
+    last_toggled_ = window_count_;
+  }
+
+  size_t window = window_count_;
+  size_t delay = parameters_.detection_delay;
+  detected_signal_[window % kHistorySize] = current_signal;
+  current_signal_ = current_signal;
+  signal_level_ = current_value;
+  // the reader sees silence until the first window comes out of the delay
+  output_signal_ =
+      window >= delay ? detected_signal_[(window - delay) % kHistorySize] : 0;
+
+  if (analysis_file_ != nullptr) {
+    if (!analysis_spectrum_.empty()) {
+      for (size_t bin = 0; bin < num_bins_; ++bin) {
+        analysis_spectrum_[bin] =
+            !silent && bin >= half_filter && bin + half_filter < num_bins_
+                ? FilterAt(bin)
+                : 0.0;
+      }
     }
-    if (level < 0) {
-      level = 0;
+    analysis_file_->Add(window_count_, current_value, output_signal_, diff,
+                        analysis_spectrum_.data());
+  }
+  ++window_count_;
+
+  if (monitor != nullptr) {
+    monitor->AddSignal(current_signal ? '^' : '_');
+  }
+
+  if (dump_file_ == nullptr && analysis_file_ == nullptr && !decide_only_) {
+    bool some_changed = false;
+    if (window < delay) {
+      some_changed = morse_reader_->UpdateSilence();
+    } else {
+      // an amendment may reach windows that the reader has already seen
+      if (amended_ && CorrectionEnabled() && first_amended_ < window - delay) {
+        some_changed = Correct(first_amended_, window - delay);
+      }
+      some_changed |= Feed(window - delay);
+    }
+    if (some_changed && monitor != nullptr) {
+      monitor->Dump(morse_reader_);
     }
-    char buf[128];
-    memset(buf, '*', level);
-    buf[level] = 0;
-    printw("%s", buf);
   }
+  amended_ = false;
 
-  uint8_t current_signal = 0;
+  if (dump_file_ != nullptr) {
+    dump_file_->Add(current_signal);
+  }
+}
 
+uint8_t MorseSignalDetector::Decide(uint8_t *prev_signal, float *current_value,
+                                    float *diff) {
   // apply filter in frequency domain to retrieve peaks
-  float v = Filter(data.data() + center - kFreqDomainFilterSize / 2,
-                   kFreqDomainFilterCoef, kFreqDomainFilterSize);
+  float v = FilterAt(center_frequency_);
 
   // apply filter in time domain to reduce noise
-  float current_value = (v + filtered_values_[0] + filtered_values_[1]) * 0.33;
+  *current_value = (v + filtered_values_[0] + filtered_values_[1]) * 0.33;
   // take value diff to detect rapid rise and drop
-  float diff =
-      (v + filtered_values_[0] - filtered_values_[1] - filtered_values_[2]) *
-      0.5;
+  *diff = (v + filtered_values_[0] - filtered_values_[1] - filtered_values_[2]) *
+          0.5;
 
-  // detect signal for this window
-  uint8_t prev_signal = detected_signal_[(signal_ptr_ - 2) % kDetectionDelay];
-  current_signal = prev_signal;
+  uint8_t current_signal = *prev_signal;
   if (current_signal) {
-    peak_ = std::max(peak_, current_value);
+    peak_ = std::max(peak_, *current_value);
   }
-  if (window_count_ - last_toggled_ >= 2) {
-    float change_factor = diff / peak_;
-    if (change_factor > 1.3 && prev_signal) {
+  if (window_count_ - last_toggled_ >= parameters_.min_toggle_interval) {
+    float change_factor = *diff / peak_;
+    if (change_factor > parameters_.rise_factor && *prev_signal) {
       // Special case of detecting steep rise while the signal is on.
       // It's likely the detector missed the previous drop due to noise in the
       // source. The detected signal would be amended.
-      size_t dot_length =
-          static_cast<size_t>(morse_reader_->GetEstimatedDotLength());
-      if (dot_length > 5) {
-        for (size_t i = 0; i < dot_length; ++i) {
-          detected_signal_[(signal_ptr_ - 1 - dot_length + i) %
-                           kDetectionDelay] = 0;
-        }
-        prev_signal = 0;
+      if (Amend()) {
+        *prev_signal = 0;
       }
-    } else if (!prev_signal) {
+    } else if (!*prev_signal) {
       // TODO(Naoki): Is there a way to specify a relative value?
-      if (current_value > 3.e10) {
+      if (*current_value > parameters_.turn_on_level) {
         current_signal = 1;
-        peak_ = current_value;
+        peak_ = *current_value;
       }
-    } else if (current_value < peak_ / 20 || change_factor < -1.3) {
+    } else if (*current_value < peak_ / parameters_.turn_off_ratio ||
+               change_factor < -parameters_.drop_factor) {
       // turn off signal when the value becomes low enough or whena steep drop
       // is detected
       current_signal = 0;
     }
+  }
 
-    if (current_signal != prev_signal) {
-      last_toggled_ = window_count_;
-    }
+  for (int i = kLookBackWindowSize; --i >= 1;) {
+    filtered_values_[i] = filtered_values_[i - 1];
   }
+  filtered_values_[0] = v;
+  return current_signal;
+}
 
-  detected_signal_[signal_ptr_ == 0 ? kDetectionDelay - 1 : signal_ptr_ - 1] =
-      current_signal;
+uint8_t MorseSignalDetector::DecideFixed(uint8_t *prev_signal,
+                                         float *current_value, float *diff) {
+  // same as Decide, the ratios are compared by cross multiplication
+  int64_t v = FixedFilterAt(center_frequency_);
+  const int64_t *filtered = fixed_filtered_values_;
+  int64_t value = (v + filtered[0] + filtered[1]) * 33 / 100;
+  int64_t change = (v + filtered[0] - filtered[1] - filtered[2]) / 2;
 
-  if (analysis_file_ != nullptr) {
-    fprintf(analysis_file_, "%ld %f %f %f\n", window_count_, current_value,
-            detected_signal_[signal_ptr_] ? 1.e11 : 0, diff);
-    // current_signal ? 1.e11 : 0, diff);
-    fflush(analysis_file_);
-  }
-
-#if 0
-  int count = 0;
-  for (size_t i = 0; i < kAnalysisSize - 10; ++i) {
-    auto value =
-        Filter(data.data() + i, kFreqDomainFilterCoef, kFreqDomainFilterSize);
-    // fprintf(analysis_file_, "%ld %f\n", index, data[index]);
-    // /*
-    fprintf(analysis_file_, "%ld %ld %f\n", window_count_, i, value);
-    // */
-  }
-  printf("%s", count > 0 ? "*" : "");
-  fflush(stdout);
-#endif
-  ++window_count_;
-
-  if (monitor != nullptr) {
-    monitor->AddSignal(current_signal ? '^' : '_');
+  uint8_t current_signal = *prev_signal;
+  if (current_signal) {
+    fixed_peak_ = std::max(fixed_peak_, value);
   }
-
-  if (dump_file_ == nullptr && analysis_file_ == nullptr) {
-    bool some_changed = morse_reader_->Update(detected_signal_[signal_ptr_]);
-    if (some_changed && monitor != nullptr) {
-      monitor->Dump(morse_reader_);
+  if (window_count_ - last_toggled_ >= parameters_.min_toggle_interval) {
+    if (*prev_signal && Multiply(change, kFixedRatioOne) >
+                            Multiply(fixed_peak_, fixed_rise_factor_)) {
+      if (Amend()) {
+        *prev_signal = 0;
+      }
+    } else if (!*prev_signal) {
+      if (value > fixed_turn_on_level_) {
+        current_signal = 1;
+        fixed_peak_ = value;
+      }
+    } else if (Multiply(value, fixed_turn_off_ratio_) <
+                   Multiply(fixed_peak_, kFixedRatioOne) ||
+               Multiply(change, kFixedRatioOne) <
+                   Multiply(-fixed_peak_, fixed_drop_factor_)) {
+      current_signal = 0;
     }
   }
 
-  if (dump_file_ != nullptr) {
-    fprintf(dump_file_, "%c", current_signal ? '^' : '_');
+  for (int i = kLookBackWindowSize; --i >= 1;) {
+    fixed_filtered_values_[i] = fixed_filtered_values_[i - 1];
   }
+  fixed_filtered_values_[0] = v;
+
+  *current_value = static_cast<float>(value) / kFixedFilterScale;
+  *diff = static_cast<float>(change) / kFixedFilterScale;
+  return current_signal;
+}
 
+uint8_t MorseSignalDetector::DecideSilence(float *current_value, float *diff) {
+  // the filters see no power in the skipped windows
   for (int i = kLookBackWindowSize; --i >= 1;) {
     filtered_values_[i] = filtered_values_[i - 1];
+    fixed_filtered_values_[i] = fixed_filtered_values_[i - 1];
   }
-  filtered_values_[0] = v;
-  signal_ptr_ = (signal_ptr_ + 1) % kDetectionDelay;
+  filtered_values_[0] = 0.0;
+  fixed_filtered_values_[0] = 0;
+  *current_value = 0.0;
+  *diff = 0.0;
+  return 0;
+}
+
+bool MorseSignalDetector::Amend() {
+  size_t dot_length =
+      static_cast<size_t>(morse_reader_->GetEstimatedDotLength());
+  if (dot_length <= 5) {
+    return false;
+  }
+  dot_length = std::min(dot_length, kHistorySize - 1);
+  for (size_t i = 0; i < dot_length; ++i) {
+    detected_signal_[(window_count_ - dot_length + i) % kHistorySize] = 0;
+  }
+  amended_ = true;
+  first_amended_ = window_count_ >= dot_length ? window_count_ - dot_length : 0;
+  return true;
+}
+
+bool MorseSignalDetector::Feed(size_t window) {
+  if (CorrectionEnabled() && window % kSnapshotInterval == 0) {
+    size_t slot = (window / kSnapshotInterval) % kNumSnapshots;
+    if (snapshots_[slot] == nullptr) {
+      snapshots_[slot] = new MorseReader(morse_reader_->GetParameters());
+    }
+    snapshots_[slot]->CopyFrom(*morse_reader_);
+    snapshot_windows_[slot] = window;
+  }
+  uint8_t level = detected_signal_[window % kHistorySize];
+  return level ? morse_reader_->Update(level) : morse_reader_->UpdateSilence();
+}
+
+bool MorseSignalDetector::Correct(size_t first_amended, size_t end) {
+  size_t start = first_amended / kSnapshotInterval * kSnapshotInterval;
+  size_t slot = (start / kSnapshotInterval) % kNumSnapshots;
+  // the snapshot must be there and the history must still hold the windows
+  // since then
+  if (snapshots_[slot] == nullptr || snapshot_windows_[slot] != start ||
+      window_count_ - start >= kHistorySize) {
+    return false;
+  }
+  morse_reader_->CopyFrom(*snapshots_[slot]);
+  for (size_t window = start; window < end; ++window) {
+    Feed(window);
+  }
+  ++num_corrections_;
+  return true;
 }
 
 void MorseSignalDetector::Drain(Monitor *monitor) {
-  if (dump_file_ == nullptr && analysis_file_ == nullptr) {
+  if (dump_file_ == nullptr && analysis_file_ == nullptr && !decide_only_) {
 
-    for (size_t i = 0; i < kDetectionDelay; ++i) {
-      bool some_changed = morse_reader_->Update(
-          detected_signal_[(signal_ptr_ + i) % kDetectionDelay]);
+    size_t delay = std::min(parameters_.detection_delay, window_count_);
+    for (size_t window = window_count_ - delay; window < window_count_;
+         ++window) {
+      bool some_changed = Feed(window);
       if (some_changed && monitor != nullptr) {
         monitor->Dump(morse_reader_);
       }
     }
-  }
-}
-
-void MorseSignalDetector::MakeBlackmanNuttallWindow(size_t window_size,
-                                                    float window[]) {
-  float a0 = 0.3636819;
-  float a1 = 0.4891775;
-  float a2 = 0.1365995;
-  float a3 = 0.0106411;
-  for (size_t n = 0; n < window_size; ++n) {
-    window[n] = a0 - a1 * cos((2 * M_PI * (n + 0.5)) / window_size) +
-                a2 * cos((4 * M_PI * (n + 0.5)) / window_size) -
-                a3 * cos((6 * M_PI * (n + 0.5)) / window_size);
+    // one more window of silence after the end of the input
+    if (morse_reader_->UpdateSilence() && monitor != nullptr) {
+      monitor->Dump(morse_reader_);
+    }
   }
 }
 
 float MorseSignalDetector::MakeInputData(complex input_data[], float window[],
                                          short *buffers[], int n) {
   float total_power = 0.0;
-  memset(buffers[num_buffers_ - 1] + n, 0, buffer_size_ - n);
+  memset(buffers[num_buffers_ - 1] + n, 0, sizeof(short) * (buffer_size_ - n));
   for (size_t ibuf = 0; ibuf < num_buffers_; ++ibuf) {
     for (size_t i = 0; i < buffer_size_; ++i) {
       input_data[buffer_size_ * ibuf + i].Re =
@@ -251,4 +722,136 @@ float MorseSignalDetector::MakeInputData(complex input_data[], float window[],
   return total_power;
 }
 
-} // namespace morse
\ No newline at end of file
+float MorseSignalDetector::MakeInputData(complex input_data[], float window[],
+                                         complex *buffers[], int n) {
+  float total_power = 0.0;
+  memset(buffers[num_buffers_ - 1] + n, 0,
+         sizeof(complex) * (buffer_size_ - n));
+  for (size_t ibuf = 0; ibuf < num_buffers_; ++ibuf) {
+    for (size_t i = 0; i < buffer_size_; ++i) {
+      size_t index = buffer_size_ * ibuf + i;
+      input_data[index].Re = window[index] * buffers[ibuf][i].Re;
+      input_data[index].Im = window[index] * buffers[ibuf][i].Im;
+      total_power += Power(input_data[index]);
+    }
+  }
+  return total_power;
+}
+
+int MorseSignalDetector::MakeFixedInputData(short *buffers[], int n) {
+  memset(buffers[num_buffers_ - 1] + n, 0, sizeof(short) * (buffer_size_ - n));
+  int32_t max = 0;
+  for (size_t ibuf = 0; ibuf < num_buffers_; ++ibuf) {
+    for (size_t i = 0; i < buffer_size_; ++i) {
+      size_t index = buffer_size_ * ibuf + i;
+      fixed_data_[index].Re = fixed_window_[index] * buffers[ibuf][i];
+      fixed_data_[index].Im = 0;
+      max = std::max(max, std::abs(fixed_data_[index].Re));
+    }
+  }
+
+  // Normalize the Q15 products to the headroom of the FFT so that quiet
+  // input keeps its precision.
+  int shift = 0;
+  while ((max >> shift) >= (1 << 13)) {
+    ++shift;
+  }
+  int32_t round = shift > 0 ? 1 << (shift - 1) : 0;
+  for (size_t i = 0; i < buffer_size_ * num_buffers_; ++i) {
+    fixed_data_[i].Re = (fixed_data_[i].Re + round) >> shift;
+  }
+  return shift - 15;
+}
+
+void MorseSignalDetector::SaveState(StateWriter *writer) const {
+  writer->Put(num_buffers_);
+  writer->Put(buffer_size_);
+  writer->Put(num_bins_);
+  writer->Put(fixed_point_);
+  writer->Put(tracker_ != nullptr);
+
+  writer->Put(center_frequency_);
+  if (tracker_ != nullptr) {
+    tracker_->SaveState(writer);
+  }
+  writer->Put(window_count_);
+  writer->Put(last_toggled_);
+  writer->PutArray(filtered_values_, kLookBackWindowSize);
+  writer->Put(peak_);
+  writer->PutArray(fixed_filtered_values_, kLookBackWindowSize);
+  writer->Put(fixed_peak_);
+  writer->Put(output_signal_);
+  writer->PutArray(hop_energies_.data(), num_buffers_);
+  writer->Put(hop_index_);
+  writer->Put(noise_floor_);
+  writer->Put(energy_average_);
+  writer->Put(num_squelched_);
+  writer->PutArray(detected_signal_, kHistorySize);
+  writer->Put(current_signal_);
+  writer->Put(num_corrections_);
+  writer->Put(amended_);
+  writer->Put(first_amended_);
+  for (size_t slot = 0; slot < kNumSnapshots; ++slot) {
+    writer->Put(snapshots_[slot] != nullptr);
+    if (snapshots_[slot] != nullptr) {
+      writer->Put(snapshot_windows_[slot]);
+      snapshots_[slot]->SaveState(writer);
+    }
+  }
+  morse_reader_->SaveState(writer);
+}
+
+bool MorseSignalDetector::LoadState(StateReader *reader) {
+  reader->Expect(num_buffers_);
+  reader->Expect(buffer_size_);
+  reader->Expect(num_bins_);
+  reader->Expect(fixed_point_);
+  reader->Expect(tracker_ != nullptr);
+
+  reader->Get(&center_frequency_);
+  if (tracker_ != nullptr) {
+    tracker_->LoadState(reader);
+  }
+  reader->Get(&window_count_);
+  reader->Get(&last_toggled_);
+  reader->GetArray(filtered_values_, kLookBackWindowSize);
+  reader->Get(&peak_);
+  reader->GetArray(fixed_filtered_values_, kLookBackWindowSize);
+  reader->Get(&fixed_peak_);
+  reader->Get(&output_signal_);
+  reader->GetArray(hop_energies_.data(), num_buffers_);
+  reader->Get(&hop_index_);
+  reader->Get(&noise_floor_);
+  reader->Get(&energy_average_);
+  reader->Get(&num_squelched_);
+  reader->GetArray(detected_signal_, kHistorySize);
+  reader->Get(&current_signal_);
+  reader->Get(&num_corrections_);
+  reader->Get(&amended_);
+  reader->Get(&first_amended_);
+  if (center_frequency_ < kFreqDomainFilterSize / 2 ||
+      center_frequency_ + kFreqDomainFilterSize / 2 >= num_bins_ ||
+      hop_index_ >= num_buffers_) {
+    reader->Fail();
+  }
+  for (size_t slot = 0; slot < kNumSnapshots && !reader->Failed(); ++slot) {
+    bool present = false;
+    reader->Get(&present);
+    if (!present) {
+      delete snapshots_[slot];
+      snapshots_[slot] = nullptr;
+      continue;
+    }
+    reader->Get(&snapshot_windows_[slot]);
+    if (snapshots_[slot] == nullptr) {
+      snapshots_[slot] = new MorseReader(morse_reader_->GetParameters());
+    }
+    snapshots_[slot]->LoadState(reader);
+  }
+  if (reader->Failed()) {
+    return false;
+  }
+  return morse_reader_->LoadState(reader);
+}
+
+} // namespace morse
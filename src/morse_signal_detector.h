@@ -4,12 +4,22 @@
 #include <stdio.h>
 
 #include <string>
+#include <vector>
 
 #include <stddef.h>
 
+#include "analysis_file.h"
+#include "batch_fft.h"
+#include "checkpoint.h"
 #include "fft.h"
+#include "fixed_fft.h"
+#include "frequency_tracker.h"
 #include "monitor.h"
 #include "morse_reader.h"
+#include "parameters.h"
+#include "pattern_file.h"
+#include "spectrum_capture.h"
+#include "spectrum_transform.h"
 
 namespace morse {
 
@@ -20,43 +30,299 @@ private:
   float *window_;
   complex *input_data_;
   complex *temp_data_;
+  // specialized window and FFT for the common sizes, or nullptr
+  SpectrumTransform *transform_;
+  size_t num_bins_; // number of spectrum bins to examine
+  std::vector<float> spectrum_;
+
+  // windows collected for a batched FFT, one per lane
+  complex_batch *batch_data_ = nullptr;
+  complex *batch_twiddles_ = nullptr;
+  size_t batch_size_ = 0;
 
   MorseReader *morse_reader_;
 
   bool verbose_ = false;
-  FILE *dump_file_ = nullptr;
-  FILE *analysis_file_ = nullptr;
+  bool decide_only_ = false;
+  PatternWriter *dump_file_ = nullptr;
+  AnalysisWriter *analysis_file_ = nullptr;
+  std::vector<float> analysis_spectrum_;
+  SpectrumCaptureWriter *capture_file_ = nullptr;
 
   // used for signal detection
+  DetectorParameters parameters_;
   size_t center_frequency_;
+  FrequencyTracker *tracker_ = nullptr;
+  std::vector<float> tracker_values_;
   size_t window_count_ = 0;
   size_t last_toggled_ = 0; // used to avoid chattering
   static const size_t kLookBackWindowSize = 3;
   float filtered_values_[kLookBackWindowSize];
   float peak_; // used to scale values
 
-  // the detector keeps the result for a while since it may be amended
-  static const size_t kDetectionDelay = 32;
-  uint8_t detected_signal_[kDetectionDelay];
-  size_t signal_ptr_;
+  // integer path; powers and filtered values are scaled by the coefficients
+  // of the integer frequency domain filter
+  bool fixed_point_ = false;
+  int16_t *fixed_window_ = nullptr; // Q15
+  int16_t *twiddles_ = nullptr;
+  complex32 *fixed_data_ = nullptr;
+  std::vector<int64_t> power_;
+  int64_t fixed_filtered_values_[kLookBackWindowSize];
+  int64_t fixed_peak_;
+  int64_t fixed_turn_on_level_;
+  int64_t fixed_turn_off_ratio_; // thresholds ratios in kFixedRatioOne units
+  int64_t fixed_rise_factor_;
+  int64_t fixed_drop_factor_;
+  uint8_t output_signal_ = 0;
+
+  // squelch; energies of the hops in the window, the tracked noise floor of
+  // the window energy, and its long term average
+  std::vector<double> hop_energies_;
+  size_t hop_index_ = 0;
+  double noise_floor_ = -1.0;
+  double energy_average_ = -1.0;
+  size_t num_squelched_ = 0;
+
+  // The detector keeps the result for a while since it may be amended. The
+  // history is indexed by window and is longer than the delay so that the
+  // reader can be corrected with a short delay.
+  static constexpr size_t kHistorySize = 64;
+  uint8_t detected_signal_[kHistorySize];
+  uint8_t current_signal_ = 0;
+  // value of the signal bin that the latest window was decided on
+  float signal_level_ = 0.0;
+
+  // snapshots of the reader to rewind to on corrections, taken before the
+  // reader sees every kSnapshotInterval-th window
+  static const size_t kSnapshotInterval = 16;
+  static const size_t kNumSnapshots = 4;
+  MorseReader *snapshots_[kNumSnapshots] = {};
+  size_t snapshot_windows_[kNumSnapshots] = {};
+  size_t num_corrections_ = 0;
+  bool amended_ = false;
+  size_t first_amended_ = 0;
 
 public:
+  // the longest delay that DetectorParameters::detection_delay may give
+  static constexpr size_t kMaxDetectionDelay = kHistorySize / 2 - 1;
+  // number of low frequency bins that are examined for the signal
+  static constexpr size_t kAnalysisSize = 100;
+  // the lowest bin that can hold the signal
+  static constexpr size_t kMinSignalBin = 3;
+
+  /**
+   * The spectrum of num_buffers * buffer_size samples must hold the
+   * frequency domain filter around center_frequency; see CanAnalyze.
+   */
   MorseSignalDetector(MorseReader *morse_reader, size_t num_buffers,
                       size_t buffer_size, size_t center_frequency);
   virtual ~MorseSignalDetector();
 
+  /**
+   * Whether the spectrum of fft_size holds the frequency domain filter
+   * around center_frequency and leaves the frequency tracking bins to search.
+   */
+  static bool CanAnalyze(size_t fft_size, size_t center_frequency);
+
   void Verbose(bool value = true);
 
-  int SetDumpFile(const std::string &pattern_file_name);
+  void SetParameters(const DetectorParameters &parameters);
+
+  /**
+   * Selects the integer path; Q15 window, block floating point FFT, and
+   * integer power and thresholds. It applies to 16-bit samples, complex
+   * samples of the decimating front end always take the float path.
+   * Returns -1 with errno EINVAL if the FFT size is not a power of two.
+   */
+  int EnableFixedPoint(bool enabled = true);
+
+  /**
+   * Returns the signal last given to the reader, i.e. after the detection
+   * delay.
+   */
+  inline uint8_t GetOutputSignal() const { return output_signal_; }
+
+  /**
+   * Returns the signal decided for the latest window, before the delay.
+   */
+  inline uint8_t GetCurrentSignal() const { return current_signal_; }
+
+  inline size_t GetWindowCount() const { return window_count_; }
+
+  /**
+   * Returns the bin of the tone, fractional while the frequency is tracked.
+   */
+  double GetToneBin() const;
 
-  int SetAnalysisFile(const std::string &analysis_file_name);
+  /**
+   * Returns the value that the latest window was decided on.
+   */
+  inline float GetSignalLevel() const { return signal_level_; }
+
+  /**
+   * Returns the number of windows skipped by the squelch.
+   */
+  inline size_t GetNumSquelched() const { return num_squelched_; }
+
+  inline size_t GetDetectionDelay() const {
+    return parameters_.detection_delay;
+  }
+
+  /**
+   * Only decides the signal without feeding the reader, for a caller that
+   * takes the decisions by GetCurrentSignal, e.g. EnsembleDecoder. Signals
+   * are not amended then since the reader knows no dot length.
+   */
+  inline void DecideOnly(bool value = true) { decide_only_ = value; }
+
+  /**
+   * Returns the number of times the reader was rewound to correct signals
+   * that it had already seen.
+   */
+  inline size_t GetNumCorrections() const { return num_corrections_; }
+
+  /**
+   * Lets the detector follow the tone instead of staying on the center
+   * frequency. If locked is false, the initial center frequency is only a
+   * guess and the detector scans the spectrum for the tone first.
+   */
+  void EnableFrequencyTracking(bool locked);
+
+  /**
+   * Records detected signals to a pattern file. The hop size is in samples of
+   * the original sample rate.
+   */
+  int SetDumpFile(const std::string &pattern_file_name, uint32_t sample_rate,
+                  uint32_t hop_size);
+
+  /**
+   * Records detection data to a binary analysis file, optionally with the
+   * filtered spectrum of every window.
+   */
+  int SetAnalysisFile(const std::string &analysis_file_name,
+                      bool with_spectrum = false);
+
+  /**
+   * Records the power spectrum of every window to a capture file, so that the
+   * detection can be run again without the audio and the FFT.
+   */
+  int SetCaptureFile(const std::string &capture_file_name,
+                     uint32_t sample_rate, uint32_t hop_size);
 
   void Process(short *buffers[], size_t current_buffer_size, Monitor *monitor);
 
+  /**
+   * Processes complex samples, i.e. output of the decimating front end.
+   */
+  void Process(complex *buffers[], size_t current_buffer_size,
+               Monitor *monitor);
+
+  /**
+   * Computes the power spectrum of a window into spectrum[0, GetNumBins())
+   * without the detection, so that the FFT can run on another thread than
+   * ProcessSpectrum. It takes the float path.
+   */
+  void MakeSpectrum(short *buffers[], size_t current_buffer_size,
+                    float spectrum[]);
+  void MakeSpectrum(complex *buffers[], size_t current_buffer_size,
+                    float spectrum[]);
+
+  /**
+   * Whether MakeSpectrum can be batched for FFT_BATCH windows, which needs a
+   * power of two FFT size.
+   */
+  bool CanBatch() const;
+
+  /**
+   * MakeSpectrum in batches for offline decoding, where the windows are
+   * available ahead. Adds a window to the batch and returns true when the
+   * batch is full. TransformBatch then computes the power spectra of the
+   * windows in the batch into spectra, GetNumBins() each, returns their
+   * number and empties the batch.
+   */
+  bool AddToBatch(short *buffers[], size_t current_buffer_size);
+  bool AddToBatch(complex *buffers[], size_t current_buffer_size);
+  size_t TransformBatch(float spectra[]);
+
+  /**
+   * Runs the detection on a power spectrum, skipping the FFT; e.g. on a
+   * captured one.
+   */
+  void ProcessSpectrum(const float spectrum[], Monitor *monitor);
+
+  inline size_t GetNumBins() const { return num_bins_; }
+
   void Drain(Monitor *monitor);
 
+  /**
+   * Saves and loads the detection state and the reader for a checkpoint,
+   * between windows and with no batch pending. The loading detector must be
+   * made and set up like the saving one, e.g. with the frequency tracking
+   * and the integer path; LoadState returns false otherwise or if the state
+   * is broken.
+   */
+  void SaveState(StateWriter *writer) const;
+  bool LoadState(StateReader *reader);
+
 private:
-  void MakeBlackmanNuttallWindow(size_t window_size, float window[]);
+  /**
+   * Window and FFT of the float path. Returns the transformed window.
+   */
+  const complex *Transform(short *buffers[], size_t current_buffer_size);
+  const complex *Transform(complex *buffers[], size_t current_buffer_size);
+
+  /**
+   * Takes the spectrum of the transformed window, or of the integer input
+   * data with its exponent when data is nullptr.
+   */
+  void Analyze(Monitor *monitor, const complex *data, int exponent = 0);
+
+  void GetSearchRange(size_t *first, size_t *last);
+
+  /**
+   * Decides the window from the spectrum, or as silence after the squelch.
+   */
+  void Detect(Monitor *monitor, bool fixed_point, bool silent = false);
+
+  /**
+   * Tracks the noise floor with the energy of the newest hop, and returns
+   * true if the window is silent enough to skip the spectral analysis.
+   */
+  bool Squelch(double hop_energy);
+
+  /**
+   * Decides the signal of the current window from the filtered level.
+   * prev_signal is cleared if the past signal is amended.
+   */
+  uint8_t Decide(uint8_t *prev_signal, float *current_value, float *diff);
+  uint8_t DecideFixed(uint8_t *prev_signal, float *current_value,
+                      float *diff);
+  uint8_t DecideSilence(float *current_value, float *diff);
+
+  /**
+   * Clears the last dot length of signal as a missed drop. Returns false if
+   * the dot length is not known well enough.
+   */
+  bool Amend();
+
+  /**
+   * Gives the signal of a window to the reader, taking a snapshot of the
+   * reader beforehand when corrections are possible.
+   */
+  bool Feed(size_t window);
+
+  /**
+   * Rewinds the reader to a snapshot and feeds it again with the amended
+   * signals of the windows before end. Returns false without a usable
+   * snapshot.
+   */
+  bool Correct(size_t first_amended, size_t end);
+
+  inline bool CorrectionEnabled() const {
+    return parameters_.detection_delay < kMaxDetectionDelay;
+  }
+
+  void UpdateFixedThresholds();
 
   inline float Power(complex data) {
     return data.Re * data.Re + data.Im * data.Im;
@@ -64,8 +330,27 @@ private:
 
   float Filter(float data[], float coefficients[], size_t num_taps);
 
+  /**
+   * Returns the value of the frequency domain filter centered at the bin.
+   */
+  float FilterAt(size_t bin);
+  int64_t FixedFilterAt(size_t bin);
+
   float MakeInputData(complex input_data[], float window[], short *buffers[],
                       int n);
+
+  /**
+   * Puts input_data_ to the next lane of the batch.
+   */
+  bool AddInputToBatch();
+
+  float MakeInputData(complex input_data[], float window[], complex *buffers[],
+                      int n);
+
+  /**
+   * Makes the integer input data and returns its block exponent.
+   */
+  int MakeFixedInputData(short *buffers[], int n);
 };
 
 } // namespace morse
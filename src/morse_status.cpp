@@ -0,0 +1,199 @@
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <ncurses.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "status_segment.h"
+
+/**
+ * Shows the live status that read_morse --status publishes to a shared
+ * memory segment. The viewer can be started and stopped at any time without
+ * affecting the decoder, and waits for the segment when the decoder is not
+ * running.
+ */
+
+namespace {
+
+// refresh interval of the viewer
+const int kDefaultIntervalMs = 200;
+
+std::string Format(const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
+
+std::string Format(const char *format, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  return line;
+}
+
+// state is "running:", "ended:", or "stale:" for a decoder that died
+void FormatStatus(const morse::StatusBlock &status, const char *state,
+                  std::vector<std::string> *lines) {
+  lines->clear();
+  double seconds =
+      status.sample_rate > 0
+          ? static_cast<double>(status.num_samples) / status.sample_rate
+          : 0.0;
+  lines->push_back(Format(
+      "%s %.1f s of audio in %.1f s (%.1fx), %llu windows, %llu overruns",
+      state, seconds, status.elapsed,
+      status.elapsed > 0.0 ? seconds / status.elapsed : 0.0,
+      static_cast<unsigned long long>(status.num_windows),
+      static_cast<unsigned long long>(status.num_overruns)));
+  // the frequency is known only without the mixing down
+  std::string tone = Format("tone: bin %.1f", status.tone_bin);
+  if (status.decimation == 1 && status.fft_size > 0) {
+    tone += Format(" (%.0f Hz)",
+                   status.tone_bin * status.sample_rate / status.fft_size);
+  }
+  lines->push_back(Format("%s, level %g, %s", tone.c_str(), status.level,
+                          status.signal ? "mark" : "space"));
+  lines->push_back(Format("world lines: %u (peak %u), %llu characters "
+                          "committed",
+                          status.num_world_lines, status.peak_num_world_lines,
+                          static_cast<unsigned long long>(
+                              status.num_committed)));
+  lines->push_back(Format("committed: %s", status.committed));
+  lines->push_back("");
+  for (uint32_t i = 0;
+       i < status.num_hypotheses && i < morse::kStatusMaxHypotheses; ++i) {
+    const auto &hypothesis = status.hypotheses[i];
+    lines->push_back(Format("(%f) %f : %s", hypothesis.dot_length,
+                            hypothesis.confidence, hypothesis.characters));
+  }
+}
+
+/**
+ * Prints the status once. Returns -1 if the segment cannot be read.
+ */
+int PrintOnce(const std::string &name) {
+  morse::StatusViewer viewer{};
+  if (viewer.Attach(name) < 0) {
+    fprintf(stderr, "Attach failed: %s (%s)\n", name.c_str(), strerror(errno));
+    return -1;
+  }
+  // the final status is published before the segment is closed
+  bool closed = viewer.IsClosed();
+  bool stale = !closed && viewer.IsStale();
+  morse::StatusBlock status;
+  if (!viewer.Read(&status)) {
+    if (stale) {
+      fprintf(stderr, "stale segment: %s (the decoder has died)\n",
+              name.c_str());
+    } else {
+      fprintf(stderr, "nothing is published yet\n");
+    }
+    return -1;
+  }
+  std::vector<std::string> lines{};
+  FormatStatus(status,
+               stale    ? "stale:"
+               : closed ? "ended:"
+                        : "running:",
+               &lines);
+  for (const auto &line : lines) {
+    printf("%s\n", line.c_str());
+  }
+  return 0;
+}
+
+void Watch(const std::string &name, int interval_ms) {
+  initscr();
+  cbreak();
+  noecho();
+  curs_set(0);
+  timeout(interval_ms);
+
+  morse::StatusViewer viewer{};
+  morse::StatusBlock status;
+  bool has_status = false;
+  bool ended = false;
+  bool stale = false;
+  std::vector<std::string> lines{};
+  while (getch() != 'q') {
+    // the last status of a decoder that has ended stays until a new one
+    // publishes
+    if (!viewer.IsAttached() && viewer.Attach(name) == 0) {
+      ended = false;
+    }
+    if (viewer.IsAttached()) {
+      // the final status is published before the segment is closed
+      bool closed = viewer.IsClosed();
+      // a segment left by a decoder that died stays until a new decoder
+      // takes its name
+      stale = !closed && viewer.IsStale();
+      has_status |= viewer.Read(&status);
+      if (closed || stale) {
+        viewer.Detach();
+        ended = true;
+      }
+    }
+    erase();
+    if (has_status) {
+      FormatStatus(status,
+                   stale   ? "stale:"
+                   : ended ? "ended:"
+                           : "running:",
+                   &lines);
+      for (size_t i = 0; i < lines.size(); ++i) {
+        mvprintw(i, 0, "%s", lines[i].c_str());
+      }
+    } else if (stale) {
+      mvprintw(0, 0, "stale segment %s, waiting for a new decoder",
+               name.c_str());
+    } else {
+      mvprintw(0, 0, "waiting for %s", name.c_str());
+    }
+    mvprintw(LINES - 1, 0, "q to quit");
+    refresh();
+  }
+  endwin();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  bool once = false;
+  int interval_ms = kDefaultIntervalMs;
+  while (true) {
+    int c = getopt(argc, argv, "1i:");
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case '1':
+      once = true;
+      break;
+    case 'i':
+      interval_ms = std::max(10, atoi(optarg));
+      break;
+    }
+  }
+
+  if (optind + 1 != argc) {
+    fprintf(stderr, "Usage: %s [options] <segment_name>\n", basename(argv[0]));
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -1 : Print the status once and exit\n");
+    fprintf(stderr, "  -i <ms> : Refresh interval (default %d)\n",
+            kDefaultIntervalMs);
+    return 1;
+  }
+
+  std::string name = argv[optind];
+  if (once) {
+    return PrintOnce(name) < 0 ? 1 : 0;
+  }
+  Watch(name, interval_ms);
+  return 0;
+}
@@ -0,0 +1,80 @@
+#ifndef MORSE_PARAMETERS_H_
+#define MORSE_PARAMETERS_H_
+
+#include <stddef.h>
+
+namespace morse {
+
+class LanguageModel;
+
+/**
+ * Tunable values of MorseSignalDetector.
+ */
+struct DetectorParameters {
+  // filtered level that turns the signal on
+  float turn_on_level = 3.e10;
+  // the signal turns off when the level falls below peak / turn_off_ratio
+  float turn_off_ratio = 20.0;
+  // steep rise and drop relative to the peak
+  float rise_factor = 1.3;
+  float drop_factor = 1.3;
+  // minimum number of windows between toggles, avoids chattering
+  size_t min_toggle_interval = 2;
+  // windows a decision is held before the reader sees it, so that it can be
+  // amended; a shorter delay than the default makes the detector correct the
+  // reader instead
+  size_t detection_delay = 31;
+  // windows with less energy than the noise floor times this are taken as
+  // silence without the spectral analysis; 0 analyzes every window
+  float squelch_level = 0.0;
+};
+
+/**
+ * Tunable values of MorseReader and WorldLine. Ratios are multiples of the
+ * estimated dot length.
+ */
+struct ReaderParameters {
+  // shorter elements and gaps terminate the world line
+  double min_element_ratio = 0.3;
+  // elements and gaps longer than this are ambiguous and fork the world line
+  double ambiguous_ratio = 1.5;
+  // boundary between a dot and a dash
+  double dash_ratio = 2.3;
+  // boundary between an element gap and a character break
+  double break_ratio = 2.5;
+  // gap that makes a character break while the signal is off
+  double letter_space_ratio = 5.0;
+  // gap that makes a word space
+  double word_space_ratio = 7.0;
+  // longer marks terminate the world line
+  double max_dash_ratio = 7.0;
+  // confidence is halved after a break longer than this
+  double long_break_ratio = 10.0;
+  // the dot length is averaged over about this many dots of the latest
+  // elements and gaps, so that it follows the speed; 0 averages over the
+  // whole line
+  size_t dot_length_window = 1000;
+  // world lines less confident than the best by this ratio are dropped
+  double prune_ratio = 8.0;
+  // the least confident world lines beyond this number are dropped; 0 for
+  // no limit
+  size_t max_world_lines = 0;
+  // a world line at most 1 / dominance_ratio as confident as the most
+  // confident one is dominated by it; once that has lasted for commit_lead
+  // characters of the most confident line, the characters are committed
+  // without the line, which is dropped if it disagrees. With the ratio of 1,
+  // a line is dropped once it has not led for commit_lead characters; lines
+  // that tie with the most confident one for so long are readings the
+  // timing cannot tell apart. commit_lead 0 commits only the characters that
+  // all the world lines agree on
+  double dominance_ratio = 1.0;
+  size_t commit_lead = 32;
+  // scores the characters of the world lines when set, not owned; the
+  // confidence is multiplied by exp(language_weight * score)
+  const LanguageModel *language_model = nullptr;
+  double language_weight = 1.0;
+};
+
+} // namespace morse
+
+#endif // MORSE_PARAMETERS_H_
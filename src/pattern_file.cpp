@@ -0,0 +1,180 @@
+#include "pattern_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace morse {
+
+static const size_t kWriteBufferSize = 64 * 1024;
+static const size_t kHeaderSize = sizeof(kPatternFileMagic) + 1 + 4 + 4;
+
+static void PutUint32(uint8_t *dest, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    dest[i] = (value >> (8 * i)) & 0xff;
+  }
+}
+
+static uint32_t GetUint32(const uint8_t *src) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; ++i) {
+    value |= static_cast<uint32_t>(src[i]) << (8 * i);
+  }
+  return value;
+}
+
+PatternWriter::PatternWriter() { buffer_.reserve(kWriteBufferSize); }
+
+PatternWriter::~PatternWriter() { Close(); }
+
+int PatternWriter::Open(const std::string &file_name, uint32_t sample_rate,
+                        uint32_t hop_size) {
+  fd_ = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    return -1;
+  }
+  uint8_t header[kHeaderSize];
+  memcpy(header, kPatternFileMagic, sizeof(kPatternFileMagic));
+  header[4] = kPatternFileVersion;
+  PutUint32(header + 5, sample_rate);
+  PutUint32(header + 9, hop_size);
+  buffer_.insert(buffer_.end(), header, header + kHeaderSize);
+  return 0;
+}
+
+int PatternWriter::Close() {
+  if (fd_ < 0) {
+    return 0;
+  }
+  if (run_length_ > 0) {
+    PutRun();
+  }
+  int result = Flush();
+  if (close(fd_) < 0) {
+    result = -1;
+  }
+  fd_ = -1;
+  return result;
+}
+
+void PatternWriter::PutRun() {
+  PutVarint(level_);
+  PutVarint(run_length_);
+  run_length_ = 0;
+  if (buffer_.size() >= kWriteBufferSize - 32) {
+    Flush();
+  }
+}
+
+void PatternWriter::PutVarint(uint64_t value) {
+  while (value >= 0x80) {
+    buffer_.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  buffer_.push_back(static_cast<uint8_t>(value));
+}
+
+int PatternWriter::Flush() {
+  size_t written = 0;
+  while (written < buffer_.size()) {
+    ssize_t result =
+        write(fd_, buffer_.data() + written, buffer_.size() - written);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    written += result;
+  }
+  buffer_.clear();
+  return 0;
+}
+
+PatternReader::~PatternReader() {
+  if (data_ != nullptr) {
+    munmap(const_cast<uint8_t *>(data_), size_);
+  }
+}
+
+int PatternReader::Open(const std::string &file_name) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  size_ = st.st_size;
+  if (size_ > 0) {
+    void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      return -1;
+    }
+    data_ = static_cast<const uint8_t *>(data);
+    madvise(data, size_, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  if (size_ >= kHeaderSize &&
+      memcmp(data_, kPatternFileMagic, sizeof(kPatternFileMagic)) == 0) {
+    if (data_[4] != kPatternFileVersion) {
+      errno = EINVAL;
+      return -1;
+    }
+    binary_ = true;
+    sample_rate_ = GetUint32(data_ + 5);
+    hop_size_ = GetUint32(data_ + 9);
+    position_ = kHeaderSize;
+  }
+  return 0;
+}
+
+bool PatternReader::Next(uint8_t *level, uint64_t *num_windows) {
+  if (binary_) {
+    uint64_t value;
+    if (!GetVarint(&value) || !GetVarint(num_windows)) {
+      return false;
+    }
+    *level = value > 0 ? 1 : 0;
+    return true;
+  }
+
+  // legacy text format, characters other than '^' and '_' are ignored
+  uint64_t count = 0;
+  while (position_ < size_) {
+    char value = data_[position_];
+    if (value == '^' || value == '_') {
+      uint8_t current = value == '^' ? 1 : 0;
+      if (count > 0 && current != *level) {
+        break;
+      }
+      *level = current;
+      ++count;
+    }
+    ++position_;
+  }
+  *num_windows = count;
+  return count > 0;
+}
+
+bool PatternReader::GetVarint(uint64_t *value) {
+  uint64_t result = 0;
+  for (int shift = 0; position_ < size_ && shift < 64; shift += 7) {
+    uint8_t byte = data_[position_++];
+    result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace morse
@@ -0,0 +1,100 @@
+#ifndef MORSE_PATTERN_FILE_H_
+#define MORSE_PATTERN_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace morse {
+
+/*
+ * Binary pattern file is a run-length encoded sequence of detected levels.
+ *
+ *   header : "MPTN", version (1 byte), sample rate and hop size in samples
+ *            (4 bytes each, little endian)
+ *   runs   : level and number of windows of the run, as unsigned LEB128
+ *            varints, repeated until the end of file
+ *
+ * The reader also accepts the legacy text format, one '^' or '_' per window.
+ */
+static const char kPatternFileMagic[] = {'M', 'P', 'T', 'N'};
+static const uint8_t kPatternFileVersion = 1;
+
+class PatternWriter {
+private:
+  int fd_ = -1;
+  std::vector<uint8_t> buffer_;
+  uint8_t level_ = 0;
+  uint64_t run_length_ = 0;
+
+public:
+  PatternWriter();
+  virtual ~PatternWriter();
+
+  /**
+   * Opens the file and writes the header. Returns -1 on failure with errno
+   * set.
+   */
+  int Open(const std::string &file_name, uint32_t sample_rate,
+           uint32_t hop_size);
+
+  /**
+   * Adds the level of the next window.
+   */
+  inline void Add(uint8_t level) {
+    if (level != level_ && run_length_ > 0) {
+      PutRun();
+    }
+    level_ = level;
+    ++run_length_;
+  }
+
+  /**
+   * Writes out the last run and closes the file.
+   */
+  int Close();
+
+private:
+  void PutRun();
+  void PutVarint(uint64_t value);
+  int Flush();
+};
+
+class PatternReader {
+private:
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+  size_t position_ = 0;
+  bool binary_ = false;
+  uint32_t sample_rate_ = 0;
+  uint32_t hop_size_ = 0;
+
+public:
+  PatternReader() = default;
+  virtual ~PatternReader();
+
+  /**
+   * Maps the file into memory. Returns -1 on failure with errno set.
+   */
+  int Open(const std::string &file_name);
+
+  inline bool IsBinary() const { return binary_; }
+
+  // zero if unknown, i.e. legacy text format
+  inline uint32_t GetSampleRate() const { return sample_rate_; }
+  inline uint32_t GetHopSize() const { return hop_size_; }
+
+  /**
+   * Reads the next run. Returns false at the end of the pattern.
+   */
+  bool Next(uint8_t *level, uint64_t *num_windows);
+
+private:
+  bool GetVarint(uint64_t *value);
+};
+
+} // namespace morse
+
+#endif // MORSE_PATTERN_FILE_H_
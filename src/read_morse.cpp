@@ -3,85 +3,552 @@
 #include <getopt.h>
 #include <libgen.h>
 #include <math.h>
-#include <ncurses.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sndfile.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <pulse/error.h>
 #include <pulse/simple.h>
 
+#include "activity_index.h"
+#include "analysis_plan.h"
+#include "batch_fft.h"
+#include "block_queue.h"
+#include "channel_decoder.h"
+#include "checkpoint.h"
+#include "curses_monitor.h"
+#include "deadline_monitor.h"
+#include "ensemble_decoder.h"
 #include "fft.h"
-#include "monitor.h"
+#include "language_model.h"
 #include "morse_reader.h"
 #include "morse_signal_detector.h"
+#include "pattern_file.h"
+#include "spectrum_capture.h"
+#include "spsc_queue.h"
+#include "status_segment.h"
 
-#define BUFFER_SIZE 256
-#define DEFAULT_NUM_BUFFERS 2
+#define MAX_DECIMATION 32
+
+// multi-channel input is handed to the channel threads in blocks of hops
+static const size_t kHopsPerBlock = 64;
+static const size_t kQueueCapacity = 8;
+
+struct SampleBlock {
+  std::vector<short> samples{};
+  bool last = false;
+};
 
 /**
- * Read morse signals from pattern file instead of analysing wav.
+ * Decodes a block of hops read ahead of the decoding, with the windows
+ * transformed in batches. spectra is kept across blocks to save allocations.
  */
-void ReadFile(int fd, ::morse::MorseReader *reader) {
-  auto *monitor = new morse::Monitor();
-
-  const size_t kBufSize = 1024;
-  char buffer[kBufSize];
-
-  int length;
-  uint8_t prev_level = 0;
-  while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
-    for (int i = 0; i < length; ++i) {
-      usleep(10000);
-      char value = buffer[i];
-      monitor->AddSignal(value);
-      uint8_t level;
-      switch (value) {
-      case '^':
-        level = 1;
-        break;
-      case '_':
-        level = 0;
+void DecodeBlock(morse::ChannelDecoder *channel, const SampleBlock &block,
+                 size_t hop_size, std::vector<float> *spectra,
+                 morse::Monitor *monitor) {
+  size_t num_bins = channel->GetDetector()->GetNumBins();
+  size_t num_hops = block.samples.size() / hop_size;
+  spectra->resize(num_bins * (num_hops + 1));
+  const short *samples = block.samples.data();
+  size_t num_spectra = channel->AnalyzeHops(samples, num_hops, spectra->data());
+  size_t offset = num_hops * hop_size;
+  if (block.last &&
+      channel->Analyze(samples + offset, block.samples.size() - offset,
+                       spectra->data() + num_spectra * num_bins)) {
+    ++num_spectra;
+  }
+  for (size_t i = 0; i < num_spectra; ++i) {
+    channel->Detect(spectra->data() + i * num_bins, monitor);
+  }
+}
+
+/**
+ * Channel thread body. Runs the decoder over blocks of the channel's samples
+ * until the last block arrives. The integer path takes the windows one by
+ * one since the batches are transformed in floating point.
+ */
+void DecodeChannel(morse::ChannelDecoder *channel,
+                   morse::BlockQueue<SampleBlock> *queue, size_t hop_size,
+                   bool batch) {
+  std::vector<float> spectra{};
+  while (true) {
+    SampleBlock block = queue->Pop();
+    if (batch) {
+      DecodeBlock(channel, block, hop_size, &spectra, nullptr);
+      if (block.last) {
         break;
-      default:
-        // ignore
-        continue;
       }
-      reader->Update(level);
-      if (prev_level != level) {
-        monitor->Dump(reader);
+      continue;
+    }
+    const short *samples = block.samples.data();
+    size_t offset = 0;
+    for (; offset + hop_size <= block.samples.size(); offset += hop_size) {
+      channel->Process(samples + offset, hop_size, nullptr);
+    }
+    if (block.last) {
+      channel->Process(samples + offset, block.samples.size() - offset,
+                       nullptr);
+      break;
+    }
+  }
+  channel->Drain(nullptr);
+}
+
+// a single channel may run as a pipeline of the reading thread, the spectral
+// thread (front end and FFT), and the detection thread (detector and reader),
+// connected by queues of blocks of hops
+static const size_t kPipelineHopsPerBlock = 8;
+static const size_t kPipelineCapacity = 16;
+static const size_t kNumPipelineStages = 3;
+
+struct SpectrumBlock {
+  // num_windows spectra of the detector's number of bins each
+  std::vector<float> spectra{};
+  size_t num_windows = 0;
+  bool last = false;
+};
+
+/**
+ * Spectral stage of the pipeline.
+ */
+void AnalyzeChannel(morse::ChannelDecoder *channel,
+                    morse::SpscQueue<SampleBlock> *input,
+                    morse::SpscQueue<SpectrumBlock> *output, size_t hop_size) {
+  size_t num_bins = channel->GetDetector()->GetNumBins();
+  while (true) {
+    SampleBlock block = input->Pop();
+    SpectrumBlock spectra{};
+    spectra.spectra.resize(num_bins * (block.samples.size() / hop_size + 1));
+    const short *samples = block.samples.data();
+    size_t num_hops = block.samples.size() / hop_size;
+    spectra.num_windows =
+        channel->AnalyzeHops(samples, num_hops, spectra.spectra.data());
+    size_t offset = num_hops * hop_size;
+    if (block.last &&
+        channel->Analyze(samples + offset, block.samples.size() - offset,
+                         &spectra.spectra[spectra.num_windows * num_bins])) {
+      ++spectra.num_windows;
+    }
+    spectra.last = block.last;
+    output->Push(std::move(spectra));
+    if (block.last) {
+      break;
+    }
+  }
+}
+
+/**
+ * Detection stage of the pipeline.
+ */
+void DetectChannel(morse::ChannelDecoder *channel,
+                   morse::SpscQueue<SpectrumBlock> *input,
+                   morse::Monitor *monitor) {
+  size_t num_bins = channel->GetDetector()->GetNumBins();
+  while (true) {
+    SpectrumBlock block = input->Pop();
+    for (size_t i = 0; i < block.num_windows; ++i) {
+      channel->Detect(&block.spectra[i * num_bins], monitor);
+    }
+    if (block.last) {
+      break;
+    }
+  }
+  channel->Drain(monitor);
+}
+
+/**
+ * Pins a thread to a CPU. Returns -1 with errno set on failure.
+ */
+int PinThread(pthread_t thread, int cpu) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  int result = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+  if (result != 0) {
+    errno = result;
+    return -1;
+  }
+  return 0;
+}
+
+template <typename T>
+void PrintQueueStats(const char *name, const morse::SpscQueue<T> &queue) {
+  fprintf(stderr,
+          "%-17s: %ld blocks, occupancy %.1f on average, %ld at most of %ld, "
+          "full %ld times, empty %ld times\n",
+          name, queue.GetNumPushes(), queue.GetAverageOccupancy(),
+          queue.GetMaxOccupancy(), queue.GetCapacity(),
+          queue.GetNumFullWaits(), queue.GetNumEmptyWaits());
+}
+
+// reader parameters by the load level of DeadlineMonitor; level 1 only
+// pauses the monitor, the higher levels prune the world lines harder and cap
+// their number so that a fork storm cannot hold up the audio
+struct LoadLevel {
+  double prune_ratio;
+  size_t max_world_lines;
+};
+static const LoadLevel kLoadLevels[morse::DeadlineMonitor::kMaxLevel + 1] = {
+    {0.0, 0}, {0.0, 0}, {4.0, 32}, {2.0, 8}};
+
+/**
+ * Sets the reader parameters for the load level, base being those of the
+ * full quality.
+ */
+void ShedLoad(morse::MorseReader *reader,
+              const morse::ReaderParameters &base, int level) {
+  morse::ReaderParameters parameters = base;
+  const LoadLevel &load = kLoadLevels[level];
+  if (load.prune_ratio > 0.0) {
+    parameters.prune_ratio = std::min(base.prune_ratio, load.prune_ratio);
+  }
+  if (load.max_world_lines > 0) {
+    parameters.max_world_lines =
+        base.max_world_lines > 0
+            ? std::min(base.max_world_lines, load.max_world_lines)
+            : load.max_world_lines;
+  }
+  reader->SetParameters(parameters);
+}
+
+inline double ElapsedSeconds(const struct timespec &start,
+                             const struct timespec &end) {
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1.e-9;
+}
+
+/**
+ * Read morse signals from pattern file instead of analysing wav. The pattern
+ * is replayed at full speed.
+ */
+int ReadFile(const char *file_name, ::morse::MorseReader *reader,
+             bool headless) {
+  morse::PatternReader pattern{};
+  if (pattern.Open(file_name) < 0) {
+    return -1;
+  }
+
+  morse::Monitor *monitor = headless ? nullptr : new morse::CursesMonitor();
+  uint8_t level;
+  uint64_t num_windows;
+  while (pattern.Next(&level, &num_windows)) {
+    for (uint64_t i = 0; i < num_windows; ++i) {
+      if (monitor != nullptr) {
+        monitor->AddSignal(level ? '^' : '_');
       }
-      prev_level = level;
+      reader->Update(level);
+    }
+    if (monitor != nullptr) {
+      monitor->Dump(reader);
     }
   }
-  monitor->Dump(reader);
-  delete monitor;
+
+  if (monitor != nullptr) {
+    monitor->Dump(reader);
+    delete monitor;
+  } else {
+    printf("%s\n", reader->GetCharacters().c_str());
+  }
+  return 0;
+}
+
+/**
+ * Run the signal detection on a spectrum capture file instead of analysing
+ * wav.
+ */
+int ReadCapture(const morse::SpectrumCaptureReader &capture, size_t center_freq,
+                const morse::ReaderParameters &reader_parameters, bool afc,
+                bool headless) {
+  const auto &header = capture.GetHeader();
+  auto *morse_reader = new ::morse::MorseReader(reader_parameters);
+  // a single buffer of the FFT size gives the bins of the capture
+  auto *signal_detector = new ::morse::MorseSignalDetector(
+      morse_reader, 1, header.fft_size, center_freq);
+  if (signal_detector->GetNumBins() != header.num_bins) {
+    fprintf(stderr, "inconsistent capture: %u bins for FFT size %u\n",
+            header.num_bins, header.fft_size);
+    delete signal_detector;
+    return -1;
+  }
+  if (center_freq + 2 >= header.num_bins) {
+    fprintf(stderr, "center bin %zu is outside the %u bins of the capture\n",
+            center_freq, header.num_bins);
+    delete signal_detector;
+    return -1;
+  }
+  if (afc) {
+    signal_detector->EnableFrequencyTracking(true);
+  }
+
+  morse::Monitor *monitor = headless ? nullptr : new morse::CursesMonitor();
+  for (size_t i = 0; i < capture.GetNumWindows(); ++i) {
+    signal_detector->ProcessSpectrum(capture.GetWindow(i), monitor);
+  }
+  signal_detector->Drain(monitor);
+
+  if (monitor != nullptr) {
+    monitor->Dump(morse_reader);
+    delete monitor;
+  } else {
+    printf("%s\n", morse_reader->GetCharacters().c_str());
+  }
+  delete signal_detector;
+  return 0;
+}
+
+/**
+ * Reads up to num_frames frames and keeps the first channel in samples.
+ * Returns the number of frames read.
+ */
+sf_count_t ReadFirstChannel(SNDFILE *sndfile, const SF_INFO &sf_info,
+                            std::vector<short> *frames, size_t num_frames,
+                            short samples[]) {
+  frames->resize(num_frames * sf_info.channels);
+  sf_count_t num_read = sf_readf_short(sndfile, frames->data(), num_frames);
+  for (sf_count_t i = 0; i < num_read; ++i) {
+    samples[i] = (*frames)[i * sf_info.channels];
+  }
+  return num_read;
+}
+
+/**
+ * Coarse pass over the first channel that writes the activity index.
+ */
+int MakeIndex(SNDFILE *sndfile, const SF_INFO &sf_info,
+              const morse::AnalysisPlan &plan, const std::string &file_name,
+              bool verbose) {
+  morse::ActivityScanner scanner(plan.hop_size, plan.fft_size,
+                                 sf_info.samplerate);
+  std::vector<short> frames{};
+  std::vector<short> samples(plan.hop_size);
+  sf_count_t num_frames;
+  do {
+    num_frames = ReadFirstChannel(sndfile, sf_info, &frames, plan.hop_size,
+                                  samples.data());
+    scanner.Process(samples.data(), num_frames);
+  } while (num_frames == static_cast<sf_count_t>(plan.hop_size));
+
+  const auto &intervals = scanner.GetIntervals();
+  if (morse::WriteActivityIndex(file_name, sf_info.samplerate, plan.hop_size,
+                                plan.fft_size, intervals) < 0) {
+    fprintf(stderr, "File write failed: %s (%s)\n", file_name.c_str(),
+            strerror(errno));
+    return -1;
+  }
+  if (verbose) {
+    for (const auto &interval : intervals) {
+      fprintf(stderr, "%9.1f - %9.1f s: bin %u, dot %.1f ms\n",
+              interval.start_sample / static_cast<double>(sf_info.samplerate),
+              interval.end_sample / static_cast<double>(sf_info.samplerate),
+              interval.bin,
+              interval.dot_length * 1000.0 / sf_info.samplerate);
+    }
+  }
+  fprintf(stderr, "%ld active intervals\n", intervals.size());
+  return 0;
+}
+
+// a range is decoded from a little before its start so that the window and
+// the filters are filled, and for a while after its end so that the last
+// character is concluded
+static const double kRangePreroll = 0.5;
+static const double kRangeTail = 1.0;
+
+struct TimeRange {
+  // [start, end) in samples
+  uint64_t start;
+  uint64_t end;
+  size_t center_bin;
+  // dot length in samples to start the reader with; 0 when unknown
+  double dot_length;
+};
+
+/**
+ * Decodes time ranges of the first channel, each by a fresh decoder, and
+ * prints the characters of each range with its start time.
+ */
+int DecodeRanges(SNDFILE *sndfile, const SF_INFO &sf_info,
+                 const morse::AnalysisPlan &plan,
+                 const std::vector<TimeRange> &ranges, size_t decimation,
+                 const morse::DetectorParameters &parameters,
+                 const morse::ReaderParameters &reader_parameters, bool afc,
+                 bool fixed_point) {
+  const size_t hop_size = plan.hop_size;
+  std::vector<short> frames{};
+  std::vector<short> samples(hop_size);
+  for (const auto &range : ranges) {
+    uint64_t preroll = kRangePreroll * sf_info.samplerate;
+    uint64_t start = range.start > preroll ? range.start - preroll : 0;
+    uint64_t end = std::min<uint64_t>(
+        range.end + kRangeTail * sf_info.samplerate, sf_info.frames);
+    if (sf_seek(sndfile, start, SEEK_SET) < 0) {
+      fprintf(stderr, "seek failed: %s\n", sf_strerror(sndfile));
+      return -1;
+    }
+
+    morse::ChannelDecoder channel(plan.num_buffers, hop_size, range.center_bin,
+                                  decimation, sf_info.samplerate);
+    auto *signal_detector = channel.GetDetector();
+    signal_detector->SetParameters(parameters);
+    channel.GetReader()->SetParameters(reader_parameters);
+    if (afc) {
+      signal_detector->EnableFrequencyTracking(true);
+    }
+    if (fixed_point && signal_detector->EnableFixedPoint() < 0) {
+      fprintf(stderr, "fixed point detection needs a power of two FFT size\n");
+      return -1;
+    }
+    if (range.dot_length > 0.0) {
+      channel.GetReader()->SetDotLength(range.dot_length / hop_size);
+    }
+
+    uint64_t position = start;
+    sf_count_t num_frames;
+    do {
+      size_t n = std::min<uint64_t>(hop_size, end - position);
+      num_frames =
+          ReadFirstChannel(sndfile, sf_info, &frames, n, samples.data());
+      position += num_frames;
+      channel.Process(samples.data(), num_frames, nullptr);
+    } while (num_frames == static_cast<sf_count_t>(hop_size));
+    channel.Drain(nullptr);
+
+    unsigned seconds = range.start / sf_info.samplerate;
+    printf("[%02u:%02u:%02u] %s\n", seconds / 3600, seconds / 60 % 60,
+           seconds % 60, channel.GetReader()->GetCharacters().c_str());
+  }
+  return 0;
+}
+
+// seconds of audio between checkpoints
+static const double kCheckpointInterval = 10.0;
+
+/**
+ * Saves the state of a single channel with the position in the input file,
+ * in frames, where the decoding resumes. Returns -1 on failure with errno set.
+ */
+int SaveChannel(const std::string &file_name,
+                const morse::ChannelDecoder &channel, uint64_t position) {
+  morse::StateWriter writer{};
+  writer.Put(position);
+  channel.SaveState(&writer);
+  return morse::SaveCheckpoint(file_name, writer);
+}
+
+// wall clock seconds between updates of the status segment
+static const double kStatusInterval = 0.1;
+
+/**
+ * Publishes the status of the decoding between hops.
+ */
+void PublishStatus(morse::StatusPublisher *publisher,
+                   const morse::MorseSignalDetector &detector,
+                   morse::MorseReader *reader, uint64_t num_samples,
+                   double elapsed, size_t num_overruns) {
+  morse::StatusBlock *status = publisher->GetStatus();
+  status->num_samples = num_samples;
+  status->elapsed = elapsed;
+  status->num_overruns = num_overruns;
+  publisher->CollectDetector(detector);
+  publisher->CollectReader(reader);
+  publisher->Publish();
+}
+
+/**
+ * Restores a channel set up like the saved one and gives the position to
+ * resume from. Returns -1 on failure with errno set, EINVAL if the
+ * checkpoint is broken or does not fit the channel.
+ */
+int ResumeChannel(const std::string &file_name, morse::ChannelDecoder *channel,
+                  uint64_t *position) {
+  std::vector<uint8_t> state{};
+  if (morse::LoadCheckpoint(file_name, &state) < 0) {
+    return -1;
+  }
+  morse::StateReader reader(state.data(), state.size());
+  if (!reader.Get(position) || !channel->LoadState(&reader) ||
+      !reader.AtEnd()) {
+    errno = EINVAL;
+    return -1;
+  }
+  return 0;
 }
 
 int main(int argc, char *argv[]) {
   // read arguments
   std::string pattern_file_name{};
   std::string analysis_file_name{};
+  std::string capture_file_name{};
+  std::string make_index_file_name{};
+  std::string index_file_name{};
+  double range_from = -1.0;
+  double range_to = -1.0;
   bool verbose = false;
   int mute = 0;
-  size_t center_freq = 12;
-  size_t num_buffers = DEFAULT_NUM_BUFFERS;
+  int afc = 0;
+  int headless = 0;
+  int with_spectrum = 0;
+  int fixed_point = 0;
+  int pipeline = 0;
+  std::vector<int> stage_cpus{};
+  bool center_freq_given = false;
+  size_t center_freq = 11;
+  size_t num_buffers = 0;
+  morse::AnalysisSettings analysis_settings{};
+  bool tone_given = false;
+  size_t decimation = 1;
+  morse::DetectorParameters detector_parameters{};
+  morse::ReaderParameters reader_parameters{};
+  std::string model_file_name{};
+  std::string checkpoint_file_name{};
+  std::string resume_file_name{};
+  std::vector<size_t> ensemble_buffers{};
+  std::string status_name{};
   while (true) {
     static struct option long_options[] = {
         {"record", required_argument, nullptr, 'r'},
         {"analyze", required_argument, nullptr, 'a'},
+        {"capture", required_argument, nullptr, 'c'},
         {"mute", no_argument, &mute, 1},
+        {"afc", no_argument, &afc, 1},
+        {"headless", no_argument, &headless, 1},
+        {"spectrum", no_argument, &with_spectrum, 1},
+        {"fixed-point", no_argument, &fixed_point, 1},
+        {"pipeline", no_argument, &pipeline, 1},
+        {"pin", required_argument, nullptr, 'P'},
         {"center-freq", required_argument, nullptr, 'f'},
+        {"tone", required_argument, nullptr, 't'},
+        {"wpm", required_argument, nullptr, 'w'},
+        {"resolution", required_argument, nullptr, 'R'},
         {"num-buffers", required_argument, nullptr, 'b'},
+        {"decimate", required_argument, nullptr, 'd'},
+        {"delay", required_argument, nullptr, 'D'},
+        {"squelch", required_argument, nullptr, 'S'},
+        {"make-index", required_argument, nullptr, 'I'},
+        {"index", required_argument, nullptr, 'i'},
+        {"from", required_argument, nullptr, 'F'},
+        {"to", required_argument, nullptr, 'T'},
+        {"model", required_argument, nullptr, 'm'},
+        {"checkpoint", required_argument, nullptr, 'C'},
+        {"resume", required_argument, nullptr, 'u'},
+        {"ensemble", required_argument, nullptr, 'E'},
+        {"status", required_argument, nullptr, 's'},
         {0, 0, 0, 0},
     };
-    int c = getopt_long(argc, argv, "r:a:f:b:v", long_options, nullptr);
+    int c = getopt_long(argc, argv,
+                        "r:a:c:f:t:w:R:b:d:D:S:I:i:F:T:m:C:u:E:s:P:v",
+                        long_options, nullptr);
     if (c == -1) {
       break;
     }
@@ -92,13 +559,31 @@ int main(int argc, char *argv[]) {
     case 'a':
       analysis_file_name = optarg;
       break;
+    case 'c':
+      capture_file_name = optarg;
+      break;
     case 'f':
+      center_freq_given = true;
       center_freq = atol(optarg);
-      if (center_freq <= 2 || center_freq > 30) {
-        fprintf(stderr, "center frequency must be in the range of [3:20]\n");
+      if (center_freq <= 2) {
+        fprintf(stderr, "center frequency bin must be at least 3\n");
+        return 1;
+      }
+      break;
+    case 't':
+      tone_given = true;
+      analysis_settings.tone_frequency = atof(optarg);
+      break;
+    case 'w':
+      analysis_settings.max_wpm = atof(optarg);
+      if (analysis_settings.max_wpm <= 0) {
+        fprintf(stderr, "speed must be positive\n");
         return 1;
       }
       break;
+    case 'R':
+      analysis_settings.time_resolution = atof(optarg);
+      break;
     case 'b':
       num_buffers = atol(optarg);
       if (num_buffers < 1) {
@@ -106,6 +591,77 @@ int main(int argc, char *argv[]) {
         return 1;
       }
       break;
+    case 'd':
+      decimation = atol(optarg);
+      if (decimation < 1 || decimation > MAX_DECIMATION ||
+          (decimation & (decimation - 1)) != 0) {
+        fprintf(stderr, "decimation factor must be a power of two up to %d\n",
+                MAX_DECIMATION);
+        return 1;
+      }
+      break;
+    case 'D':
+      detector_parameters.detection_delay = atol(optarg);
+      if (detector_parameters.detection_delay >
+          morse::MorseSignalDetector::kMaxDetectionDelay) {
+        fprintf(stderr, "detection delay must be up to %ld windows\n",
+                morse::MorseSignalDetector::kMaxDetectionDelay);
+        return 1;
+      }
+      break;
+    case 'S':
+      detector_parameters.squelch_level = atof(optarg);
+      break;
+    case 'I':
+      make_index_file_name = optarg;
+      break;
+    case 'i':
+      index_file_name = optarg;
+      break;
+    case 'F':
+      range_from = atof(optarg);
+      break;
+    case 'T':
+      range_to = atof(optarg);
+      break;
+    case 'm':
+      model_file_name = optarg;
+      break;
+    case 'C':
+      checkpoint_file_name = optarg;
+      break;
+    case 'u':
+      resume_file_name = optarg;
+      break;
+    case 'E':
+      for (char *hops = optarg; *hops != '\0';) {
+        char *end;
+        long value = strtol(hops, &end, 10);
+        if (end == hops || value < 1) {
+          fprintf(stderr, "--ensemble takes window lengths in hops separated "
+                          "by commas\n");
+          return 1;
+        }
+        ensemble_buffers.push_back(value);
+        hops = *end == ',' ? end + 1 : end;
+      }
+      break;
+    case 's':
+      status_name = optarg;
+      break;
+    case 'P':
+      for (char *cpu = optarg; *cpu != '\0';) {
+        char *end;
+        stage_cpus.push_back(strtol(cpu, &end, 10));
+        if (end == cpu || stage_cpus.size() > kNumPipelineStages) {
+          fprintf(stderr, "--pin takes up to %ld CPU numbers separated by "
+                          "commas\n",
+                  kNumPipelineStages);
+          return 1;
+        }
+        cpu = *end == ',' ? end + 1 : end;
+      }
+      break;
     case 'v':
       verbose = true;
       break;
@@ -121,17 +677,116 @@ int main(int argc, char *argv[]) {
     fprintf(
         stderr,
         "  --analyze|-a <plot_file>   : Print signal detection data to file\n");
+    fprintf(stderr, "  --spectrum                 : Include the filtered "
+                    "spectrum in the analysis file\n");
+    fprintf(stderr, "  --capture|-c <capture_file>: Save power spectrum for "
+                    "re-running detection\n");
     fprintf(stderr, "  --mute                     : Stop sound output for "
                     "faster execution\n");
     fprintf(stderr, "  --center-freq|-f           : Specifies center "
-                    "frequency, default=12\n");
+                    "frequency bin instead of --tone; the bin is of the "
+                    "planned FFT, which depends on the sample rate, --wpm "
+                    "and --buffers (see --verbose)\n");
+    fprintf(stderr, "  --tone|-t <Hz>             : Frequency of the tone, "
+                    "default=950\n");
+    fprintf(stderr, "  --wpm|-w <wpm>             : Fastest expected speed, "
+                    "default=40\n");
+    fprintf(stderr, "  --resolution|-R <ms>       : Longest hop if shorter "
+                    "than the speed needs\n");
+    fprintf(stderr, "  --num-buffers|-b <hops>    : Window length in hops "
+                    "instead of the planned one\n");
+    fprintf(stderr, "  --decimate|-d <factor>     : Mix down and decimate "
+                    "before analysis, default=1\n");
+    fprintf(stderr, "  --afc                      : Track the tone frequency, "
+                    "-f gives the initial lock\n");
+    fprintf(stderr, "  --headless                 : Run without the "
+                    "monitor, e.g. with --status\n");
+    fprintf(stderr, "  --fixed-point              : Detect with integer "
+                    "arithmetic, not with -d\n");
+    fprintf(stderr, "  --pipeline                 : Run reading, FFT, and "
+                    "detection on their own threads\n");
+    fprintf(stderr, "  --pin <cpu>[,<cpu>...]     : Pin the pipeline threads "
+                    "in that order\n");
+    fprintf(stderr, "  --delay|-D <windows>       : Windows to wait before "
+                    "deciding a signal, default=31\n");
+    fprintf(stderr, "  --squelch|-S <ratio>       : Skip the analysis of "
+                    "windows below the noise floor\n"
+                    "                               times this, default=0 "
+                    "(off)\n");
+    fprintf(stderr, "  --make-index|-I <file>     : Write the intervals of "
+                    "tone activity and exit\n");
+    fprintf(stderr, "  --index|-i <file>          : Decode only the active "
+                    "intervals of an index\n");
+    fprintf(stderr, "  --from|-F <s> --to|-T <s>  : Decode only the time "
+                    "range, with --index too\n");
+    fprintf(stderr, "  --model|-m <model_file>    : Score the readings with "
+                    "a language model\n");
+    fprintf(stderr, "  --checkpoint|-C <file>     : Save the decoding state "
+                    "every %.0f s of audio\n",
+            kCheckpointInterval);
+    fprintf(stderr, "  --resume|-u <file>         : Resume the decoding from "
+                    "a checkpoint\n");
+    fprintf(stderr, "  --ensemble|-E <hops>[,...] : Decode with several "
+                    "window lengths at once and fuse\n"
+                    "                               their decisions\n");
+    fprintf(stderr, "  --status|-s <name>         : Publish the live status "
+                    "to a shared memory\n"
+                    "                               segment, e.g. /morse\n");
     exit(1);
   }
 
-  auto input_file_name = argv[optind++];
+  if (fixed_point && decimation > 1) {
+    fprintf(stderr, "fixed point detection does not support decimation\n");
+    return 1;
+  }
+  if (detector_parameters.squelch_level > 0.0 && pipeline) {
+    fprintf(stderr, "squelch does not apply to the pipeline\n");
+    return 1;
+  }
+  bool ranges = !index_file_name.empty() || range_from >= 0.0 ||
+                range_to >= 0.0;
+  if (ranges && (pipeline || !pattern_file_name.empty() ||
+                 !analysis_file_name.empty() || !capture_file_name.empty())) {
+    fprintf(stderr, "time ranges are decoded without output files or the "
+                    "pipeline\n");
+    return 1;
+  }
+  if (fixed_point && pipeline) {
+    fprintf(stderr, "fixed point detection does not run as a pipeline\n");
+    return 1;
+  }
+  bool checkpoint = !checkpoint_file_name.empty() || !resume_file_name.empty();
+  if (checkpoint && (pipeline || ranges)) {
+    fprintf(stderr, "checkpoints are taken without the pipeline or time "
+                    "ranges\n");
+    return 1;
+  }
+  bool ensemble_given = !ensemble_buffers.empty();
+  if (ensemble_given &&
+      (pipeline || ranges || checkpoint || !pattern_file_name.empty() ||
+       !analysis_file_name.empty() || !capture_file_name.empty())) {
+    fprintf(stderr, "the ensemble runs without output files, the pipeline, "
+                    "time ranges, or checkpoints\n");
+    return 1;
+  }
+  if (!status_name.empty() && (pipeline || ranges)) {
+    fprintf(stderr, "the status is published without the pipeline or time "
+                    "ranges\n");
+    return 1;
+  }
 
-  // make morse timing tracker
-  auto *morse_reader = new ::morse::MorseReader();
+  // the model outlives the readers
+  static morse::LanguageModel language_model{};
+  if (!model_file_name.empty()) {
+    if (language_model.Open(model_file_name) < 0) {
+      fprintf(stderr, "File error: %s: %s\n", model_file_name.c_str(),
+              strerror(errno));
+      return 1;
+    }
+    reader_parameters.language_model = &language_model;
+  }
+
+  auto input_file_name = argv[optind++];
 
   // setup input file
   SF_INFO sf_info = {0};
@@ -146,13 +801,26 @@ int main(int argc, char *argv[]) {
       return 1;
     }
     */
-    int fd = open(input_file_name, 0);
-    if (fd < 0) {
+    morse::SpectrumCaptureReader capture{};
+    if (capture.Open(input_file_name) == 0) {
+      size_t center = center_freq_given ? center_freq
+                                        : capture.GetHeader().center_bin;
+      return ReadCapture(capture, center, reader_parameters, afc, headless) < 0
+                 ? 1
+                 : 0;
+    } else if (errno != EINVAL) {
+      fprintf(stderr, "File error: %s: %s\n", input_file_name, strerror(errno));
+      return 1;
+    }
+
+    // make morse timing tracker
+    auto *morse_reader = new ::morse::MorseReader(reader_parameters);
+    int result = ReadFile(input_file_name, morse_reader, headless);
+    delete morse_reader;
+    if (result < 0) {
       fprintf(stderr, "File error: %s: %s\n", input_file_name, strerror(errno));
       return 1;
     }
-    ReadFile(fd, morse_reader);
-    close(fd);
     return 0;
   }
 
@@ -164,8 +832,137 @@ int main(int argc, char *argv[]) {
     fprintf(stderr, "format     = 0x%x\n", sf_info.format);
   }
 
+  // size the analysis for the sample rate
+  morse::AnalysisPlan plan;
+  analysis_settings.num_buffers = num_buffers;
+  analysis_settings.center_bin = center_freq_given ? center_freq : 0;
+  if (morse::PlanAnalysis(analysis_settings, sf_info.samplerate, &plan) < 0) {
+    if (center_freq_given) {
+      fprintf(stderr, "center bin %ld cannot be analysed at %d Hz\n",
+              center_freq, sf_info.samplerate);
+    } else {
+      fprintf(stderr, "tone of %.0f Hz cannot be analysed at %d Hz\n",
+              analysis_settings.tone_frequency, sf_info.samplerate);
+    }
+    return 1;
+  }
+  center_freq = plan.center_bin;
+  // the members of an ensemble scale the thresholds for their own windows
+  const morse::DetectorParameters unscaled_parameters = detector_parameters;
+  detector_parameters = plan.Scale(detector_parameters);
+  const size_t hop_size = plan.hop_size;
+  if (hop_size / decimation < 4) {
+    fprintf(stderr, "decimation factor must be up to %ld at this rate\n",
+            hop_size / 4);
+    return 1;
+  }
+  if (!morse::ChannelDecoder::CanAnalyze(plan.num_buffers, hop_size,
+                                         center_freq, decimation)) {
+    fprintf(stderr, "window of %ld hops decimated by %ld cannot resolve the "
+                    "tone\n",
+            plan.num_buffers, decimation);
+    return 1;
+  }
+  if (verbose) {
+    fprintf(stderr, "hop        = %ld (%.1f ms)\n", hop_size,
+            plan.hop_duration);
+    fprintf(stderr, "fft size   = %ld (%.1f Hz per bin)\n", plan.fft_size,
+            sf_info.samplerate / static_cast<double>(plan.fft_size));
+    fprintf(stderr, "center bin = %ld\n", center_freq);
+  }
+
+  // the index and the time ranges look at the first channel only
+  if (!make_index_file_name.empty()) {
+    int result = MakeIndex(sndfile, sf_info, plan, make_index_file_name,
+                           verbose);
+    sf_close(sndfile);
+    return result < 0 ? 1 : 0;
+  }
+  if (ranges) {
+    uint64_t from = range_from > 0.0 ? range_from * sf_info.samplerate : 0;
+    uint64_t to = range_to >= 0.0 ? range_to * sf_info.samplerate
+                                  : static_cast<uint64_t>(sf_info.frames);
+    std::vector<TimeRange> time_ranges{};
+    if (index_file_name.empty()) {
+      time_ranges.push_back(TimeRange{from, to, center_freq, 0.0});
+    } else {
+      morse::ActivityHeader header;
+      std::vector<morse::ActivityInterval> intervals{};
+      if (morse::ReadActivityIndex(index_file_name, &header, &intervals) < 0) {
+        fprintf(stderr, "File error: %s: %s\n", index_file_name.c_str(),
+                strerror(errno));
+        return 1;
+      }
+      if (header.sample_rate != static_cast<uint32_t>(sf_info.samplerate)) {
+        fprintf(stderr, "index is made at %u Hz, not at %d Hz\n",
+                header.sample_rate, sf_info.samplerate);
+        return 1;
+      }
+      for (const auto &interval : intervals) {
+        if (interval.end_sample <= from || interval.start_sample >= to) {
+          continue;
+        }
+        // the tone found by the scan unless given
+        size_t bin = lround(static_cast<double>(interval.bin) *
+                            plan.fft_size / header.fft_size);
+        if (center_freq_given || tone_given ||
+            bin < morse::MorseSignalDetector::kMinSignalBin ||
+            bin + 2 >= std::min(morse::MorseSignalDetector::kAnalysisSize,
+                                plan.fft_size / 2)) {
+          bin = center_freq;
+        }
+        time_ranges.push_back(
+            TimeRange{std::max(interval.start_sample, from),
+                      std::min(interval.end_sample, to), bin,
+                      interval.dot_length});
+      }
+    }
+    int result =
+        DecodeRanges(sndfile, sf_info, plan, time_ranges, decimation,
+                     detector_parameters, reader_parameters, afc, fixed_point);
+    sf_close(sndfile);
+    return result < 0 ? 1 : 0;
+  }
+
   printf("\n");
 
+  if (checkpoint && sf_info.channels != 1) {
+    fprintf(stderr, "checkpoints are taken of a single channel\n");
+    return 1;
+  }
+
+  // the windows of the ensemble share the hop, the tone stays on the same
+  // frequency in their spectra
+  std::vector<morse::EnsembleMember> ensemble_members{};
+  for (size_t member_buffers : ensemble_buffers) {
+    morse::AnalysisPlan member_plan = plan;
+    member_plan.num_buffers = member_buffers;
+    member_plan.fft_size = hop_size * member_buffers;
+    size_t bin =
+        center_freq_given
+            ? lround(static_cast<double>(center_freq) * member_buffers /
+                     plan.num_buffers)
+            : lround(analysis_settings.tone_frequency * member_plan.fft_size /
+                     sf_info.samplerate);
+    if (bin < morse::MorseSignalDetector::kMinSignalBin ||
+        bin + 2 >= std::min(morse::MorseSignalDetector::kAnalysisSize,
+                            member_plan.fft_size / 2)) {
+      fprintf(stderr, "window of %ld hops cannot resolve the tone\n",
+              member_buffers);
+      return 1;
+    }
+    ensemble_members.push_back(morse::EnsembleMember{
+        member_buffers, bin, member_plan.Scale(unscaled_parameters)});
+  }
+  if (ensemble_given && sf_info.channels != 1) {
+    fprintf(stderr, "the ensemble decodes a single channel\n");
+    return 1;
+  }
+  if (!status_name.empty() && sf_info.channels != 1) {
+    fprintf(stderr, "the status is published for a single channel\n");
+    return 1;
+  }
+
   // setup playback environment
   pa_sample_spec ss;
   memset(&ss, 0, sizeof(ss));
@@ -182,73 +979,335 @@ int main(int argc, char *argv[]) {
     return -1;
   }
 
-  // setup buffers
-  std::vector<short *> buffers_mem{};
-  short **buffers = new short *[num_buffers];
-  for (size_t i = 0; i < num_buffers; ++i) {
-    buffers_mem.push_back(new short[BUFFER_SIZE]);
-    buffers[i] = buffers_mem[i];
-    memset(buffers[i], 0, sizeof(short) * BUFFER_SIZE);
+  // the ensemble decodes the single channel with its own decoders
+  morse::EnsembleDecoder *ensemble = nullptr;
+  if (ensemble_given) {
+    ensemble = new morse::EnsembleDecoder(hop_size, ensemble_members,
+                                          decimation, sf_info.samplerate,
+                                          reader_parameters);
+    for (size_t i = 0; i < ensemble->GetNumMembers(); ++i) {
+      auto *signal_detector = ensemble->GetMember(i)->GetDetector();
+      if (afc) {
+        signal_detector->EnableFrequencyTracking(center_freq_given ||
+                                                 tone_given);
+      }
+      if (fixed_point && signal_detector->EnableFixedPoint() < 0) {
+        fprintf(stderr, "fixed point detection needs a power of two FFT "
+                        "size\n");
+        return 1;
+      }
+    }
+  }
+
+  // setup a decoder for each channel
+  size_t num_channels = sf_info.channels;
+  std::vector<morse::ChannelDecoder *> channels{};
+  for (size_t ich = 0; ensemble == nullptr && ich < num_channels; ++ich) {
+    auto *channel = new morse::ChannelDecoder(plan.num_buffers, hop_size,
+                                              center_freq, decimation,
+                                              sf_info.samplerate, verbose);
+    auto *signal_detector = channel->GetDetector();
+    if (afc) {
+      signal_detector->EnableFrequencyTracking(center_freq_given ||
+                                               tone_given);
+    }
+    signal_detector->SetParameters(detector_parameters);
+    channel->GetReader()->SetParameters(reader_parameters);
+    if (fixed_point && signal_detector->EnableFixedPoint() < 0) {
+      fprintf(stderr, "fixed point detection needs a power of two FFT size\n");
+      return 1;
+    }
+    // output files of channels are distinguished by suffixes
+    std::string suffix =
+        num_channels > 1 ? std::string(".") + std::to_string(ich) : "";
+    if (!pattern_file_name.empty() &&
+        signal_detector->SetDumpFile(pattern_file_name + suffix,
+                                     sf_info.samplerate, hop_size) < 0) {
+      fprintf(stderr, "File open failed: %s%s (%s)\n",
+              pattern_file_name.c_str(), suffix.c_str(), strerror(errno));
+      exit(-1);
+    }
+    if (!analysis_file_name.empty() &&
+        signal_detector->SetAnalysisFile(analysis_file_name + suffix,
+                                         with_spectrum) < 0) {
+      fprintf(stderr, "File open failed: %s%s (%s)\n",
+              analysis_file_name.c_str(), suffix.c_str(), strerror(errno));
+      exit(-1);
+    }
+    if (!capture_file_name.empty() &&
+        signal_detector->SetCaptureFile(capture_file_name + suffix,
+                                        sf_info.samplerate, hop_size) < 0) {
+      fprintf(stderr, "File open failed: %s%s (%s)\n",
+              capture_file_name.c_str(), suffix.c_str(), strerror(errno));
+      exit(-1);
+    }
+    channels.push_back(channel);
   }
 
-  short *current_buffer = buffers[num_buffers - 1];
+  // the decoding continues from the position of the checkpoint; the output
+  // files start there as well
+  uint64_t position = 0;
+  if (!resume_file_name.empty()) {
+    if (ResumeChannel(resume_file_name, channels[0], &position) < 0) {
+      fprintf(stderr, "Resume failed: %s (%s)\n", resume_file_name.c_str(),
+              strerror(errno));
+      return 1;
+    }
+    if (sf_seek(sndfile, position, SEEK_SET) < 0) {
+      fprintf(stderr, "seek failed: %s\n", sf_strerror(sndfile));
+      return 1;
+    }
+  }
+  const uint64_t checkpoint_interval = kCheckpointInterval * sf_info.samplerate;
+  uint64_t next_checkpoint = position + checkpoint_interval;
 
-  // setup morse reader
-  auto *signal_detector = new ::morse::MorseSignalDetector(
-      morse_reader, num_buffers, BUFFER_SIZE, center_freq);
-  signal_detector->Verbose(verbose);
-  if (!pattern_file_name.empty() &&
-      signal_detector->SetDumpFile(pattern_file_name) < 0) {
-    fprintf(stderr, "File open failed: %s (%s)\n", pattern_file_name.c_str(),
-            strerror(errno));
-    exit(-1);
+  // the monitor shows a single channel
+  morse::Monitor *monitor = nullptr;
+  if (num_channels == 1 && analysis_file_name.empty() && !headless) {
+    monitor = new morse::CursesMonitor();
   }
-  if (!analysis_file_name.empty() &&
-      signal_detector->SetAnalysisFile(analysis_file_name) < 0) {
-    fprintf(stderr, "File open failed: %s (%s)\n", analysis_file_name.c_str(),
-            strerror(errno));
-    exit(-1);
+
+  // The windows of hops read ahead are transformed in batches, except on the
+  // integer path and with the squelch, which skip the FFT window by window.
+  bool batch = !fixed_point && detector_parameters.squelch_level == 0.0;
+  if (ensemble != nullptr) {
+    ensemble->EnableBatch(batch && mute);
   }
 
-  morse::Monitor *monitor = nullptr;
-  if (analysis_file_name.empty()) {
-    monitor = new morse::Monitor();
+  // channels are decoded on their own threads when there are more than one
+  std::vector<morse::BlockQueue<SampleBlock> *> queues{};
+  std::vector<std::thread> threads{};
+  std::vector<SampleBlock> blocks(num_channels);
+  if (num_channels > 1) {
+    for (auto *channel : channels) {
+      auto *queue = new morse::BlockQueue<SampleBlock>(kQueueCapacity);
+      queues.push_back(queue);
+      threads.emplace_back(DecodeChannel, channel, queue, hop_size, batch);
+    }
+  }
+
+  // a single channel runs as a pipeline on request
+  pipeline = pipeline && num_channels == 1;
+  morse::SpscQueue<SampleBlock> sample_queue(kPipelineCapacity);
+  morse::SpscQueue<SpectrumBlock> spectrum_queue(kPipelineCapacity);
+  if (pipeline) {
+    threads.emplace_back(AnalyzeChannel, channels[0], &sample_queue,
+                         &spectrum_queue, hop_size);
+    threads.emplace_back(DetectChannel, channels[0], &spectrum_queue, monitor);
+    for (size_t i = 0; i < stage_cpus.size(); ++i) {
+      pthread_t thread =
+          i == 0 ? pthread_self() : threads[i - 1].native_handle();
+      if (PinThread(thread, stage_cpus[i]) < 0) {
+        fprintf(stderr, "pinning to CPU %d failed: %s\n", stage_cpus[i],
+                strerror(errno));
+      }
+    }
+  }
+
+  // without the playback, a single channel is decoded offline; the hops are
+  // read ahead so that their windows are transformed in batches
+  bool offline =
+      batch && mute && num_channels == 1 && !pipeline && ensemble == nullptr;
+  std::vector<float> batch_spectra{};
+
+  // with the playback, a single channel is timed against the audio clock
+  // and sheds load when it falls behind
+  bool live = !mute && num_channels == 1 && !pipeline && ensemble == nullptr;
+  morse::DeadlineMonitor deadline(plan.hop_duration / 1000.0);
+
+  // the status of the single channel is published between hops, at most
+  // every kStatusInterval
+  morse::StatusPublisher status{};
+  morse::ChannelDecoder *status_channel =
+      ensemble != nullptr ? ensemble->GetMember(0) : channels[0];
+  morse::MorseReader *status_reader = ensemble != nullptr
+                                          ? ensemble->GetReader()
+                                          : channels[0]->GetReader();
+  if (!status_name.empty()) {
+    if (status.Open(status_name) < 0) {
+      fprintf(stderr, "Status segment failed: %s (%s)\n", status_name.c_str(),
+              strerror(errno));
+      return 1;
+    }
+    morse::StatusBlock *block = status.GetStatus();
+    block->sample_rate = sf_info.samplerate;
+    block->hop_size = hop_size;
+    block->fft_size =
+        ensemble != nullptr ? hop_size * ensemble_buffers[0] : plan.fft_size;
+    block->decimation = decimation;
   }
+  const uint64_t start_position = position;
+  struct timespec decode_start;
+  clock_gettime(CLOCK_MONOTONIC, &decode_start);
+  double next_status = 0.0;
 
   // read and process data of approximately 6ms for each in the loop
-  size_t num_windows = 0;
-  sf_count_t num_samples;
+  short *frames = new short[hop_size * num_channels];
+  size_t num_hops = 0;
+  sf_count_t num_frames;
+  bool playback_failed = false;
   do {
-    num_samples = sf_read_short(sndfile, current_buffer, BUFFER_SIZE);
+    // a checkpoint is taken between hops, and offline between blocks so that
+    // no batch is pending
+    if (!checkpoint_file_name.empty() && position >= next_checkpoint &&
+        num_hops == 0) {
+      if (SaveChannel(checkpoint_file_name, *channels[0], position) < 0) {
+        fprintf(stderr, "Checkpoint failed: %s (%s)\n",
+                checkpoint_file_name.c_str(), strerror(errno));
+      }
+      next_checkpoint = position + checkpoint_interval;
+    }
+    if (!status_name.empty() && num_hops == 0) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      double elapsed = ElapsedSeconds(decode_start, now);
+      if (elapsed >= next_status) {
+        PublishStatus(&status, *status_channel->GetDetector(), status_reader,
+                      position - start_position, elapsed,
+                      deadline.GetNumOverruns());
+        next_status = elapsed + kStatusInterval;
+      }
+    }
+    num_frames = sf_readf_short(sndfile, frames, hop_size);
+    position += num_frames;
 
     if (!mute) {
-      if (pa_simple_write(pa, current_buffer,
-                          (size_t)(num_samples * sizeof(*current_buffer)),
+      if (pa_simple_write(pa, frames,
+                          (size_t)(num_frames * num_channels * sizeof(*frames)),
                           &error) < 0) {
         fprintf(stderr, __FILE__ ": pa_simple_write() failed: %s\n",
                 pa_strerror(error));
-        if (pa) {
-          pa_simple_free(pa);
-        }
-
-        return -1;
+        // the input ends here, so that the blocks in flight are handed over
+        // as the last ones and the threads end
+        playback_failed = true;
+        num_frames = 0;
       }
     }
 
-    if (++num_windows >= num_buffers) {
-      signal_detector->Process(buffers, num_samples, monitor);
+    bool last = num_frames < static_cast<sf_count_t>(hop_size);
+    if (ensemble != nullptr) {
+      // offline, the members take blocks of hops at a time
+      auto &samples = blocks[0].samples;
+      samples.insert(samples.end(), frames, frames + num_frames);
+      if (++num_hops == (mute ? kHopsPerBlock : 1) || last) {
+        ensemble->Process(samples.data(), samples.size(), last, monitor);
+        samples.clear();
+        num_hops = 0;
+      }
+      continue;
     }
-
-    short *temp = buffers[0];
-    for (size_t i = 1; i < num_buffers; ++i) {
-      buffers[i - 1] = buffers[i];
+    if (pipeline) {
+      auto &samples = blocks[0].samples;
+      samples.insert(samples.end(), frames, frames + num_frames);
+      if (++num_hops == kPipelineHopsPerBlock || last) {
+        blocks[0].last = last;
+        sample_queue.Push(std::move(blocks[0]));
+        blocks[0] = SampleBlock{};
+        num_hops = 0;
+      }
+      continue;
+    }
+    if (offline) {
+      auto &samples = blocks[0].samples;
+      samples.insert(samples.end(), frames, frames + num_frames);
+      if (++num_hops == FFT_BATCH || last) {
+        blocks[0].last = last;
+        DecodeBlock(channels[0], blocks[0], hop_size, &batch_spectra,
+                    monitor);
+        samples.clear();
+        num_hops = 0;
+      }
+      continue;
+    }
+    if (live) {
+      struct timespec start;
+      struct timespec end;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      // the monitor is paused under load
+      channels[0]->Process(frames, num_frames,
+                           deadline.GetLevel() > 0 ? nullptr : monitor);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      if (deadline.AddHop(ElapsedSeconds(start, end))) {
+        ShedLoad(channels[0]->GetReader(), reader_parameters,
+                 deadline.GetLevel());
+        if (deadline.GetLevel() == 0 && monitor != nullptr) {
+          monitor->Dump(channels[0]->GetReader());
+        }
+      }
+      continue;
+    }
+    if (num_channels == 1) {
+      channels[0]->Process(frames, num_frames, monitor);
+      continue;
     }
-    buffers[num_buffers - 1] = temp;
-    current_buffer = temp;
 
-  } while (num_samples == BUFFER_SIZE);
+    // de-interleave the frames and hand them over to the channel threads
+    for (size_t ich = 0; ich < num_channels; ++ich) {
+      auto &samples = blocks[ich].samples;
+      for (sf_count_t i = 0; i < num_frames; ++i) {
+        samples.push_back(frames[i * num_channels + ich]);
+      }
+    }
+    if (++num_hops == kHopsPerBlock || last) {
+      for (size_t ich = 0; ich < num_channels; ++ich) {
+        blocks[ich].last = last;
+        queues[ich]->Push(std::move(blocks[ich]));
+        blocks[ich] = SampleBlock{};
+      }
+      num_hops = 0;
+    }
+  } while (num_frames == static_cast<sf_count_t>(hop_size));
 
-  signal_detector->Drain(monitor);
+  if (ensemble != nullptr) {
+    ensemble->Drain(monitor);
+  } else if (num_channels == 1 && !pipeline) {
+    channels[0]->Drain(monitor);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  if (playback_failed) {
+    delete monitor;
+    pa_simple_free(pa);
+    sf_close(sndfile);
+    return -1;
+  }
+  if (!status_name.empty()) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    PublishStatus(&status, *status_channel->GetDetector(), status_reader,
+                  position - start_position, ElapsedSeconds(decode_start, now),
+                  deadline.GetNumOverruns());
+    status.Close();
+  }
+  if (verbose && detector_parameters.squelch_level > 0.0) {
+    for (size_t ich = 0; ich < channels.size(); ++ich) {
+      auto *detector = channels[ich]->GetDetector();
+      fprintf(stderr, "channel %ld: %ld of %ld windows squelched\n", ich,
+              detector->GetNumSquelched(), detector->GetWindowCount());
+    }
+  }
+  if (live && verbose) {
+    fprintf(stderr,
+            "deadline: %ld hops, %ld overruns, worst %.2f ms of %.2f ms, "
+            "backlog up to %.1f ms, %ld hops degraded in %ld changes\n",
+            deadline.GetNumHops(), deadline.GetNumOverruns(),
+            deadline.GetMaxElapsed() * 1000.0, plan.hop_duration,
+            deadline.GetMaxBacklog() * 1000.0, deadline.GetNumDegradedHops(),
+            deadline.GetNumLevelChanges());
+  }
+  if (ensemble != nullptr && verbose) {
+    for (size_t i = 0; i < ensemble->GetNumMembers(); ++i) {
+      fprintf(stderr, "window of %ld hops: agreed on %.1f%% of windows, "
+                      "timing error %.2f dots\n",
+              ensemble_buffers[i], ensemble->GetAgreement(i) * 100.0,
+              ensemble->GetTimingError(i));
+    }
+  }
+  if (pipeline && verbose) {
+    PrintQueueStats("reading -> FFT", sample_queue);
+    PrintQueueStats("FFT -> detection", spectrum_queue);
+  }
 
   /*
     if (monitor != nullptr) {
@@ -258,6 +1317,18 @@ int main(int argc, char *argv[]) {
 
   delete monitor;
 
+  // the transcript, once the monitor has left the screen
+  if (pattern_file_name.empty() && analysis_file_name.empty()) {
+    if (num_channels > 1) {
+      for (size_t ich = 0; ich < num_channels; ++ich) {
+        printf("channel %ld: %s\n", ich,
+               channels[ich]->GetReader()->GetCharacters().c_str());
+      }
+    } else {
+      printf("%s\n", status_reader->GetCharacters().c_str());
+    }
+  }
+
   if (pa_simple_drain(pa, &error) < 0) {
     fprintf(stderr, __FILE__ ": pa_simple_drain() failed: %s\n",
             pa_strerror(error));
@@ -267,13 +1338,16 @@ int main(int argc, char *argv[]) {
   if (pa) {
     pa_simple_free(pa);
   }
-  delete signal_detector;
   sf_close(sndfile);
 
-  delete[] buffers;
-  for (auto buffer : buffers_mem) {
-    delete[] buffer;
+  delete[] frames;
+  for (auto *queue : queues) {
+    delete queue;
+  }
+  for (auto *channel : channels) {
+    delete channel;
   }
+  delete ensemble;
 
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,459 @@
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <math.h>
+#include <sndfile.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "analysis_plan.h"
+#include "channel_decoder.h"
+#include "morse_keyer.h"
+#include "world_line.h"
+
+/**
+ * Decodes hours or days of audio through the detector and the reader as fast
+ * as possible and watches for drift: the resident memory, the bytes held by
+ * the world lines, and the cost of a window. The audio is a file played in a
+ * loop or synthetic code with fresh noise, whose speed drifts over the run.
+ * Reports are printed for every interval of audio, and the run fails if the
+ * figures grow beyond the limits over those of the first interval, or if the
+ * estimated dot length lags behind the synthetic speed.
+ */
+
+namespace {
+
+// rise and fall of the synthetic tone, in seconds
+const double kToneEdge = 0.005;
+
+// the memory is sampled this often, in seconds of audio
+const double kMemorySampleInterval = 1.0;
+
+// characters of the decoded text shown with a report
+const size_t kRecentText = 40;
+
+struct Options {
+  double tone_frequency = 700.0;
+  double wpm = 20.0;
+  double sample_rate = 8000.0;
+  double snr_db = 20.0;
+  double hours = 24.0;
+  double report_minutes = 60.0;
+  double max_rss_growth_mb = 16.0;
+  double max_reader_growth_kb = 512.0;
+  double max_cost_ratio = 3.0;
+  // the synthetic speed falls to this fraction of wpm at the middle of the
+  // run and comes back at the end
+  double slowest_ratio = 0.5;
+  double max_dot_error = 0.25;
+};
+
+/**
+ * Keys the text into an envelope of [0, 1] per sample at the speed. Returns
+ * the dot length in samples.
+ */
+size_t KeyEnvelope(const char *text, double wpm, double sample_rate,
+                   std::vector<float> *envelope) {
+  // PARIS is 50 dots
+  size_t dot = lround(sample_rate * 60.0 / (50.0 * wpm));
+  size_t edge = std::min<size_t>(lround(kToneEdge * sample_rate), dot / 2);
+  morse::KeyText(text, [&](bool mark, int num_dots) {
+    for (size_t i = 0; i < num_dots * dot; ++i) {
+      float level = 1.0f;
+      if (i < edge) {
+        level = 0.5f - 0.5f * cosf(M_PI * i / edge);
+      } else if (num_dots * dot - i <= edge) {
+        level = 0.5f - 0.5f * cosf(M_PI * (num_dots * dot - i) / edge);
+      }
+      envelope->push_back(mark ? level : 0.0f);
+    }
+  });
+  return dot;
+}
+
+/**
+ * Gives hops of audio in a loop, the file or the synthetic code with noise.
+ * The synthetic code is keyed again on every repetition at the speed set
+ * for it.
+ */
+class AudioSource {
+private:
+  std::vector<short> samples_;
+  std::vector<float> envelope_;
+  double sample_rate_ = 0.0;
+  double wpm_ = 0.0;
+  size_t dot_length_ = 0;
+  size_t position_ = 0;
+  double phase_ = 0.0;
+  double phase_step_ = 0.0;
+  float amplitude_ = 0.0f;
+  std::mt19937 random_{1};
+  std::normal_distribution<float> noise_;
+
+public:
+  explicit AudioSource(const std::vector<short> &samples)
+      : samples_(samples) {}
+
+  explicit AudioSource(const Options &options)
+      : sample_rate_(options.sample_rate), wpm_(options.wpm) {
+    // the longest envelope is allocated up front so that the harness itself
+    // does not grow
+    KeyEnvelope(morse::kKeyerText, options.wpm * options.slowest_ratio,
+                sample_rate_, &envelope_);
+    envelope_.clear();
+    dot_length_ =
+        KeyEnvelope(morse::kKeyerText, wpm_, sample_rate_, &envelope_);
+    phase_step_ = 2.0 * M_PI * options.tone_frequency / options.sample_rate;
+    // the noise in the whole band against the power of the tone
+    amplitude_ = 8000.0f;
+    float sigma =
+        amplitude_ / sqrtf(2.0f) / powf(10.0f, options.snr_db / 20.0f);
+    noise_ = std::normal_distribution<float>(0.0f, sigma);
+  }
+
+  /**
+   * Sets the speed of the synthetic code from its next repetition.
+   */
+  inline void SetWpm(double wpm) { wpm_ = wpm; }
+
+  /**
+   * Returns the dot length of the synthetic code being sent in samples, or 0
+   * for the file.
+   */
+  inline size_t GetDotLength() const { return dot_length_; }
+
+  void Read(short hop[], size_t hop_size) {
+    for (size_t i = 0; i < hop_size; ++i) {
+      if (!samples_.empty()) {
+        hop[i] = samples_[position_];
+        position_ = (position_ + 1) % samples_.size();
+        continue;
+      }
+      float value =
+          envelope_[position_] * amplitude_ * sin(phase_) + noise_(random_);
+      hop[i] = std::max(-32768.0f, std::min(value, 32767.0f));
+      phase_ = fmod(phase_ + phase_step_, 2.0 * M_PI);
+      if (++position_ == envelope_.size()) {
+        envelope_.clear();
+        dot_length_ =
+            KeyEnvelope(morse::kKeyerText, wpm_, sample_rate_, &envelope_);
+        position_ = 0;
+      }
+    }
+  }
+};
+
+size_t GetResidentBytes() {
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm == nullptr) {
+    return 0;
+  }
+  unsigned long size = 0;
+  unsigned long resident = 0;
+  if (fscanf(statm, "%lu %lu", &size, &resident) != 2) {
+    resident = 0;
+  }
+  fclose(statm);
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+struct Report {
+  size_t resident_bytes = 0;
+  // the largest sample over the interval
+  size_t reader_bytes = 0;
+  size_t num_world_lines = 0;
+  double p50 = 0.0;
+  double p99 = 0.0;
+  double max = 0.0;
+  // relative error of the dot length estimated by the most confident world
+  // line against that of the synthetic code
+  double dot_error = 0.0;
+};
+
+/**
+ * Takes the percentiles of the window costs of an interval and empties them.
+ */
+void TakeCosts(std::vector<float> *costs, Report *report) {
+  if (costs->empty()) {
+    return;
+  }
+  size_t p50 = costs->size() / 2;
+  size_t p99 = costs->size() * 99 / 100;
+  std::nth_element(costs->begin(), costs->begin() + p50, costs->end());
+  report->p50 = (*costs)[p50];
+  std::nth_element(costs->begin(), costs->begin() + p99, costs->end());
+  report->p99 = (*costs)[p99];
+  report->max = *std::max_element(costs->begin() + p99, costs->end());
+  costs->clear();
+}
+
+/**
+ * Checks a report against the first one. Returns false and tells why if
+ * something has grown beyond its limit.
+ */
+bool CheckDrift(const Options &options, const Report &first,
+                const Report &report) {
+  bool ok = true;
+  double rss_growth =
+      (static_cast<double>(report.resident_bytes) - first.resident_bytes) /
+      (1024.0 * 1024.0);
+  if (rss_growth > options.max_rss_growth_mb) {
+    printf("FAIL: resident memory grew by %.1f MB\n", rss_growth);
+    ok = false;
+  }
+  double reader_growth =
+      (static_cast<double>(report.reader_bytes) - first.reader_bytes) / 1024.0;
+  if (reader_growth > options.max_reader_growth_kb) {
+    printf("FAIL: world lines grew by %.1f KB\n", reader_growth);
+    ok = false;
+  }
+  if (first.p99 > 0.0 && report.p99 > first.p99 * options.max_cost_ratio) {
+    printf("FAIL: p99 window cost grew %.1f times\n", report.p99 / first.p99);
+    ok = false;
+  }
+  return ok;
+}
+
+/**
+ * Checks that the estimated dot length follows the speed of the synthetic
+ * code. Returns false and tells why if it lags.
+ */
+bool CheckDotLength(const Options &options, const Report &report) {
+  if (report.dot_error > options.max_dot_error) {
+    printf("FAIL: estimated dot length is off by %.0f%%\n",
+           report.dot_error * 100.0);
+    return false;
+  }
+  return true;
+}
+
+int Soak(const Options &options, const std::vector<short> *file_samples,
+         double sample_rate) {
+  morse::AnalysisSettings settings{};
+  settings.tone_frequency = options.tone_frequency;
+  settings.max_wpm = options.wpm;
+  morse::AnalysisPlan plan;
+  if (morse::PlanAnalysis(settings, sample_rate, &plan) < 0) {
+    fprintf(stderr, "cannot plan the analysis: %s\n", strerror(errno));
+    return -1;
+  }
+  morse::ChannelDecoder channel(plan.num_buffers, plan.hop_size,
+                                plan.center_bin, 1, sample_rate);
+  channel.GetDetector()->SetParameters(
+      plan.Scale(morse::DetectorParameters{}));
+  morse::MorseReader *reader = channel.GetReader();
+  AudioSource source = file_samples != nullptr ? AudioSource(*file_samples)
+                                               : AudioSource(options);
+
+  const size_t hop_size = plan.hop_size;
+  const uint64_t num_hops = options.hours * 3600.0 * sample_rate / hop_size;
+  const uint64_t report_hops =
+      std::max(1.0, options.report_minutes * 60.0 * sample_rate / hop_size);
+  const uint64_t memory_hops =
+      std::max(1.0, kMemorySampleInterval * sample_rate / hop_size);
+  // allocated once so that the harness itself does not drift
+  std::vector<short> hop(hop_size);
+  std::vector<float> costs{};
+  costs.reserve(report_hops);
+  std::string recent{};
+  recent.reserve(2 * kRecentText);
+  std::vector<const morse::WorldLine *> lines{};
+
+  printf("hop %ld samples, window %ld hops, %.1f hours of audio\n", hop_size,
+         plan.num_buffers, num_hops * hop_size / sample_rate / 3600.0);
+  printf("%8s %9s %9s %6s %6s %8s %8s %8s %6s  %s\n", "hours", "rss_kb",
+         "reader_kb", "lines", "peak", "p50_us", "p99_us", "max_us", "dot_%",
+         "text");
+  Report first{};
+  Report report{};
+  bool has_first = false;
+  bool ok = true;
+  for (uint64_t i = 1; i <= num_hops; ++i) {
+    // down to the slowest speed at the middle of the run and back
+    double middle = std::abs(2.0 * i / num_hops - 1.0);
+    source.SetWpm(options.wpm *
+                  (options.slowest_ratio +
+                   (1.0 - options.slowest_ratio) * middle));
+    source.Read(hop.data(), hop_size);
+    double start = morse::MonotonicTime();
+    channel.Process(hop.data(), hop_size, nullptr);
+    costs.push_back((morse::MonotonicTime() - start) * 1.e6);
+
+    // an endless stream releases what it has taken
+    std::string_view committed = reader->GetCommittedCharacters();
+    recent.append(committed);
+    if (recent.size() > kRecentText) {
+      recent.erase(0, recent.size() - kRecentText);
+    }
+    reader->ReleaseCommittedCharacters();
+
+    if (i % memory_hops == 0) {
+      report.reader_bytes =
+          std::max(report.reader_bytes, reader->GetMemoryUsage());
+    }
+    if (i % report_hops != 0 && i != num_hops) {
+      continue;
+    }
+    report.resident_bytes = GetResidentBytes();
+    report.num_world_lines = reader->GetNumWorldLines();
+    TakeCosts(&costs, &report);
+    reader->GetWorldLines(&lines);
+    auto best = std::max_element(lines.begin(), lines.end(),
+                                 [](auto a, auto b) {
+                                   return a->GetConfidence() <
+                                          b->GetConfidence();
+                                 });
+    if (source.GetDotLength() > 0 && best != lines.end()) {
+      report.dot_error = fabs((*best)->GetDotLength() * hop_size /
+                                  source.GetDotLength() -
+                              1.0);
+    }
+    printf("%8.2f %9ld %9.1f %6ld %6ld %8.1f %8.1f %8.1f %6.1f  %s\n",
+           i * hop_size / sample_rate / 3600.0, report.resident_bytes / 1024,
+           report.reader_bytes / 1024.0, report.num_world_lines,
+           reader->GetPeakNumWorldLines(), report.p50, report.p99, report.max,
+           report.dot_error * 100.0, recent.c_str());
+    fflush(stdout);
+    ok &= CheckDotLength(options, report);
+    // the first interval warms up the allocations and the caches
+    if (!has_first) {
+      first = report;
+      has_first = true;
+    } else {
+      ok &= CheckDrift(options, first, report);
+    }
+    report = Report{};
+  }
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : -1;
+}
+
+int LoadFile(const char *file_name, std::vector<short> *samples,
+             double *sample_rate) {
+  SF_INFO sf_info;
+  memset(&sf_info, 0, sizeof(sf_info));
+  SNDFILE *sndfile = sf_open(file_name, SFM_READ, &sf_info);
+  if (sndfile == nullptr) {
+    fprintf(stderr, "File error: %s: %s\n", file_name, sf_strerror(nullptr));
+    return -1;
+  }
+  // the first channel is decoded
+  std::vector<short> frames(sf_info.frames * sf_info.channels);
+  sf_count_t num_frames =
+      sf_readf_short(sndfile, frames.data(), sf_info.frames);
+  sf_close(sndfile);
+  samples->resize(num_frames);
+  for (sf_count_t i = 0; i < num_frames; ++i) {
+    (*samples)[i] = frames[i * sf_info.channels];
+  }
+  *sample_rate = sf_info.samplerate;
+  if (samples->empty()) {
+    fprintf(stderr, "File error: %s: no samples\n", file_name);
+    return -1;
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options{};
+  while (true) {
+    int c = getopt(argc, argv, "t:w:r:n:H:i:m:b:p:s:e:");
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 't':
+      options.tone_frequency = strtod(optarg, nullptr);
+      break;
+    case 'w':
+      options.wpm = strtod(optarg, nullptr);
+      break;
+    case 'r':
+      options.sample_rate = strtod(optarg, nullptr);
+      break;
+    case 'n':
+      options.snr_db = strtod(optarg, nullptr);
+      break;
+    case 'H':
+      options.hours = strtod(optarg, nullptr);
+      break;
+    case 'i':
+      options.report_minutes = strtod(optarg, nullptr);
+      break;
+    case 'm':
+      options.max_rss_growth_mb = strtod(optarg, nullptr);
+      break;
+    case 'b':
+      options.max_reader_growth_kb = strtod(optarg, nullptr);
+      break;
+    case 'p':
+      options.max_cost_ratio = strtod(optarg, nullptr);
+      break;
+    case 's':
+      options.slowest_ratio = strtod(optarg, nullptr);
+      break;
+    case 'e':
+      options.max_dot_error = strtod(optarg, nullptr);
+      break;
+    }
+  }
+
+  if (optind + 1 < argc || options.hours <= 0.0 ||
+      options.report_minutes <= 0.0 || options.slowest_ratio <= 0.0 ||
+      options.slowest_ratio > 1.0) {
+    fprintf(stderr, "Usage: %s [options] [<wav_file>]\n", basename(argv[0]));
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -t <Hz> : Tone frequency (default %.0f)\n",
+            options.tone_frequency);
+    fprintf(stderr, "  -w <wpm> : Speed of the synthetic code and the "
+                    "fastest expected one (default %.0f)\n",
+            options.wpm);
+    fprintf(stderr, "  -r <Hz> : Sample rate of the synthetic code (default "
+                    "%.0f)\n",
+            options.sample_rate);
+    fprintf(stderr, "  -n <dB> : SNR of the synthetic code (default %.0f)\n",
+            options.snr_db);
+    fprintf(stderr, "  -H <hours> : Audio to decode (default %.0f)\n",
+            options.hours);
+    fprintf(stderr, "  -i <minutes> : Audio between reports (default %.0f)\n",
+            options.report_minutes);
+    fprintf(stderr, "  -m <MB> : Allowed growth of the resident memory "
+                    "(default %.0f)\n",
+            options.max_rss_growth_mb);
+    fprintf(stderr, "  -b <KB> : Allowed growth of the world lines (default "
+                    "%.0f)\n",
+            options.max_reader_growth_kb);
+    fprintf(stderr, "  -p <ratio> : Allowed growth of the p99 window cost "
+                    "(default %.1f)\n",
+            options.max_cost_ratio);
+    fprintf(stderr, "  -s <ratio> : Slowest synthetic speed at the middle of "
+                    "the run as a fraction of -w (default %.1f)\n",
+            options.slowest_ratio);
+    fprintf(stderr, "  -e <ratio> : Allowed error of the estimated dot length "
+                    "on synthetic code (default %.2f)\n",
+            options.max_dot_error);
+    fprintf(stderr, "The file is played in a loop; without it, synthetic "
+                    "code is sent.\n");
+    return 1;
+  }
+
+  std::vector<short> file_samples{};
+  double sample_rate = options.sample_rate;
+  if (optind < argc &&
+      LoadFile(argv[optind], &file_samples, &sample_rate) < 0) {
+    return 1;
+  }
+  return Soak(options, optind < argc ? &file_samples : nullptr, sample_rate) <
+                 0
+             ? 1
+             : 0;
+}
@@ -0,0 +1,127 @@
+#include "spectrum_capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace morse {
+
+static const size_t kWriteBufferSize = 1024 * 1024;
+
+static_assert(sizeof(CaptureHeader) == kCaptureHeaderSize,
+              "capture header must not be padded");
+
+SpectrumCaptureWriter::~SpectrumCaptureWriter() { Close(); }
+
+int SpectrumCaptureWriter::Open(const std::string &file_name,
+                                uint32_t num_bins, uint32_t sample_rate,
+                                uint32_t hop_size, uint32_t fft_size,
+                                uint32_t center_bin) {
+  fd_ = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    return -1;
+  }
+  num_bins_ = num_bins;
+  buffer_.reserve(kWriteBufferSize);
+
+  CaptureHeader header{};
+  memcpy(header.magic, kCaptureFileMagic, sizeof(header.magic));
+  header.version = kCaptureFileVersion;
+  header.num_bins = num_bins;
+  header.sample_rate = sample_rate;
+  header.hop_size = hop_size;
+  header.fft_size = fft_size;
+  header.center_bin = center_bin;
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&header);
+  buffer_.insert(buffer_.end(), bytes, bytes + sizeof(header));
+  return 0;
+}
+
+void SpectrumCaptureWriter::Add(const float spectrum[]) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(spectrum);
+  buffer_.insert(buffer_.end(), bytes, bytes + sizeof(float) * num_bins_);
+  if (buffer_.size() >= kWriteBufferSize) {
+    Flush();
+  }
+}
+
+int SpectrumCaptureWriter::Close() {
+  if (fd_ < 0) {
+    return 0;
+  }
+  int result = Flush();
+  if (close(fd_) < 0) {
+    result = -1;
+  }
+  fd_ = -1;
+  return result;
+}
+
+int SpectrumCaptureWriter::Flush() {
+  size_t written = 0;
+  while (written < buffer_.size()) {
+    ssize_t result =
+        write(fd_, buffer_.data() + written, buffer_.size() - written);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    written += result;
+  }
+  buffer_.clear();
+  return 0;
+}
+
+SpectrumCaptureReader::~SpectrumCaptureReader() {
+  if (data_ != nullptr) {
+    munmap(const_cast<uint8_t *>(data_), size_);
+  }
+}
+
+int SpectrumCaptureReader::Open(const std::string &file_name) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  if (static_cast<size_t>(st.st_size) < kCaptureHeaderSize) {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+  size_ = st.st_size;
+  void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+  data_ = static_cast<const uint8_t *>(data);
+
+  memcpy(&header_, data_, sizeof(header_));
+  if (memcmp(header_.magic, kCaptureFileMagic, sizeof(header_.magic)) != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (header_.version != kCaptureFileVersion || header_.num_bins == 0 ||
+      header_.fft_size == 0 ||
+      (header_.fft_size & (header_.fft_size - 1)) != 0 ||
+      header_.num_bins > header_.fft_size / 2) {
+    errno = EBADMSG;
+    return -1;
+  }
+  num_windows_ =
+      (size_ - kCaptureHeaderSize) / (sizeof(float) * header_.num_bins);
+  madvise(data, size_, MADV_SEQUENTIAL);
+  return 0;
+}
+
+} // namespace morse
@@ -0,0 +1,95 @@
+#ifndef MORSE_SPECTRUM_CAPTURE_H_
+#define MORSE_SPECTRUM_CAPTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace morse {
+
+/*
+ * Spectrum capture file keeps the power spectrum of every window so that the
+ * detection can be re-run without decoding audio and running FFTs. All
+ * fields are in host byte order, the file is meant to be mapped into memory.
+ *
+ *   header : "MSPC" followed by 32-bit version, number of bins, sample rate,
+ *            hop size in samples, FFT size, and center bin at capture time,
+ *            padded to kCaptureHeaderSize bytes
+ *   window : power of bins [0, number of bins) as floats
+ */
+static const char kCaptureFileMagic[] = {'M', 'S', 'P', 'C'};
+static const uint32_t kCaptureFileVersion = 1;
+static const size_t kCaptureHeaderSize = 32;
+
+struct CaptureHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t num_bins;
+  uint32_t sample_rate;
+  uint32_t hop_size;
+  uint32_t fft_size;
+  uint32_t center_bin;
+  uint32_t reserved;
+};
+
+class SpectrumCaptureWriter {
+private:
+  int fd_ = -1;
+  uint32_t num_bins_ = 0;
+  std::vector<uint8_t> buffer_;
+
+public:
+  SpectrumCaptureWriter() = default;
+  virtual ~SpectrumCaptureWriter();
+
+  /**
+   * Opens the file and writes the header. Returns -1 on failure with errno
+   * set.
+   */
+  int Open(const std::string &file_name, uint32_t num_bins,
+           uint32_t sample_rate, uint32_t hop_size, uint32_t fft_size,
+           uint32_t center_bin);
+
+  /**
+   * Adds the power spectrum of a window.
+   */
+  void Add(const float spectrum[]);
+
+  int Close();
+
+private:
+  int Flush();
+};
+
+class SpectrumCaptureReader {
+private:
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+  CaptureHeader header_{};
+  size_t num_windows_ = 0;
+
+public:
+  SpectrumCaptureReader() = default;
+  virtual ~SpectrumCaptureReader();
+
+  /**
+   * Maps the capture file into memory. Returns -1 on failure with errno set,
+   * EINVAL if the file is not a capture file, EBADMSG if it is of another
+   * version or its bins do not fit a power of two FFT size.
+   */
+  int Open(const std::string &file_name);
+
+  inline const CaptureHeader &GetHeader() const { return header_; }
+  inline size_t GetNumWindows() const { return num_windows_; }
+
+  inline const float *GetWindow(size_t index) const {
+    return reinterpret_cast<const float *>(data_ + kCaptureHeaderSize) +
+           index * header_.num_bins;
+  }
+};
+
+} // namespace morse
+
+#endif // MORSE_SPECTRUM_CAPTURE_H_
@@ -0,0 +1,38 @@
+#include "spectrum_transform.h"
+
+#include <math.h>
+
+namespace morse {
+
+void MakeBlackmanNuttallWindow(size_t window_size, float window[]) {
+  float a0 = 0.3636819;
+  float a1 = 0.4891775;
+  float a2 = 0.1365995;
+  float a3 = 0.0106411;
+  for (size_t n = 0; n < window_size; ++n) {
+    window[n] = a0 - a1 * cos((2 * M_PI * (n + 0.5)) / window_size) +
+                a2 * cos((4 * M_PI * (n + 0.5)) / window_size) -
+                a3 * cos((6 * M_PI * (n + 0.5)) / window_size);
+  }
+}
+
+SpectrumTransform *MakeSpectrumTransform(size_t num_buffers,
+                                         size_t buffer_size) {
+  // the sizes of the analysis plans at the common sample rates
+  if (buffer_size == 256) {
+    switch (num_buffers) {
+    case 1:
+      return new FixedSpectrumTransform<1, 256>();
+    case 2:
+      return new FixedSpectrumTransform<2, 256>();
+    case 4:
+      return new FixedSpectrumTransform<4, 256>();
+    }
+  }
+  if (buffer_size == 512 && num_buffers == 2) {
+    return new FixedSpectrumTransform<2, 512>();
+  }
+  return nullptr;
+}
+
+} // namespace morse
@@ -0,0 +1,133 @@
+#ifndef MORSE_SPECTRUM_TRANSFORM_H_
+#define MORSE_SPECTRUM_TRANSFORM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "batch_fft.h"
+#include "fft.h"
+
+namespace morse {
+
+void MakeBlackmanNuttallWindow(size_t window_size, float window[]);
+
+/**
+ * Window and FFT of the float path of the detector over num_buffers hops of
+ * buffer_size samples each.
+ */
+class SpectrumTransform {
+public:
+  virtual ~SpectrumTransform() = default;
+
+  /**
+   * Returns the transformed window, valid until the next call.
+   */
+  virtual const complex *Transform(short *const buffers[]) = 0;
+  virtual const complex *Transform(complex *const buffers[]) = 0;
+};
+
+/**
+ * Returns a transform specialized at compile time for the sizes, or nullptr
+ * for the sizes that take the generic path.
+ */
+SpectrumTransform *MakeSpectrumTransform(size_t num_buffers,
+                                         size_t buffer_size);
+
+/**
+ * Transform whose loops have constant trip counts, over a buffer in the
+ * object, so that the compiler can unroll and vectorize them. The results
+ * are the same as those of the generic path.
+ */
+template <size_t kNumBuffers, size_t kBufferSize>
+class FixedSpectrumTransform : public SpectrumTransform {
+public:
+  static constexpr size_t kSize = kNumBuffers * kBufferSize;
+  static_assert((kSize & (kSize - 1)) == 0, "FFT size is not a power of two");
+
+private:
+  struct Tables {
+    float window[kSize];
+    complex twiddles[kSize - 1];
+    // the windowed samples are stored in bit reversed order for the FFT
+    uint16_t reversed[kSize];
+
+    Tables() {
+      MakeBlackmanNuttallWindow(kSize, window);
+      batch_fft_make_twiddles(twiddles, kSize);
+      for (size_t i = 1, j = 0; i < kSize; ++i) {
+        size_t bit = kSize >> 1;
+        for (; j & bit; bit >>= 1) {
+          j ^= bit;
+        }
+        j ^= bit;
+        reversed[i] = j;
+      }
+      reversed[0] = 0;
+    }
+  };
+
+  alignas(32) complex data_[kSize];
+
+  // shared by the instances of a size
+  static const Tables &GetTables() {
+    static const Tables tables;
+    return tables;
+  }
+
+public:
+  const complex *Transform(short *const buffers[]) override {
+    const Tables &tables = GetTables();
+    for (size_t ibuf = 0; ibuf < kNumBuffers; ++ibuf) {
+      for (size_t i = 0; i < kBufferSize; ++i) {
+        size_t index = kBufferSize * ibuf + i;
+        complex &data = data_[tables.reversed[index]];
+        data.Re = tables.window[index] * buffers[ibuf][i];
+        data.Im = 0;
+      }
+    }
+    Stage<2>(tables.twiddles);
+    return data_;
+  }
+
+  const complex *Transform(complex *const buffers[]) override {
+    const Tables &tables = GetTables();
+    for (size_t ibuf = 0; ibuf < kNumBuffers; ++ibuf) {
+      for (size_t i = 0; i < kBufferSize; ++i) {
+        size_t index = kBufferSize * ibuf + i;
+        complex &data = data_[tables.reversed[index]];
+        data.Re = tables.window[index] * buffers[ibuf][i].Re;
+        data.Im = tables.window[index] * buffers[ibuf][i].Im;
+      }
+    }
+    Stage<2>(tables.twiddles);
+    return data_;
+  }
+
+private:
+  /**
+   * Radix-2 stages from kStageSize up, with the butterflies of fft().
+   */
+  template <size_t kStageSize> void Stage(const complex twiddles[]) {
+    constexpr size_t kHalf = kStageSize / 2;
+    const complex *stage = twiddles + kHalf - 1;
+    for (size_t i = 0; i < kSize; i += kStageSize) {
+      for (size_t k = 0; k < kHalf; ++k) {
+        complex &a = data_[i + k];
+        complex &b = data_[i + k + kHalf];
+        real tr = stage[k].Re * b.Re - stage[k].Im * b.Im;
+        real ti = stage[k].Re * b.Im + stage[k].Im * b.Re;
+        b.Re = a.Re - tr;
+        b.Im = a.Im - ti;
+        a.Re = a.Re + tr;
+        a.Im = a.Im + ti;
+      }
+    }
+    if constexpr (kStageSize < kSize) {
+      Stage<kStageSize * 2>(twiddles);
+    }
+  }
+};
+
+} // namespace morse
+
+#endif // MORSE_SPECTRUM_TRANSFORM_H_
@@ -0,0 +1,130 @@
+#ifndef MORSE_SPSC_QUEUE_H_
+#define MORSE_SPSC_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace morse {
+
+/**
+ * Bounded lock-free queue between exactly one producer thread and one
+ * consumer thread. Push waits while the queue is full, which holds back a
+ * faster stage, and Pop waits while it is empty. The occupancy is sampled on
+ * every push for statistics.
+ */
+template <typename T> class SpscQueue {
+private:
+  // spin this many times before sleeping on a full or an empty queue
+  static constexpr int kSpinCount = 64;
+  static constexpr std::chrono::microseconds kSleep{100};
+
+  std::vector<T> items_;
+  size_t mask_;
+
+  // the indices only grow; they are on separate cache lines since each is
+  // written by one side
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+
+  // statistics of the producer
+  alignas(64) uint64_t num_pushes_ = 0;
+  uint64_t sum_occupancy_ = 0;
+  size_t max_occupancy_ = 0;
+  uint64_t num_full_waits_ = 0;
+
+  // statistics of the consumer
+  alignas(64) uint64_t num_empty_waits_ = 0;
+
+public:
+  /**
+   * The capacity is rounded up to a power of two.
+   */
+  explicit SpscQueue(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size *= 2;
+    }
+    items_.resize(size);
+    mask_ = size - 1;
+  }
+
+  inline size_t GetCapacity() const { return items_.size(); }
+
+  bool TryPush(T *item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t occupancy = tail - head_.load(std::memory_order_acquire);
+    if (occupancy == items_.size()) {
+      return false;
+    }
+    items_[tail & mask_] = std::move(*item);
+    tail_.store(tail + 1, std::memory_order_release);
+    ++num_pushes_;
+    sum_occupancy_ += occupancy;
+    max_occupancy_ = std::max(max_occupancy_, occupancy + 1);
+    return true;
+  }
+
+  void Push(T item) {
+    if (TryPush(&item)) {
+      return;
+    }
+    ++num_full_waits_;
+    for (int spin = 0; !TryPush(&item); ++spin) {
+      Wait(spin);
+    }
+  }
+
+  bool TryPop(T *item) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *item = std::move(items_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  T Pop() {
+    T item;
+    if (TryPop(&item)) {
+      return item;
+    }
+    ++num_empty_waits_;
+    for (int spin = 0; !TryPop(&item); ++spin) {
+      Wait(spin);
+    }
+    return item;
+  }
+
+  /**
+   * Statistics; read them after both threads are done.
+   */
+  inline uint64_t GetNumPushes() const { return num_pushes_; }
+  inline double GetAverageOccupancy() const {
+    return num_pushes_ > 0 ? static_cast<double>(sum_occupancy_) / num_pushes_
+                           : 0.0;
+  }
+  inline size_t GetMaxOccupancy() const { return max_occupancy_; }
+  inline uint64_t GetNumFullWaits() const { return num_full_waits_; }
+  inline uint64_t GetNumEmptyWaits() const { return num_empty_waits_; }
+
+private:
+  static void Wait(int spin) {
+    if (spin < kSpinCount) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(kSleep);
+    }
+  }
+};
+
+} // namespace morse
+
+#endif // MORSE_SPSC_QUEUE_H_
@@ -0,0 +1,237 @@
+#include "status_segment.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace morse {
+
+static_assert(offsetof(StatusSegment, block) == kStatusHeaderSize,
+              "status header must not be padded");
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the sequence counter is shared between processes");
+
+// copies the last characters of text that fit in a status field; the reader
+// keeps an undecodable character as NUL, which is shown as '*'
+static void CopyTail(std::string_view text, char field[kStatusTextSize]) {
+  size_t length = std::min(text.size(), kStatusTextSize - 1);
+  std::string_view tail = text.substr(text.size() - length);
+  for (size_t i = 0; i < length; ++i) {
+    field[i] = tail[i] != '\0' ? tail[i] : '*';
+  }
+  field[length] = '\0';
+}
+
+// whether the process exists; one of another user cannot be signalled
+static bool IsRunning(pid_t pid) {
+  return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+// whether a segment of the name is a status segment that is closed or whose
+// decoder has died, so that its name can be taken
+static bool IsReplaceable(const std::string &name) {
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  // a segment that is still being made is smaller than its header
+  if (fstat(fd, &st) < 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(StatusSegment)) {
+    close(fd);
+    return false;
+  }
+  void *data = mmap(nullptr, sizeof(StatusSegment), PROT_READ, MAP_SHARED,
+                    fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  const auto *segment = static_cast<const StatusSegment *>(data);
+  bool replaceable =
+      memcmp(segment->magic, kStatusSegmentMagic, sizeof(segment->magic)) ==
+          0 &&
+      segment->version == kStatusSegmentVersion &&
+      (segment->closed.load(std::memory_order_acquire) != 0 ||
+       !IsRunning(segment->owner));
+  munmap(data, sizeof(StatusSegment));
+  return replaceable;
+}
+
+StatusPublisher::~StatusPublisher() { Close(); }
+
+int StatusPublisher::Open(const std::string &name) {
+  Close();
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0 && errno == EEXIST && IsReplaceable(name)) {
+    // the viewers of the old segment keep their mapping
+    shm_unlink(name.c_str());
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  }
+  if (fd < 0) {
+    return -1;
+  }
+  if (ftruncate(fd, sizeof(StatusSegment)) < 0) {
+    int saved_errno = errno;
+    close(fd);
+    shm_unlink(name.c_str());
+    errno = saved_errno;
+    return -1;
+  }
+  void *data = mmap(nullptr, sizeof(StatusSegment), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    int saved_errno = errno;
+    shm_unlink(name.c_str());
+    errno = saved_errno;
+    return -1;
+  }
+  // the new object is zero filled
+  segment_ = static_cast<StatusSegment *>(data);
+  segment_->owner = getpid();
+  memcpy(segment_->magic, kStatusSegmentMagic, sizeof(segment_->magic));
+  segment_->version = kStatusSegmentVersion;
+  segment_->block_size = sizeof(StatusBlock);
+  name_ = name;
+  candidates_.reserve(kStatusMaxHypotheses);
+  return 0;
+}
+
+void StatusPublisher::Close() {
+  if (segment_ == nullptr) {
+    return;
+  }
+  segment_->closed.store(1, std::memory_order_release);
+  munmap(segment_, sizeof(StatusSegment));
+  segment_ = nullptr;
+  // the viewers keep their mapping until they detach
+  shm_unlink(name_.c_str());
+}
+
+void StatusPublisher::CollectDetector(const MorseSignalDetector &detector) {
+  status_.num_windows = detector.GetWindowCount();
+  status_.tone_bin = detector.GetToneBin();
+  status_.level = detector.GetSignalLevel();
+  status_.signal = detector.GetCurrentSignal();
+}
+
+void StatusPublisher::CollectReader(MorseReader *reader) {
+  reader->GetWorldLines(&candidates_);
+  size_t num_hypotheses = std::min(candidates_.size(), kStatusMaxHypotheses);
+  std::partial_sort(candidates_.begin(), candidates_.begin() + num_hypotheses,
+                    candidates_.end(), [](auto a, auto b) {
+                      return a->GetConfidence() > b->GetConfidence();
+                    });
+  for (size_t i = 0; i < num_hypotheses; ++i) {
+    StatusHypothesis &hypothesis = status_.hypotheses[i];
+    hypothesis.confidence = candidates_[i]->GetConfidence();
+    hypothesis.dot_length = candidates_[i]->GetDotLength();
+    CopyTail(candidates_[i]->GetCharacters(), hypothesis.characters);
+  }
+  status_.num_hypotheses = num_hypotheses;
+  status_.num_world_lines = reader->GetNumWorldLines();
+  status_.peak_num_world_lines = reader->GetPeakNumWorldLines();
+  status_.num_committed = reader->GetNumCommitted();
+  CopyTail(reader->GetCommittedCharacters(), status_.committed);
+}
+
+void StatusPublisher::Publish() {
+  if (segment_ == nullptr) {
+    return;
+  }
+  // odd while the block is being copied
+  uint64_t sequence = segment_->sequence.load(std::memory_order_relaxed);
+  segment_->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&segment_->block, &status_, sizeof(status_));
+  segment_->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+StatusViewer::~StatusViewer() { Detach(); }
+
+int StatusViewer::Attach(const std::string &name) {
+  Detach();
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  // a segment that is still being made is smaller than its header
+  if (static_cast<size_t>(st.st_size) < sizeof(StatusSegment)) {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+  void *data = mmap(nullptr, sizeof(StatusSegment), PROT_READ, MAP_SHARED,
+                    fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+  const auto *segment = static_cast<const StatusSegment *>(data);
+  if (memcmp(segment->magic, kStatusSegmentMagic, sizeof(segment->magic)) !=
+          0 ||
+      segment->version != kStatusSegmentVersion ||
+      segment->block_size != sizeof(StatusBlock)) {
+    munmap(data, sizeof(StatusSegment));
+    errno = EINVAL;
+    return -1;
+  }
+  segment_ = segment;
+  return 0;
+}
+
+void StatusViewer::Detach() {
+  if (segment_ != nullptr) {
+    munmap(const_cast<StatusSegment *>(segment_), sizeof(StatusSegment));
+    segment_ = nullptr;
+  }
+}
+
+bool StatusViewer::IsClosed() const {
+  return segment_ != nullptr &&
+         segment_->closed.load(std::memory_order_acquire) != 0;
+}
+
+bool StatusViewer::IsStale() const {
+  return segment_ != nullptr &&
+         segment_->closed.load(std::memory_order_acquire) == 0 &&
+         !IsRunning(segment_->owner);
+}
+
+bool StatusViewer::Read(StatusBlock *status) const {
+  if (segment_ == nullptr) {
+    return false;
+  }
+  for (size_t i = 0; i < kStatusReadRetries; ++i) {
+    uint64_t before = segment_->sequence.load(std::memory_order_acquire);
+    if (before == 0) {
+      return false;
+    }
+    if (before % 2 == 0) {
+      memcpy(status, &segment_->block, sizeof(*status));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (segment_->sequence.load(std::memory_order_relaxed) == before) {
+        return true;
+      }
+    }
+    // the decoder may be preempted in the middle of its copy
+    sched_yield();
+  }
+  return false;
+}
+
+} // namespace morse
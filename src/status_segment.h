@@ -0,0 +1,186 @@
+#ifndef MORSE_STATUS_SEGMENT_H_
+#define MORSE_STATUS_SEGMENT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "morse_reader.h"
+#include "morse_signal_detector.h"
+#include "world_line.h"
+
+namespace morse {
+
+/*
+ * Status segment is a POSIX shared memory object where a running decoder
+ * publishes its live status, so that any number of viewers can attach and
+ * detach while it runs. The decoder only copies a status block into it; the
+ * block is guarded by a sequence counter that is odd while the copy is in
+ * progress, and a viewer retries its own copy until it sees the same even
+ * count before and after. All fields are in host byte order.
+ *
+ * The segment records the process id of its decoder, so that a second
+ * decoder does not take over the name while the first one runs, and a viewer
+ * can tell a segment left by a decoder that died.
+ *
+ *   header : "MSTS" followed by 32-bit version, size of the block, closed
+ *            flag, the 64-bit sequence counter, and the 32-bit process id of
+ *            the decoder, padded to kStatusHeaderSize bytes
+ *   block  : StatusBlock
+ */
+static const char kStatusSegmentMagic[] = {'M', 'S', 'T', 'S'};
+static const uint32_t kStatusSegmentVersion = 2;
+static const size_t kStatusHeaderSize = 64;
+// copies a viewer tries before it gives up on a consistent status
+static const size_t kStatusReadRetries = 1000;
+
+// hypotheses and characters carried by a status block
+static const size_t kStatusMaxHypotheses = 8;
+static const size_t kStatusTextSize = 96;
+
+struct StatusHypothesis {
+  float confidence;
+  // in windows
+  float dot_length;
+  // the last characters that are not committed yet, NUL terminated
+  char characters[kStatusTextSize];
+};
+
+struct StatusBlock {
+  uint32_t sample_rate;
+  uint32_t hop_size;
+  uint32_t fft_size;
+  // the tone bin is of the mixed down spectrum when decimated
+  uint32_t decimation;
+  // throughput; the samples and windows decoded over the wall clock seconds
+  // since the start
+  uint64_t num_samples;
+  uint64_t num_windows;
+  double elapsed;
+  uint64_t num_overruns;
+
+  // the tone in bins of the FFT size, fractional with the frequency tracking
+  double tone_bin;
+  float level;
+  uint8_t signal;
+  uint8_t reserved2[3];
+
+  uint64_t num_committed;
+  uint32_t num_world_lines;
+  uint32_t peak_num_world_lines;
+  // by descending confidence
+  uint32_t num_hypotheses;
+  uint32_t reserved3;
+  StatusHypothesis hypotheses[kStatusMaxHypotheses];
+  // the last committed characters, NUL terminated
+  char committed[kStatusTextSize];
+};
+
+struct StatusSegment {
+  char magic[4];
+  uint32_t version;
+  uint32_t block_size;
+  std::atomic<uint32_t> closed;
+  std::atomic<uint64_t> sequence;
+  int32_t owner;
+  uint8_t reserved[kStatusHeaderSize - 28];
+  StatusBlock block;
+};
+
+/**
+ * Publishes the status of a decoder to a status segment. The status is
+ * collected into a private block off the segment and published with a single
+ * copy, so viewers never hold the decoder back.
+ */
+class StatusPublisher {
+private:
+  std::string name_;
+  StatusSegment *segment_ = nullptr;
+  StatusBlock status_{};
+  std::vector<const WorldLine *> candidates_;
+
+public:
+  StatusPublisher() = default;
+  StatusPublisher(const StatusPublisher &) = delete;
+  StatusPublisher &operator=(const StatusPublisher &) = delete;
+  virtual ~StatusPublisher();
+
+  /**
+   * Creates the segment of the name, e.g. "/morse", replacing one that is
+   * closed or whose decoder has died. Returns -1 with errno set on failure;
+   * EEXIST if a running decoder or another program holds the name.
+   */
+  int Open(const std::string &name);
+
+  /**
+   * Marks the segment closed for the viewers and removes its name.
+   */
+  void Close();
+
+  /**
+   * The block to fill before Publish; the counters are kept across calls.
+   */
+  inline StatusBlock *GetStatus() { return &status_; }
+
+  /**
+   * Takes the tone, its level, and the latest decision of a detector.
+   */
+  void CollectDetector(const MorseSignalDetector &detector);
+
+  /**
+   * Takes the most confident world lines and the committed characters of a
+   * reader.
+   */
+  void CollectReader(MorseReader *reader);
+
+  void Publish();
+};
+
+/**
+ * Reads the status of a decoder from its status segment.
+ */
+class StatusViewer {
+private:
+  const StatusSegment *segment_ = nullptr;
+
+public:
+  StatusViewer() = default;
+  StatusViewer(const StatusViewer &) = delete;
+  StatusViewer &operator=(const StatusViewer &) = delete;
+  virtual ~StatusViewer();
+
+  /**
+   * Maps the segment of the name read only. Returns -1 with errno set on
+   * failure; EINVAL if it is not a status segment of this version.
+   */
+  int Attach(const std::string &name);
+  void Detach();
+
+  inline bool IsAttached() const { return segment_ != nullptr; }
+
+  /**
+   * Whether the decoder has ended; the segment then keeps its last status.
+   */
+  bool IsClosed() const;
+
+  /**
+   * Whether the decoder has died without closing the segment. A status read
+   * from it may be its last one, if any.
+   */
+  bool IsStale() const;
+
+  /**
+   * Copies a consistent status. Returns false if nothing is published yet,
+   * or if no consistent copy is seen within kStatusReadRetries, as in a
+   * segment whose decoder died while publishing.
+   */
+  bool Read(StatusBlock *status) const;
+};
+
+} // namespace morse
+
+#endif // MORSE_STATUS_SEGMENT_H_
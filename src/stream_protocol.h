@@ -0,0 +1,31 @@
+#ifndef MORSE_STREAM_PROTOCOL_H_
+#define MORSE_STREAM_PROTOCOL_H_
+
+#include <stdint.h>
+
+namespace morse {
+
+/*
+ * Protocol of morse_daemon on a Unix-domain stream socket. The client sends
+ * a StreamHeader followed by 16-bit mono samples in host byte order, and
+ * shuts down its side at the end of the stream. The daemon sends back the
+ * decoded characters as text as they are decided; a retracted character is
+ * a backspace, and the end of the stream is a newline after the rest of the
+ * text. A stream that the daemon does not take gets a line starting with
+ * kRejectPrefix and is closed.
+ */
+static const char kStreamMagic[] = {'M', 'S', 'T', 'R'};
+static const char kRejectPrefix[] = "ERROR ";
+
+struct StreamHeader {
+  char magic[4];
+  uint32_t sample_rate;
+  // tone frequency in Hz and the fastest expected speed in WPM, see
+  // AnalysisSettings
+  float tone_frequency;
+  float max_wpm;
+};
+
+} // namespace morse
+
+#endif // MORSE_STREAM_PROTOCOL_H_
@@ -0,0 +1,574 @@
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "morse_keyer.h"
+#include "morse_reader.h"
+#include "parameters.h"
+#include "pattern_file.h"
+#include "world_line.h"
+
+/**
+ * Replays a corpus of adversarial patterns through the reader and checks that
+ * the hypotheses stay bounded: the peak number of live world lines, the forks
+ * over the whole pattern, the bytes held, the cost of a window, and the cap
+ * of shed load across a rewind. The corpus is made of the keying that forks
+ * the world lines the most, e.g. marks between a dot and a dash. Some of it
+ * forks without bound, so every pattern is replayed under a cap, and the
+ * limits follow from the cap and the keying rather than from what the
+ * current reader does.
+ */
+
+namespace {
+
+// pattern timing; a dot of 6 windows is 20 WPM with a hop of 10 ms
+const uint32_t kSampleRate = 8000;
+const uint32_t kHopSize = 80;
+const double kDotLength = 6.0;
+
+const int kRepeats = 3;
+
+using Runs = std::vector<std::pair<uint8_t, uint64_t>>;
+
+/**
+ * Appends a run of at least a window, merged into the last one of the same
+ * level.
+ */
+void Put(uint8_t level, double num_windows, Runs *runs) {
+  uint64_t n = std::max<long>(1, lround(num_windows));
+  if (!runs->empty() && runs->back().first == level) {
+    runs->back().second += n;
+  } else {
+    runs->emplace_back(level, n);
+  }
+}
+
+/**
+ * Gives the length of a mark or a gap in windows from its nominal length in
+ * dots.
+ */
+using Keying = std::function<double(bool mark, double dots)>;
+
+/**
+ * Keys the text with the keying.
+ */
+void KeyRuns(const char *text, const Keying &keying, Runs *runs) {
+  morse::KeyText(text, [&](bool mark, int dots) {
+    Put(mark ? 1 : 0, keying(mark, dots), runs);
+  });
+}
+
+void KeyRepeats(const Keying &keying, Runs *runs) {
+  for (int i = 0; i < kRepeats; ++i) {
+    KeyRuns(morse::kKeyerText, keying, runs);
+  }
+}
+
+double Uniform(double min, double max, std::mt19937 *engine) {
+  return std::uniform_real_distribution<double>(min, max)(*engine);
+}
+
+double Exact(bool, double dots) { return dots * kDotLength; }
+
+/*
+ * Marks squeezed into 1.5 to 2.5 dots, between ambiguous_ratio and
+ * break_ratio, so that every drop may be either element.
+ */
+void MakeAmbiguous(std::mt19937 *engine, Runs *runs) {
+  KeyRepeats(
+      [engine](bool mark, double dots) {
+        if (!mark) {
+          return Exact(mark, dots);
+        }
+        // dots in the lower half, dashes in the upper
+        double min = dots < 2 ? 1.5 : 2.0;
+        return kDotLength * Uniform(min, min + 0.5, engine);
+      },
+      runs);
+}
+
+/*
+ * A preamble of equal marks and gaps before the dot length is known, which
+ * keep both readings of the unconditional fork on the first drop alive,
+ * followed by regular code.
+ */
+void MakeFirstDrop(std::mt19937 *, Runs *runs) {
+  Put(0, 4 * kDotLength, runs);
+  for (int i = 0; i < 40; ++i) {
+    Put(1, 2 * kDotLength, runs);
+    Put(0, 2 * kDotLength, runs);
+  }
+  KeyRepeats(Exact, runs);
+}
+
+/*
+ * Hand keying: every element and gap off by a log-normal factor, with the
+ * speed drifting by 30% back and forth.
+ */
+void MakeJitter(std::mt19937 *engine, Runs *runs) {
+  std::lognormal_distribution<double> mark_jitter(0.0, 0.25);
+  std::lognormal_distribution<double> gap_jitter(0.0, 0.35);
+  double phase = 0.0;
+  KeyRepeats(
+      [&](bool mark, double dots) {
+        phase += 0.01;
+        double dot = kDotLength * (1.0 + 0.3 * sin(phase));
+        return dots * dot * (mark ? mark_jitter(*engine) : gap_jitter(*engine));
+      },
+      runs);
+}
+
+/*
+ * Gaps within a character stretched over 1.5 to 3.5 dots, across the
+ * boundary of a character break.
+ */
+void MakeGaps(std::mt19937 *engine, Runs *runs) {
+  KeyRepeats(
+      [engine](bool mark, double dots) {
+        if (mark || dots > 1) {
+          return Exact(mark, dots);
+        }
+        return kDotLength * Uniform(1.5, 3.5, engine);
+      },
+      runs);
+}
+
+/*
+ * Regular code broken by single windows: dropouts in a tenth of the marks
+ * and blips in a tenth of the gaps.
+ */
+void MakeGlitch(std::mt19937 *engine, Runs *runs) {
+  Runs clean;
+  KeyRepeats(Exact, &clean);
+  for (const auto &run : clean) {
+    if (run.second >= 3 && Uniform(0.0, 1.0, engine) < 0.1) {
+      uint64_t at = 1 + (*engine)() % (run.second - 2);
+      Put(run.first, at, runs);
+      Put(!run.first, 1, runs);
+      Put(run.first, run.second - at - 1, runs);
+    } else {
+      Put(run.first, run.second, runs);
+    }
+  }
+}
+
+/*
+ * The speed jumping between the dot length, half, and twice of it at every
+ * word.
+ */
+void MakeSpeed(std::mt19937 *, Runs *runs) {
+  static const double kScales[] = {1.0, 0.5, 2.0};
+  size_t word = 0;
+  Keying keying = [&word](bool, double dots) {
+    return dots * kDotLength * kScales[word % 3];
+  };
+  for (int i = 0; i < kRepeats; ++i) {
+    for (const char *p = morse::kKeyerText; *p != '\0'; ++p) {
+      if (*p == ' ') {
+        ++word;
+      }
+      char c[2] = {*p, '\0'};
+      KeyRuns(c, keying, runs);
+    }
+  }
+}
+
+/*
+ * Marks and gaps of random lengths from 2 to 40 windows, which no dot length
+ * explains.
+ */
+void MakeUntimed(std::mt19937 *engine, Runs *runs) {
+  for (int i = 0; i < 1500; ++i) {
+    Put(1, Uniform(2, 40, engine), runs);
+    Put(0, Uniform(2, 40, engine), runs);
+  }
+}
+
+struct Pattern {
+  const char *name;
+  void (*make)(std::mt19937 *engine, Runs *runs);
+};
+
+const Pattern kCorpus[] = {
+    {"ambiguous", MakeAmbiguous}, {"first-drop", MakeFirstDrop},
+    {"jitter", MakeJitter},       {"gaps", MakeGaps},
+    {"glitch", MakeGlitch},       {"speed", MakeSpeed},
+    {"untimed", MakeUntimed},
+};
+
+// cap of the reader; some patterns fork without bound without one
+const size_t kDefaultCap = 256;
+
+// symbols of the longest character with its break in the signals of a line
+const size_t kMaxSignalsPerCharacter = 8;
+
+// the rewind check sheds load to this cap, the highest load level of
+// read_morse, and rewinds the reader every so many windows
+const size_t kShedCap = 8;
+const size_t kRewindInterval = 64;
+
+struct Entry {
+  std::string file_name;
+  Runs runs;
+  uint32_t sample_rate = 0;
+  uint32_t hop_size = 0;
+  // max_world_lines of the reader
+  size_t cap = 0;
+};
+
+struct Measure {
+  uint64_t num_windows = 0;
+  size_t peak_world_lines = 0;
+  uint64_t num_forks = 0;
+  size_t peak_memory = 0;
+  // per window, in seconds
+  double mean_cost = 0.0;
+  double max_cost = 0.0;
+  bool exploded = false;
+};
+
+/**
+ * Returns the number of rises and drops of the runs. A world line forks at
+ * most once on each of them.
+ */
+uint64_t CountEdges(const Runs &runs) {
+  uint64_t num_edges = 0;
+  uint8_t level = 0;
+  for (const auto &run : runs) {
+    num_edges += run.second > 0 && run.first != level;
+    level = run.second > 0 ? run.first : level;
+  }
+  return num_edges;
+}
+
+/**
+ * Returns the bytes that a world line may hold with the parameters: itself,
+ * and the signals, the characters, and the word for the commit_lead
+ * characters it keeps and the one it reads, with room for a string to grow
+ * to twice its length.
+ */
+size_t LineFootprint(const morse::ReaderParameters &parameters) {
+  size_t num_characters = parameters.commit_lead + 1;
+  size_t num_bytes = num_characters * kMaxSignalsPerCharacter + 1 +
+                     2 * (num_characters + 1);
+  return sizeof(morse::WorldLine) + 2 * num_bytes;
+}
+
+/**
+ * Returns the bytes that a reader may hold with the parameters: its world
+ * lines, and itself with the characters committed in a window, as much as a
+ * line holds.
+ */
+size_t MemoryCeiling(const morse::ReaderParameters &parameters) {
+  return sizeof(morse::MorseReader) +
+         (parameters.max_world_lines + 1) * LineFootprint(parameters);
+}
+
+/**
+ * Replays the runs with a fresh reader under the cap, taking the committed
+ * characters as a decoder does, and stops once the live world lines exceed
+ * the cap.
+ */
+void Replay(const Runs &runs, size_t cap, Measure *measure) {
+  morse::ReaderParameters parameters{};
+  parameters.max_world_lines = cap;
+  morse::MorseReader reader(parameters);
+  double total = 0.0;
+  for (const auto &run : runs) {
+    for (uint64_t i = 0; i < run.second && !measure->exploded; ++i) {
+      double start = morse::MonotonicTime();
+      reader.Update(run.first);
+      double cost = morse::MonotonicTime() - start;
+      total += cost;
+      measure->max_cost = std::max(measure->max_cost, cost);
+      ++measure->num_windows;
+      reader.ReleaseCommittedCharacters();
+      measure->peak_memory =
+          std::max(measure->peak_memory, reader.GetMemoryUsage());
+      measure->exploded = reader.GetNumWorldLines() > cap;
+    }
+  }
+  measure->peak_world_lines = reader.GetPeakNumWorldLines();
+  measure->num_forks = reader.GetNumForks();
+  measure->mean_cost =
+      measure->num_windows > 0 ? total / measure->num_windows : 0.0;
+}
+
+/**
+ * Replays the runs with load shed halfway through and the reader rewound to
+ * a snapshot at every interval from there, as MorseSignalDetector::Correct
+ * does, and returns false if a rewind undoes the shed cap.
+ */
+bool ReplayShedRewind(const Runs &runs, size_t cap) {
+  std::vector<uint8_t> levels;
+  for (const auto &run : runs) {
+    levels.insert(levels.end(), run.second, run.first);
+  }
+  morse::ReaderParameters parameters{};
+  parameters.max_world_lines = cap;
+  morse::ReaderParameters shed = parameters;
+  shed.max_world_lines = kShedCap;
+  morse::MorseReader reader(parameters);
+  morse::MorseReader snapshot(parameters);
+  size_t shed_window = levels.size() / 2 / kRewindInterval * kRewindInterval;
+  for (size_t window = 0; window < levels.size(); ++window) {
+    if (window % kRewindInterval == 0) {
+      snapshot.CopyFrom(reader);
+    }
+    if (window == shed_window) {
+      reader.SetParameters(shed);
+    }
+    reader.Update(levels[window]);
+    if (window >= shed_window &&
+        window % kRewindInterval == kRewindInterval - 1) {
+      reader.CopyFrom(snapshot);
+      for (size_t i = window + 1 - kRewindInterval; i <= window; ++i) {
+        reader.Update(levels[i]);
+      }
+      if (reader.GetParameters().max_world_lines != kShedCap ||
+          reader.GetNumWorldLines() > kShedCap) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int ReadPattern(const std::string &file_name, Entry *entry) {
+  morse::PatternReader pattern{};
+  if (pattern.Open(file_name) < 0) {
+    fprintf(stderr, "File error: %s: %s\n", file_name.c_str(),
+            strerror(errno));
+    return -1;
+  }
+  entry->sample_rate = pattern.GetSampleRate();
+  entry->hop_size = pattern.GetHopSize();
+  uint8_t level;
+  uint64_t num_windows;
+  while (pattern.Next(&level, &num_windows)) {
+    entry->runs.emplace_back(level, num_windows);
+  }
+  return 0;
+}
+
+int WritePattern(const std::string &file_name, const Runs &runs) {
+  morse::PatternWriter writer{};
+  if (writer.Open(file_name, kSampleRate, kHopSize) < 0) {
+    fprintf(stderr, "File error: %s: %s\n", file_name.c_str(),
+            strerror(errno));
+    return -1;
+  }
+  for (const auto &run : runs) {
+    for (uint64_t i = 0; i < run.second; ++i) {
+      writer.Add(run.first);
+    }
+  }
+  if (writer.Close() < 0) {
+    fprintf(stderr, "File error: %s: %s\n", file_name.c_str(),
+            strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+std::string DirectoryOf(const std::string &file_name) {
+  size_t slash = file_name.rfind('/');
+  return slash == std::string::npos ? "" : file_name.substr(0, slash + 1);
+}
+
+/**
+ * Loads the manifest, a line <file><TAB><cap> for each pattern, relative to
+ * the manifest.
+ */
+int LoadManifest(const char *manifest_name, std::vector<Entry> *entries) {
+  FILE *file = fopen(manifest_name, "r");
+  if (file == nullptr) {
+    fprintf(stderr, "File error: %s: %s\n", manifest_name, strerror(errno));
+    return -1;
+  }
+  std::string directory = DirectoryOf(manifest_name);
+  char line[4096];
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    line[strcspn(line, "\r\n")] = 0;
+    char *tab = strchr(line, '\t');
+    if (line[0] == '#' || tab == nullptr) {
+      continue;
+    }
+    *tab = 0;
+    Entry entry;
+    entry.cap = strtoul(tab + 1, nullptr, 10);
+    if (entry.cap == 0) {
+      fprintf(stderr, "%s: %s: no cap\n", manifest_name, line);
+      fclose(file);
+      return -1;
+    }
+    std::string file_name = line[0] == '/' ? line : directory + line;
+    if (ReadPattern(file_name, &entry) < 0) {
+      fclose(file);
+      return -1;
+    }
+    entry.file_name = line;
+    entries->push_back(std::move(entry));
+  }
+  fclose(file);
+  return 0;
+}
+
+/**
+ * Writes the corpus and its manifest into the directory, every pattern under
+ * the cap.
+ */
+int Generate(const std::string &directory, unsigned int seed, size_t cap) {
+  std::string manifest_name = directory + "/manifest.txt";
+  FILE *manifest = fopen(manifest_name.c_str(), "w");
+  if (manifest == nullptr) {
+    fprintf(stderr, "File error: %s: %s\n", manifest_name.c_str(),
+            strerror(errno));
+    return -1;
+  }
+  fprintf(manifest,
+          "# stress_morse -g <directory> -s %u -l %zu\n"
+          "# <file><TAB><cap>\n",
+          seed, cap);
+  for (const auto &pattern : kCorpus) {
+    std::mt19937 engine(seed);
+    Runs runs;
+    pattern.make(&engine, &runs);
+    std::string file_name = std::string("stress-") + pattern.name + ".ptn";
+    if (WritePattern(directory + "/" + file_name, runs) < 0) {
+      fclose(manifest);
+      return -1;
+    }
+    fprintf(manifest, "%s\t%zu\n", file_name.c_str(), cap);
+  }
+  if (fclose(manifest) != 0) {
+    fprintf(stderr, "File error: %s: %s\n", manifest_name.c_str(),
+            strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+void Usage(const char *program) {
+  fprintf(stderr, "Usage: %s [options] <manifest>\n", program);
+  fprintf(stderr, "       %s -g <directory> [options]\n", program);
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "  -g <directory> : Generate the corpus and its manifest\n");
+  fprintf(stderr, "  -s <seed> : Seed of the corpus\n");
+  fprintf(stderr, "  -u <us> : Limit of the mean cost of a window\n");
+  fprintf(stderr, "  -l <num> : Cap of the world lines for the generated "
+                  "patterns (default %zu)\n",
+          kDefaultCap);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const char *directory = nullptr;
+  unsigned int seed = 1;
+  double max_mean_us = 100.0;
+  size_t cap = kDefaultCap;
+  while (true) {
+    int c = getopt(argc, argv, "g:s:u:l:");
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'g':
+      directory = optarg;
+      break;
+    case 's':
+      seed = strtoul(optarg, nullptr, 10);
+      break;
+    case 'u':
+      max_mean_us = strtod(optarg, nullptr);
+      break;
+    case 'l':
+      cap = std::max(1ul, strtoul(optarg, nullptr, 10));
+      break;
+    default:
+      Usage(basename(argv[0]));
+      return 1;
+    }
+  }
+
+  if (directory != nullptr) {
+    return Generate(directory, seed, cap) < 0 ? 1 : 0;
+  }
+  if (optind + 1 != argc) {
+    Usage(basename(argv[0]));
+    return 1;
+  }
+
+  std::vector<Entry> entries;
+  if (LoadManifest(argv[optind], &entries) < 0) {
+    return 1;
+  }
+  if (entries.empty()) {
+    fprintf(stderr, "%s: no patterns\n", argv[optind]);
+    return 1;
+  }
+
+  printf("%-24s %8s %4s %6s %8s %8s %7s %7s %7s %7s\n", "pattern",
+         "windows", "cap", "peak", "forks", "limit", "kB", "limit", "mean_us",
+         "max_us");
+  bool passed = true;
+  for (const auto &entry : entries) {
+    Measure measure{};
+    Replay(entry.runs, entry.cap, &measure);
+    // the bounds follow from the cap alone: a world line forks at most once
+    // on a rise or a drop, and holds at most its footprint
+    uint64_t max_forks = CountEdges(entry.runs) * entry.cap;
+    morse::ReaderParameters parameters{};
+    parameters.max_world_lines = entry.cap;
+    size_t max_memory = MemoryCeiling(parameters);
+    std::vector<std::string> failures;
+    if (measure.exploded || measure.peak_world_lines > entry.cap) {
+      failures.push_back("world lines");
+    }
+    if (measure.num_forks > max_forks) {
+      failures.push_back("forks");
+    }
+    if (measure.peak_memory > max_memory) {
+      failures.push_back("memory");
+    }
+    if (!ReplayShedRewind(entry.runs, entry.cap)) {
+      failures.push_back("shed rewind");
+    }
+    if (measure.mean_cost * 1.e6 > max_mean_us) {
+      failures.push_back("mean cost");
+    }
+    // a window must not take longer than it lasts
+    if (entry.sample_rate > 0 &&
+        measure.max_cost > static_cast<double>(entry.hop_size) /
+                               entry.sample_rate) {
+      failures.push_back("max cost");
+    }
+    printf("%-24s %8llu %4zu %6zu %8llu %8llu %7zu %7zu %7.2f %7.1f",
+           entry.file_name.c_str(),
+           static_cast<unsigned long long>(measure.num_windows), entry.cap,
+           measure.peak_world_lines,
+           static_cast<unsigned long long>(measure.num_forks),
+           static_cast<unsigned long long>(max_forks),
+           measure.peak_memory / 1024, max_memory / 1024,
+           measure.mean_cost * 1.e6, measure.max_cost * 1.e6);
+    for (const auto &failure : failures) {
+      printf(" %s", failure.c_str());
+    }
+    printf("\n");
+    passed &= failures.empty();
+  }
+  printf("%s\n", passed ? "PASS" : "FAIL");
+  return passed ? 0 : 1;
+}
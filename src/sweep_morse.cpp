@@ -0,0 +1,454 @@
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "morse_reader.h"
+#include "morse_signal_detector.h"
+#include "parameters.h"
+#include "pattern_file.h"
+#include "spectrum_capture.h"
+
+/**
+ * Evaluates settings of the detector and reader parameters against labeled
+ * recordings. Recordings are spectrum captures (read_morse -c), so that the
+ * FFT is not repeated for every setting, or pattern files, which only
+ * exercise the reader.
+ */
+
+namespace {
+
+// number of points a range is split into on a grid search
+const size_t kGridSteps = 5;
+
+struct Setting {
+  morse::DetectorParameters detector;
+  morse::ReaderParameters reader;
+};
+
+struct ParameterSpec {
+  const char *name;
+  void (*set)(Setting *setting, double value);
+};
+
+const ParameterSpec kParameters[] = {
+    {"turn_on_level",
+     [](Setting *s, double v) { s->detector.turn_on_level = v; }},
+    {"turn_off_ratio",
+     [](Setting *s, double v) { s->detector.turn_off_ratio = v; }},
+    {"rise_factor", [](Setting *s, double v) { s->detector.rise_factor = v; }},
+    {"drop_factor", [](Setting *s, double v) { s->detector.drop_factor = v; }},
+    {"min_toggle_interval",
+     [](Setting *s, double v) { s->detector.min_toggle_interval = v; }},
+    {"min_element_ratio",
+     [](Setting *s, double v) { s->reader.min_element_ratio = v; }},
+    {"ambiguous_ratio",
+     [](Setting *s, double v) { s->reader.ambiguous_ratio = v; }},
+    {"dash_ratio", [](Setting *s, double v) { s->reader.dash_ratio = v; }},
+    {"break_ratio", [](Setting *s, double v) { s->reader.break_ratio = v; }},
+    {"letter_space_ratio",
+     [](Setting *s, double v) { s->reader.letter_space_ratio = v; }},
+    {"word_space_ratio",
+     [](Setting *s, double v) { s->reader.word_space_ratio = v; }},
+    {"max_dash_ratio",
+     [](Setting *s, double v) { s->reader.max_dash_ratio = v; }},
+    {"long_break_ratio",
+     [](Setting *s, double v) { s->reader.long_break_ratio = v; }},
+    {"prune_ratio", [](Setting *s, double v) { s->reader.prune_ratio = v; }},
+    {"dot_length_window",
+     [](Setting *s, double v) { s->reader.dot_length_window = v; }},
+};
+
+/**
+ * A parameter to sweep, either a list of values or a range.
+ */
+struct Axis {
+  const ParameterSpec *spec;
+  std::vector<double> values;
+  bool is_range = false;
+};
+
+struct Recording {
+  std::string file_name;
+  std::string expected;
+  std::unique_ptr<morse::SpectrumCaptureReader> capture;
+  std::vector<std::pair<uint8_t, uint64_t>> runs; // pattern file
+};
+
+struct Result {
+  std::vector<double> values;
+  double accuracy = 0.0;
+  double cpu_time = 0.0; // seconds
+  size_t peak_world_lines = 0;
+};
+
+std::string Normalize(const std::string &text) {
+  std::string result;
+  for (char c : text) {
+    if (c == ' ' || c == '\t') {
+      if (!result.empty() && result.back() != ' ') {
+        result.push_back(' ');
+      }
+    } else {
+      result.push_back(toupper(static_cast<unsigned char>(c)));
+    }
+  }
+  if (!result.empty() && result.back() == ' ') {
+    result.pop_back();
+  }
+  return result;
+}
+
+size_t EditDistance(const std::string &a, const std::string &b) {
+  std::vector<size_t> row(b.size() + 1);
+  for (size_t j = 0; j <= b.size(); ++j) {
+    row[j] = j;
+  }
+  for (size_t i = 1; i <= a.size(); ++i) {
+    size_t diagonal = row[0];
+    row[0] = i;
+    for (size_t j = 1; j <= b.size(); ++j) {
+      size_t above = row[j];
+      row[j] = std::min({row[j] + 1, row[j - 1] + 1,
+                         diagonal + (a[i - 1] == b[j - 1] ? 0 : 1)});
+      diagonal = above;
+    }
+  }
+  return row[b.size()];
+}
+
+double ThreadCpuTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1.e-9;
+}
+
+bool ParseAxis(const char *arg, Axis *axis) {
+  const char *equal = strchr(arg, '=');
+  if (equal == nullptr) {
+    return false;
+  }
+  std::string name(arg, equal - arg);
+  axis->spec = nullptr;
+  for (const auto &spec : kParameters) {
+    if (name == spec.name) {
+      axis->spec = &spec;
+    }
+  }
+  if (axis->spec == nullptr) {
+    fprintf(stderr, "unknown parameter: %s\n", name.c_str());
+    return false;
+  }
+
+  const char *p = equal + 1;
+  char *end;
+  double first = strtod(p, &end);
+  if (end == p) {
+    return false;
+  }
+  if (*end == ':') {
+    p = end + 1;
+    double last = strtod(p, &end);
+    if (end == p || *end != 0) {
+      return false;
+    }
+    axis->is_range = true;
+    axis->values = {first, last};
+    return true;
+  }
+  axis->values.push_back(first);
+  while (*end == ',') {
+    p = end + 1;
+    axis->values.push_back(strtod(p, &end));
+    if (end == p) {
+      return false;
+    }
+  }
+  return *end == 0;
+}
+
+int LoadManifest(const char *manifest_name, std::vector<Recording> *recordings) {
+  FILE *file = fopen(manifest_name, "r");
+  if (file == nullptr) {
+    fprintf(stderr, "File error: %s: %s\n", manifest_name, strerror(errno));
+    return -1;
+  }
+  char line[4096];
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    line[strcspn(line, "\r\n")] = 0;
+    char *tab = strchr(line, '\t');
+    if (line[0] == '#' || tab == nullptr) {
+      continue;
+    }
+    *tab = 0;
+    Recording recording;
+    recording.file_name = line;
+    recording.expected = Normalize(tab + 1);
+
+    auto capture = std::make_unique<morse::SpectrumCaptureReader>();
+    if (capture->Open(recording.file_name) == 0) {
+      recording.capture = std::move(capture);
+    } else if (errno == EINVAL) {
+      morse::PatternReader pattern{};
+      if (pattern.Open(recording.file_name) < 0) {
+        fprintf(stderr, "File error: %s: %s\n", recording.file_name.c_str(),
+                strerror(errno));
+        fclose(file);
+        return -1;
+      }
+      uint8_t level;
+      uint64_t num_windows;
+      while (pattern.Next(&level, &num_windows)) {
+        recording.runs.emplace_back(level, num_windows);
+      }
+    } else {
+      fprintf(stderr, "File error: %s: %s\n", recording.file_name.c_str(),
+              strerror(errno));
+      fclose(file);
+      return -1;
+    }
+    recordings->push_back(std::move(recording));
+  }
+  fclose(file);
+  return 0;
+}
+
+/**
+ * Decodes a recording with the setting and returns the transcript.
+ */
+std::string Decode(const Recording &recording, const Setting &setting,
+                   size_t *peak_world_lines) {
+  auto *morse_reader = new morse::MorseReader(setting.reader);
+  std::string text;
+  if (recording.capture != nullptr) {
+    const auto &header = recording.capture->GetHeader();
+    // the detector takes the ownership of the reader
+    morse::MorseSignalDetector detector(morse_reader, 1, header.fft_size,
+                                        header.center_bin);
+    detector.SetParameters(setting.detector);
+    for (size_t i = 0; i < recording.capture->GetNumWindows(); ++i) {
+      detector.ProcessSpectrum(recording.capture->GetWindow(i), nullptr);
+    }
+    detector.Drain(nullptr);
+    text = morse_reader->GetCharacters();
+    *peak_world_lines = morse_reader->GetPeakNumWorldLines();
+  } else {
+    for (const auto &run : recording.runs) {
+      for (uint64_t i = 0; i < run.second; ++i) {
+        morse_reader->Update(run.first);
+      }
+    }
+    text = morse_reader->GetCharacters();
+    *peak_world_lines = morse_reader->GetPeakNumWorldLines();
+    delete morse_reader;
+  }
+  return text;
+}
+
+void Evaluate(const std::vector<Recording> &recordings,
+              const std::vector<Axis> &axes, Result *result) {
+  Setting setting{};
+  for (size_t i = 0; i < axes.size(); ++i) {
+    axes[i].spec->set(&setting, result->values[i]);
+  }
+
+  double start = ThreadCpuTime();
+  double sum_accuracy = 0.0;
+  for (const auto &recording : recordings) {
+    size_t peak_world_lines;
+    std::string text = Normalize(Decode(recording, setting, &peak_world_lines));
+    size_t length = std::max<size_t>(recording.expected.size(), 1);
+    double errors = EditDistance(text, recording.expected);
+    sum_accuracy += std::max(0.0, 1.0 - errors / length);
+    result->peak_world_lines =
+        std::max(result->peak_world_lines, peak_world_lines);
+  }
+  result->cpu_time = ThreadCpuTime() - start;
+  result->accuracy = sum_accuracy / recordings.size();
+}
+
+/**
+ * Enumerates the cartesian product of the axes. Ranges are split into
+ * kGridSteps points.
+ */
+void MakeGrid(const std::vector<Axis> &axes, std::vector<Result> *results) {
+  std::vector<std::vector<double>> points;
+  for (const auto &axis : axes) {
+    if (!axis.is_range) {
+      points.push_back(axis.values);
+      continue;
+    }
+    std::vector<double> values;
+    for (size_t i = 0; i < kGridSteps; ++i) {
+      values.push_back(axis.values[0] + (axis.values[1] - axis.values[0]) * i /
+                                            (kGridSteps - 1));
+    }
+    points.push_back(values);
+  }
+
+  std::vector<size_t> index(axes.size(), 0);
+  while (true) {
+    Result result;
+    for (size_t i = 0; i < axes.size(); ++i) {
+      result.values.push_back(points[i][index[i]]);
+    }
+    results->push_back(result);
+
+    size_t i = 0;
+    for (; i < axes.size(); ++i) {
+      if (++index[i] < points[i].size()) {
+        break;
+      }
+      index[i] = 0;
+    }
+    if (i == axes.size()) {
+      break;
+    }
+  }
+}
+
+void MakeRandom(const std::vector<Axis> &axes, size_t num_settings,
+                unsigned int seed, std::vector<Result> *results) {
+  std::mt19937 engine(seed);
+  for (size_t n = 0; n < num_settings; ++n) {
+    Result result;
+    for (const auto &axis : axes) {
+      if (axis.is_range) {
+        std::uniform_real_distribution<double> dist(axis.values[0],
+                                                    axis.values[1]);
+        result.values.push_back(dist(engine));
+      } else {
+        std::uniform_int_distribution<size_t> dist(0, axis.values.size() - 1);
+        result.values.push_back(axis.values[dist(engine)]);
+      }
+    }
+    results->push_back(result);
+  }
+}
+
+void Usage(const char *program) {
+  fprintf(stderr, "Usage: %s [options] <manifest>\n", program);
+  fprintf(stderr, "The manifest has a line <file><TAB><expected text> for each "
+                  "spectrum capture or pattern file.\n");
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "  -p <name>=<v1>,<v2>,... : Values of a parameter\n");
+  fprintf(stderr, "  -p <name>=<min>:<max>   : Range of a parameter, split "
+                  "into %ld points on a grid\n",
+          kGridSteps);
+  fprintf(stderr, "  -n <num> : Random search of num settings instead of "
+                  "the grid\n");
+  fprintf(stderr, "  -s <seed> : Seed of the random search\n");
+  fprintf(stderr, "  -j <num> : Number of threads, all cores by default\n");
+  fprintf(stderr, "parameters:");
+  for (const auto &spec : kParameters) {
+    fprintf(stderr, " %s", spec.name);
+  }
+  fprintf(stderr, "\n");
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::vector<Axis> axes;
+  size_t num_settings = 0;
+  unsigned int seed = 1;
+  size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+  while (true) {
+    int c = getopt(argc, argv, "p:n:s:j:");
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'p': {
+      Axis axis;
+      if (!ParseAxis(optarg, &axis)) {
+        fprintf(stderr, "invalid parameter: %s\n", optarg);
+        return 1;
+      }
+      axes.push_back(axis);
+      break;
+    }
+    case 'n':
+      num_settings = strtoul(optarg, nullptr, 10);
+      break;
+    case 's':
+      seed = strtoul(optarg, nullptr, 10);
+      break;
+    case 'j':
+      num_threads = std::max(1ul, strtoul(optarg, nullptr, 10));
+      break;
+    default:
+      Usage(basename(argv[0]));
+      return 1;
+    }
+  }
+  if (optind >= argc) {
+    Usage(basename(argv[0]));
+    return 1;
+  }
+
+  std::vector<Recording> recordings;
+  if (LoadManifest(argv[optind], &recordings) < 0) {
+    return 1;
+  }
+  if (recordings.empty()) {
+    fprintf(stderr, "%s: no recordings\n", argv[optind]);
+    return 1;
+  }
+
+  std::vector<Result> results;
+  if (num_settings > 0) {
+    MakeRandom(axes, num_settings, seed, &results);
+  } else {
+    MakeGrid(axes, &results);
+  }
+
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < std::min(num_threads, results.size()); ++i) {
+    threads.emplace_back([&] {
+      size_t index;
+      while ((index = next++) < results.size()) {
+        Evaluate(recordings, axes, &results[index]);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // the most accurate first, the cheaper one of the equally accurate
+  std::sort(results.begin(), results.end(), [](const auto &a, const auto &b) {
+    if (a.accuracy != b.accuracy) {
+      return a.accuracy > b.accuracy;
+    }
+    return a.cpu_time < b.cpu_time;
+  });
+
+  printf("accuracy cpu_ms peak_lines");
+  for (const auto &axis : axes) {
+    printf(" %s", axis.spec->name);
+  }
+  printf("\n");
+  for (const auto &result : results) {
+    printf("%8.4f %6.1f %10ld", result.accuracy, result.cpu_time * 1000,
+           result.peak_world_lines);
+    for (double value : result.values) {
+      printf(" %g", value);
+    }
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,67 @@
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "language_model.h"
+
+/**
+ * Makes a language model file from text files, e.g. QSO logs, word lists,
+ * callsigns, and Q codes.
+ */
+int main(int argc, char *argv[]) {
+  uint32_t order = morse::kMaxModelOrder;
+  while (true) {
+    int c = getopt(argc, argv, "n:");
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'n':
+      order = atoi(optarg);
+      if (order < 1 || order > morse::kMaxModelOrder) {
+        fprintf(stderr, "order must be in the range of [1:%u]\n",
+                morse::kMaxModelOrder);
+        return 1;
+      }
+      break;
+    }
+  }
+
+  if (optind + 2 > argc) {
+    fprintf(stderr, "Usage: %s [-n order] <model_file> <text_file>...\n",
+            basename(argv[0]));
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  -n <order> : Length of the n-grams, default=%u\n",
+            morse::kMaxModelOrder);
+    return 1;
+  }
+
+  morse::LanguageModelBuilder builder(order);
+  const char *model_file_name = argv[optind++];
+  for (; optind < argc; ++optind) {
+    const char *file_name = argv[optind];
+    FILE *file = fopen(file_name, "r");
+    if (file == nullptr) {
+      fprintf(stderr, "File error: %s: %s\n", file_name, strerror(errno));
+      return 1;
+    }
+    char buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      builder.AddText(std::string_view(buffer, size));
+    }
+    // files are separated as words
+    builder.AddText(" ");
+    fclose(file);
+  }
+
+  if (builder.Write(model_file_name) < 0) {
+    fprintf(stderr, "File write failed: %s (%s)\n", model_file_name,
+            strerror(errno));
+    return 1;
+  }
+  return 0;
+}
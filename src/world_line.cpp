@@ -1,15 +1,42 @@
 #include "world_line.h"
 
+#include <math.h>
+#include <stdint.h>
+
+#include "language_model.h"
+
 namespace morse {
 
+// weight of a given dot length, in dots
+static const uint32_t kGivenDotCount = 4;
+
 WorldLine::WorldLine(const WorldLine &src)
     : clock_(src.clock_), prev_level_(src.prev_level_),
       line_state_(src.line_state_), sum_dot_length_(src.sum_dot_length_),
-      dot_count_(src.dot_count_),
+      dot_count_(src.dot_count_), parameters_(src.parameters_),
       decoder_state_(src.decoder_state_), signals_{src.signals_},
       characters_{src.characters_},
       estimated_dot_length_(src.estimated_dot_length_),
-      confidence_score_(src.confidence_score_) {}
+      confidence_score_(src.confidence_score_), context_(src.context_),
+      word_{src.word_}, dominated_since_(src.dominated_since_) {}
+
+size_t WorldLine::GetMemoryUsage() const {
+  return sizeof(*this) + signals_.capacity() + characters_.capacity() +
+         word_.capacity();
+}
+
+void WorldLine::DropCharacters(size_t num_characters) {
+  // every character is preceded by a break in the signals
+  size_t end = 0;
+  for (size_t i = 0; i < num_characters && end != std::string::npos; ++i) {
+    end = signals_.find(' ', end);
+    if (end != std::string::npos) {
+      ++end;
+    }
+  }
+  signals_.erase(0, end);
+  characters_.erase(0, num_characters);
+}
 
 bool WorldLine::Update(uint8_t level) {
   ++clock_;
@@ -30,34 +57,95 @@ bool WorldLine::Update(uint8_t level) {
   return changed;
 }
 
+size_t WorldLine::GetQuietWindows() const {
+  // a drop is due, or nothing is after the first mark
+  if (prev_level_ > 0) {
+    return 0;
+  }
+  if (dot_count_ == 0) {
+    return SIZE_MAX;
+  }
+  double ratio;
+  if (line_state_ == LineState::LOW) {
+    ratio = parameters_->letter_space_ratio;
+  } else if (line_state_ == LineState::BREAK) {
+    ratio = parameters_->word_space_ratio;
+  } else {
+    return SIZE_MAX;
+  }
+  // ExtendBreak changes the line once clock_ exceeds the threshold
+  double threshold = estimated_dot_length_ * ratio;
+  if (clock_ > threshold) {
+    return 0;
+  }
+  return static_cast<size_t>(threshold) - clock_;
+}
+
+void WorldLine::SetDotLength(double dot_length) {
+  dot_count_ = kGivenDotCount;
+  sum_dot_length_ = dot_length * kGivenDotCount;
+  estimated_dot_length_ = dot_length;
+}
+
+void WorldLine::SaveState(StateWriter *writer) const {
+  writer->Put(clock_);
+  writer->Put(prev_level_);
+  writer->Put(line_state_);
+  writer->Put(sum_dot_length_);
+  writer->Put(dot_count_);
+  writer->Put(decoder_state_);
+  writer->PutString(signals_);
+  writer->PutString(characters_);
+  writer->Put(estimated_dot_length_);
+  writer->Put(confidence_score_);
+  writer->Put(context_);
+  writer->PutString(word_);
+  writer->Put(dominated_since_);
+}
+
+bool WorldLine::LoadState(StateReader *reader) {
+  reader->Get(&clock_);
+  reader->Get(&prev_level_);
+  reader->Get(&line_state_);
+  reader->Get(&sum_dot_length_);
+  reader->Get(&dot_count_);
+  reader->Get(&decoder_state_);
+  reader->GetString(&signals_);
+  reader->GetString(&characters_);
+  reader->Get(&estimated_dot_length_);
+  reader->Get(&confidence_score_);
+  reader->Get(&context_);
+  reader->GetString(&word_);
+  reader->Get(&dominated_since_);
+  return !reader->Failed();
+}
+
 void WorldLine::Rise() {
   auto prev_line_state = line_state_;
   line_state_ = LineState::HIGH;
   if (prev_line_state == LineState::LOW) {
-    if (clock_ < estimated_dot_length_ * 0.3) {
+    if (clock_ < estimated_dot_length_ * parameters_->min_element_ratio) {
       Terminate();
       return;
     }
-    if (clock_ > estimated_dot_length_ * 1.5) {
-      if (clock_ < estimated_dot_length_ * 2.5) {
+    if (clock_ > estimated_dot_length_ * parameters_->ambiguous_ratio) {
+      if (clock_ < estimated_dot_length_ * parameters_->break_ratio) {
         double probability = (((double)clock_) / estimated_dot_length_) / 3.0;
         // double probability = 0.5;
         auto fork = Fork(probability);
         fork->AddBreak(true);
       } else {
         AddBreak(true);
-        if (clock_ > estimated_dot_length_ * 5) {
+        if (clock_ > estimated_dot_length_ * parameters_->letter_space_ratio) {
           AddSpace();
         }
         return;
       }
     }
-    sum_dot_length_ += clock_;
-    dot_count_ += 1;
-    estimated_dot_length_ = sum_dot_length_ / dot_count_;
+    UpdateDotLength(1);
   }
   if (prev_line_state == LineState::BREAK &&
-      clock_ > estimated_dot_length_ * 10) {
+      clock_ > estimated_dot_length_ * parameters_->long_break_ratio) {
     confidence_score_ *= 0.5;
   }
   clock_ = 0;
@@ -69,16 +157,16 @@ void WorldLine::Drop() {
     Fork()->AddDash();
     AddDot();
   } else {
-    if (clock_ < estimated_dot_length_ * 0.3) {
+    if (clock_ < estimated_dot_length_ * parameters_->min_element_ratio) {
       Terminate();
       return;
-    } else if (clock_ < estimated_dot_length_ * 2.3) {
-      if (clock_ > estimated_dot_length_ * 1.5) {
+    } else if (clock_ < estimated_dot_length_ * parameters_->dash_ratio) {
+      if (clock_ > estimated_dot_length_ * parameters_->ambiguous_ratio) {
         double probability = (((double)clock_) / estimated_dot_length_) / 3.0;
         Fork(probability)->AddDash();
       }
       AddDot();
-    } else if (clock_ > estimated_dot_length_ * 7) {
+    } else if (clock_ > estimated_dot_length_ * parameters_->max_dash_ratio) {
       Terminate();
       return;
     } else {
@@ -93,13 +181,15 @@ bool WorldLine::ExtendBreak() {
     return false;
   }
   bool changed = false;
-  if (line_state_ == LineState::LOW && clock_ > estimated_dot_length_ * 5) {
+  if (line_state_ == LineState::LOW &&
+      clock_ > estimated_dot_length_ * parameters_->letter_space_ratio) {
     AddBreak(false);
     // AddSpace();
     line_state_ = LineState::BREAK;
     changed = true;
   }
-  if (line_state_ == LineState::BREAK && clock_ > estimated_dot_length_ * 7) {
+  if (line_state_ == LineState::BREAK &&
+      clock_ > estimated_dot_length_ * parameters_->word_space_ratio) {
     AddSpace();
     line_state_ = LineState::IDLE;
     changed = true;
@@ -132,17 +222,43 @@ void WorldLine::AddBreak(bool update_dot_length) {
     Terminate();
   }
   characters_.push_back(static_cast<char>(decoder_state_));
+  if (decoder_state_ != 0) {
+    Score(static_cast<char>(decoder_state_));
+  }
   decoder_state_ = 0;
 }
 
 void WorldLine::AddSpace() {
   signals_.push_back(' ');
   characters_.push_back(' ');
+  Score(' ');
+}
+
+void WorldLine::Score(char c) {
+  const LanguageModel *model = parameters_->language_model;
+  if (model == nullptr) {
+    return;
+  }
+  double score = model->ScoreCharacter(context_, c);
+  if (c == ' ') {
+    score += model->ScoreWord(word_);
+    word_.clear();
+  } else {
+    word_.push_back(c);
+  }
+  context_ = LanguageModel::PushContext(context_, c);
+  confidence_score_ *= exp(parameters_->language_weight * score);
 }
 
 void WorldLine::UpdateDotLength(uint32_t num_dots) {
   sum_dot_length_ += clock_;
   dot_count_ += num_dots;
+  // the older elements fade out so that the estimate follows the speed
+  size_t window = parameters_->dot_length_window;
+  if (window > 0 && dot_count_ > window) {
+    sum_dot_length_ *= static_cast<double>(window) / dot_count_;
+    dot_count_ = window;
+  }
   estimated_dot_length_ = sum_dot_length_ / dot_count_;
   clock_ = 0;
 }
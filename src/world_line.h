@@ -4,7 +4,9 @@
 #include <cstdint>
 #include <string>
 
+#include "checkpoint.h"
 #include "node.h"
+#include "parameters.h"
 
 namespace morse {
 
@@ -16,15 +18,22 @@ enum class LineState {
 };
 
 class WorldLine : public Node {
+public:
+  static constexpr uint64_t kNotDominated = UINT64_MAX;
+
 private:
   uint64_t clock_ = 0;
   uint8_t prev_level_ = 0;
 
   LineState line_state_ = LineState::IDLE;
 
+  // the dot length is the sum over the count, both of which decay once the
+  // count reaches ReaderParameters::dot_length_window
   double sum_dot_length_ = 0.0;
   uint32_t dot_count_ = 0;
 
+  const ReaderParameters *parameters_;
+
   int16_t decoder_state_ = 0;
   std::string signals_ = {};
   std::string characters_ = {};
@@ -32,21 +41,74 @@ private:
   double estimated_dot_length_ = 0.0;
   double confidence_score_ = 1.0;
 
+  // the last characters and the current word for the language model
+  uint32_t context_ = 0;
+  std::string word_ = {};
+
+  // characters read by the most confident line, committed ones included,
+  // when it started to dominate this line; kNotDominated if it does not
+  uint64_t dominated_since_ = kNotDominated;
+
 public:
-  WorldLine() {}
+  explicit WorldLine(const ReaderParameters *parameters)
+      : parameters_(parameters) {}
   WorldLine(const WorldLine &src);
+  WorldLine(const WorldLine &src, const ReaderParameters *parameters)
+      : WorldLine(src) {
+    parameters_ = parameters;
+  }
   ~WorldLine() = default;
 
   bool Update(uint8_t level);
 
+  /**
+   * Returns the number of windows of silence from now in which Update(0)
+   * would not change the line.
+   */
+  size_t GetQuietWindows() const;
+
+  /**
+   * Passes windows of silence that do not change the line, see
+   * GetQuietWindows.
+   */
+  inline void SkipQuietWindows(size_t num_windows) { clock_ += num_windows; }
+
+  /**
+   * Gives the line a dot length in windows as if it had read a few dots of
+   * it, e.g. when reading starts in the middle of a recording.
+   */
+  void SetDotLength(double dot_length);
+
   void ChildRemoved();
 
+  /**
+   * Saves and loads the state of the line for a checkpoint. LoadState
+   * returns false if the state is broken.
+   */
+  void SaveState(StateWriter *writer) const;
+  bool LoadState(StateReader *reader);
+
   inline WorldLine *Next() { return reinterpret_cast<WorldLine *>(next_); }
 
+  /**
+   * Removes the first characters that have been committed, with their
+   * signals.
+   */
+  void DropCharacters(size_t num_characters);
+
   inline const std::string &GetSignals() const { return signals_; }
   inline const std::string &GetCharacters() const { return characters_; }
   inline double GetDotLength() const { return estimated_dot_length_; }
   inline double GetConfidence() const { return confidence_score_; }
+  inline uint64_t GetDominatedSince() const { return dominated_since_; }
+  inline void SetDominatedSince(uint64_t position) {
+    dominated_since_ = position;
+  }
+
+  /**
+   * Returns the bytes held by the line and its strings.
+   */
+  size_t GetMemoryUsage() const;
   void NormalizeConfidence(double scale, bool do_square) {
     if (scale != 0.0) {
       confidence_score_ /= scale;
@@ -65,6 +127,16 @@ private:
   void AddDash();
   void AddBreak(bool update_dot_length);
   void AddSpace();
+
+  /**
+   * Scores a character read by the line with the language model.
+   */
+  void Score(char c);
+
+  /**
+   * Adds the element or the gap that has lasted clock_ as num_dots to the dot
+   * length, and restarts the clock.
+   */
   void UpdateDotLength(uint32_t num_dots);
 
   static int16_t Decode(int16_t state, char signal);